@@ -0,0 +1,335 @@
+/**
+* @brief   Replay archive tool
+*
+*
+* Commands:
+*   pack [-i interval] replay archive
+*       Plays the replay once and writes it as an archive
+*       (archive.h) with a keyframe every interval ticks
+*   seek archive tick [snapshot]
+*       Plays only the block holding tick, up to tick, prints
+*       the game there and optionally saves it as a snapshot
+*       that tetris-host loads with TETRIS_INJECT
+*   check [-j threads] archive
+*       Plays every block in parallel from its own keyframe and
+*       checks that it ends exactly at the next keyframe, and the
+*       last block at the claimed results
+*
+* Build (from the repository root, same BOARD_CONFIG as the
+* recorder):
+*   cc -O2 -pthread -DHOST_BUILD -DSERVER_BUILD -o tetris-archive tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/headless.c host/leaderboard.c host/replay.c host/archive.c host/archive-tool.c
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "archive.h"
+#include "headless.h"
+#include "leaderboard.h"
+
+#define MAX_WORKERS 64
+
+/* Keyframe of this thread's game before its next tick */
+static void capture_keyframe(ArchiveKeyframe *keyframe, uint8_t *state, const HeadlessCounts *counts)
+{
+    memset(keyframe, 0, sizeof(*keyframe));
+    keyframe->pieces = counts->pieces;
+    keyframe->lines = counts->lines;
+    keyframe->lastSwitches = lastSwitchState;
+    keyframe->lastButton = lastButtonState;
+    keyframe->stateLength = snapshot_save(state);
+}
+
+/**
+* @brief Converts a replay into an archive
+*
+*
+* Pack function that:
+* 1. Starts the replay's game on this thread
+* 2. Before every interval-th tick, hands the writer a keyframe
+*    of the running game, then adds the tick's input and plays it
+* 3. Finishes with the replay's header as the claims
+*
+* Claims are copied, not checked; tetris-verify and the check
+* command do that.
+*/
+static int pack(const char *replayPath, const char *archivePath, uint32_t interval)
+{
+    ReplayReader reader;
+    ArchiveWriter writer;
+    ArchiveKeyframe keyframe;
+    HeadlessCounts counts;
+    uint8_t state[SESSION_STATE_BYTES];
+    int input;
+
+    if (replay_open(&reader, replayPath) != 0)
+    {
+        fprintf(stderr, "%s: not a readable replay\n", replayPath);
+        return 1;
+    }
+    if (archive_create(&writer, archivePath, interval) != 0)
+    {
+        fprintf(stderr, "%s: cannot create (interval 1-65535)\n", archivePath);
+        replay_close(&reader);
+        return 1;
+    }
+
+    headless_start(reader.header.seed, reader.header.switches & SESSION_START_SWITCHES, &counts);
+    while ((input = replay_next(&reader)) >= 0)
+    {
+        if (archive_keyframe_due(&writer))
+        {
+            capture_keyframe(&keyframe, state, &counts);
+            if (archive_add_keyframe(&writer, &keyframe, state) != 0)
+            {
+                break;
+            }
+        }
+        archive_add_tick(&writer, input);
+        headless_tick(input, reader.header.switches, &counts);
+    }
+    replay_close(&reader);
+
+    if (archive_finish(&writer, &reader.header) != 0)
+    {
+        fprintf(stderr, "%s: write failed or replay truncated\n", archivePath);
+        return 1;
+    }
+    printf("%s: %u ticks, %u blocks of %u\n", archivePath, reader.header.ticks,
+           (reader.header.ticks + interval - 1) / interval, interval);
+    return 0;
+}
+
+/**
+* @brief Plays a block from its keyframe for ticks ticks
+*
+* @return 1, or 0 if the keyframe does not fit this build
+*/
+static int play_block(const Archive *archive, const ArchiveBlock *block, uint32_t ticks, HeadlessCounts *counts)
+{
+    const ArchiveKeyframe *keyframe = &block->keyframe;
+
+    if (!headless_resume(block->state, keyframe->stateLength, keyframe->lastButton, keyframe->lastSwitches))
+    {
+        return 0;
+    }
+    counts->pieces = keyframe->pieces;
+    counts->lines = keyframe->lines;
+    counts->endCause = -1;
+    for (uint32_t i = 0; i < ticks; i++)
+    {
+        headless_tick(block->inputs[i], archive->header.claims.switches, counts);
+    }
+    return 1;
+}
+
+static int seek(const char *archivePath, uint32_t tick, const char *snapshotPath)
+{
+    Archive archive;
+    ArchiveBlock block;
+    HeadlessCounts counts;
+    uint8_t state[SESSION_STATE_BYTES];
+
+    if (archive_open(&archive, archivePath) != 0)
+    {
+        fprintf(stderr, "%s: not a readable archive\n", archivePath);
+        return 1;
+    }
+    int index = archive_find_block(&archive, tick);
+    if (index < 0 || archive_read_block(&archive, index, &block) != 0)
+    {
+        fprintf(stderr, "%s: no tick %u (%u ticks)\n", archivePath, tick, archive.header.claims.ticks);
+        archive_close(&archive);
+        return 1;
+    }
+
+    uint32_t played = tick - block.keyframe.firstTick;
+    int resumed = play_block(&archive, &block, played, &counts);
+    archive_free_block(&block);
+    archive_close(&archive);
+    if (!resumed)
+    {
+        fprintf(stderr, "%s: recorded with another board size\n", archivePath);
+        return 1;
+    }
+
+    int length = snapshot_save(state);
+    printf("tick %u: score %d, %u pieces, %u lines, %s (%u ticks played from the keyframe at %u)\n",
+           tick, score, counts.pieces, counts.lines, gameOver ? "game over" : "running",
+           played, tick - played);
+    if (snapshotPath)
+    {
+        FILE *file = fopen(snapshotPath, "wb");
+        if (!file || fwrite(state, 1, length, file) != (size_t)length || fclose(file) != 0)
+        {
+            perror(snapshotPath);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Shared by the check workers */
+static Archive checkArchive;
+static atomic_int checkNext;
+static char **checkErrors; // One message per failed block, 0 if it passed
+
+/**
+* @brief Plays one block and compares where it ends
+*
+* The end state of a block must equal the next block's keyframe
+* (snapshot bytes, edge state and counts); the last block must
+* end the game with the claimed results.
+*
+* @return 0, or a message to free
+*/
+static char *check_block(int index)
+{
+    ArchiveBlock block, next;
+    HeadlessCounts counts;
+    uint8_t state[SESSION_STATE_BYTES];
+    const ReplayHeader *claims = &checkArchive.header.claims;
+    char *error = 0;
+
+    if (archive_read_block(&checkArchive, index, &block) != 0)
+    {
+        return strdup("damaged block");
+    }
+    if (!play_block(&checkArchive, &block, block.ticks, &counts))
+    {
+        archive_free_block(&block);
+        return strdup("keyframe does not fit this build");
+    }
+    int length = snapshot_save(state);
+
+    if (index + 1 < (int)checkArchive.blockCount)
+    {
+        if (archive_read_block(&checkArchive, index + 1, &next) != 0)
+        {
+            error = strdup("next block damaged");
+        }
+        else
+        {
+            const ArchiveKeyframe *keyframe = &next.keyframe;
+            if (keyframe->firstTick != block.keyframe.firstTick + block.ticks ||
+                keyframe->stateLength != length || memcmp(next.state, state, length) != 0 ||
+                keyframe->pieces != counts.pieces || keyframe->lines != counts.lines ||
+                keyframe->lastButton != lastButtonState || keyframe->lastSwitches != lastSwitchState ||
+                gameOver)
+            {
+                error = strdup("does not end at the next keyframe");
+            }
+            archive_free_block(&next);
+        }
+    }
+    else if (block.keyframe.firstTick + block.ticks != claims->ticks || !gameOver ||
+             score != claims->score || counts.lines != claims->lines || counts.pieces != claims->pieces ||
+             counts.endCause != claims->endCause ||
+             leaderboard_hash(LEADERBOARD_HASH_INIT, state, length) != claims->stateHash)
+    {
+        if (asprintf(&error, "ends at tick %u with score %d, %u lines, %u pieces; claimed %u, %d, %u, %u",
+                     block.keyframe.firstTick + block.ticks, score, counts.lines, counts.pieces,
+                     claims->ticks, claims->score, claims->lines, claims->pieces) < 0)
+        {
+            error = 0;
+        }
+    }
+    archive_free_block(&block);
+    return error;
+}
+
+static void *check_worker(void *arg)
+{
+    int index;
+
+    while ((index = atomic_fetch_add(&checkNext, 1)) < (int)checkArchive.blockCount)
+    {
+        checkErrors[index] = check_block(index);
+    }
+    return 0;
+}
+
+static int check(const char *archivePath, int workerCount)
+{
+    pthread_t workers[MAX_WORKERS];
+    struct timespec start, end;
+    int failed = 0;
+
+    if (archive_open(&checkArchive, archivePath) != 0)
+    {
+        fprintf(stderr, "%s: not a readable archive\n", archivePath);
+        return 1;
+    }
+    checkErrors = calloc(checkArchive.blockCount + 1, sizeof(char *));
+    workerCount = workerCount < 1 ? 1 : workerCount > MAX_WORKERS ? MAX_WORKERS : workerCount;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < workerCount; i++)
+    {
+        pthread_create(&workers[i], 0, check_worker, 0);
+    }
+    for (int i = 0; i < workerCount; i++)
+    {
+        pthread_join(workers[i], 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (uint32_t i = 0; i < checkArchive.blockCount; i++)
+    {
+        if (checkErrors[i])
+        {
+            printf("%s: block %u (tick %u): %s\n", archivePath, i, checkArchive.index[i].firstTick, checkErrors[i]);
+            free(checkErrors[i]);
+            failed = 1;
+        }
+    }
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %u blocks, %u ticks in %.3f s with %d threads%s\n", archivePath, checkArchive.blockCount,
+           checkArchive.header.claims.ticks, seconds, workerCount, failed ? "" : ", all verified");
+    free(checkErrors);
+    archive_close(&checkArchive);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    headless_init();
+
+    if (argc >= 4 && strcmp(argv[1], "pack") == 0)
+    {
+        int interval = ARCHIVE_INTERVAL;
+        int first = 2;
+        if (argc >= 6 && strcmp(argv[2], "-i") == 0)
+        {
+            interval = atoi(argv[3]);
+            first = 4;
+        }
+        return pack(argv[first], argv[first + 1], interval > 0 ? interval : 0);
+    }
+    if (argc >= 4 && strcmp(argv[1], "seek") == 0)
+    {
+        return seek(argv[2], strtoul(argv[3], 0, 0), argc > 4 ? argv[4] : 0);
+    }
+    if (argc >= 3 && strcmp(argv[1], "check") == 0)
+    {
+        int workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+        int first = 2;
+        if (argc >= 5 && strcmp(argv[2], "-j") == 0)
+        {
+            workerCount = atoi(argv[3]);
+            first = 4;
+        }
+        return check(argv[first], workerCount);
+    }
+
+    fprintf(stderr, "usage: %s pack [-i interval] replay archive\n"
+                    "       %s seek archive tick [snapshot]\n"
+                    "       %s check [-j threads] archive\n",
+            argv[0], argv[0], argv[0]);
+    return 2;
+}
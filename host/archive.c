@@ -0,0 +1,351 @@
+/**
+* @brief   Seekable replay archives
+*
+*
+* See archive.h. Readers keep only the header and the index in
+* memory and pread() one block at a time, so several threads
+* can share one Archive. The writer keeps one block in memory
+* and writes to path.tmp, renamed into place by
+* archive_finish().
+*/
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "archive.h"
+
+#define ARCHIVE_MAX_INTERVAL 65535 // runCount must fit in 16 bits
+
+/**
+* @brief Opens an archive and reads its header and index
+*
+* @return 0, -1 if the file cannot be read, -2 if it is not a
+*         complete archive of this version
+*/
+int archive_open(Archive *archive, const char *path)
+{
+    ArchiveTrailer trailer;
+    off_t size;
+
+    archive->index = 0;
+    archive->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (archive->fd < 0)
+    {
+        return -1;
+    }
+
+    size = lseek(archive->fd, 0, SEEK_END);
+    if (size < (off_t)(sizeof(ArchiveHeader) + sizeof(trailer)) ||
+        pread(archive->fd, &archive->header, sizeof(archive->header), 0) != sizeof(archive->header) ||
+        pread(archive->fd, &trailer, sizeof(trailer), size - sizeof(trailer)) != sizeof(trailer) ||
+        archive->header.claims.magic != ARCHIVE_MAGIC || archive->header.claims.version != REPLAY_VERSION ||
+        trailer.magic != ARCHIVE_MAGIC ||
+        trailer.indexOffset + (uint64_t)trailer.blockCount * sizeof(ArchiveIndexEntry) + sizeof(trailer) != (uint64_t)size)
+    {
+        archive_close(archive);
+        return -2;
+    }
+
+    size_t indexBytes = (size_t)trailer.blockCount * sizeof(ArchiveIndexEntry);
+    archive->blockCount = trailer.blockCount;
+    archive->index = malloc(indexBytes ? indexBytes : 1);
+    if (!archive->index || pread(archive->fd, archive->index, indexBytes, trailer.indexOffset) != (ssize_t)indexBytes)
+    {
+        archive_close(archive);
+        return -1;
+    }
+    return 0;
+}
+
+void archive_close(Archive *archive)
+{
+    free(archive->index);
+    archive->index = 0;
+    if (archive->fd >= 0)
+    {
+        close(archive->fd);
+        archive->fd = -1;
+    }
+}
+
+/**
+* @brief Block holding a tick, by binary search of the index
+*
+* @return Block number, or -1 past the last tick
+*/
+int archive_find_block(const Archive *archive, uint32_t tick)
+{
+    int low = 0;
+    int high = (int)archive->blockCount - 1;
+
+    if (tick >= archive->header.claims.ticks || high < 0)
+    {
+        return -1;
+    }
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if (archive->index[middle].firstTick <= tick)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/**
+* @brief Reads one block and decodes its inputs
+*
+*
+* Read function that:
+* 1. Reads the whole block with a single pread
+* 2. Checks the keyframe and run lengths against the block
+*    length and the index
+* 3. Expands the runs into one input byte per tick
+*
+* @param out Filled on success; release with archive_free_block
+* @return 0, or -1 on a read error or a damaged block
+*/
+int archive_read_block(const Archive *archive, int block, ArchiveBlock *out)
+{
+    const ArchiveIndexEntry *entry = &archive->index[block];
+    uint8_t *bytes = malloc(entry->length ? entry->length : 1);
+
+    out->inputs = 0;
+    if (!bytes || entry->length < sizeof(ArchiveKeyframe) ||
+        pread(archive->fd, bytes, entry->length, entry->offset) != (ssize_t)entry->length)
+    {
+        free(bytes);
+        return -1;
+    }
+
+    memcpy(&out->keyframe, bytes, sizeof(out->keyframe));
+    const ArchiveKeyframe *keyframe = &out->keyframe;
+    const uint8_t *runs = bytes + sizeof(*keyframe) + keyframe->stateLength;
+    if (keyframe->firstTick != entry->firstTick || keyframe->stateLength > SESSION_STATE_BYTES ||
+        sizeof(*keyframe) + keyframe->stateLength + 2 * (size_t)keyframe->runCount != entry->length)
+    {
+        free(bytes);
+        return -1;
+    }
+    memcpy(out->state, bytes + sizeof(*keyframe), keyframe->stateLength);
+
+    out->ticks = 0;
+    for (int i = 0; i < keyframe->runCount; i++)
+    {
+        out->ticks += runs[2 * i + 1];
+    }
+    out->inputs = malloc(out->ticks ? out->ticks : 1);
+    if (!out->inputs)
+    {
+        free(bytes);
+        return -1;
+    }
+    uint32_t tick = 0;
+    for (int i = 0; i < keyframe->runCount; i++)
+    {
+        memset(out->inputs + tick, runs[2 * i], runs[2 * i + 1]);
+        tick += runs[2 * i + 1];
+    }
+    free(bytes);
+    return 0;
+}
+
+void archive_free_block(ArchiveBlock *block)
+{
+    free(block->inputs);
+    block->inputs = 0;
+}
+
+/**
+* @brief Starts writing an archive with interval ticks per block
+*
+* @return 0, or -1 if the file cannot be created
+*/
+int archive_create(ArchiveWriter *writer, const char *path, uint32_t interval)
+{
+    ArchiveHeader placeholder;
+    char temporary[sizeof(writer->path) + 4];
+
+    writer->file = 0;
+    writer->index = 0;
+    writer->runs = 0;
+    if (interval == 0 || interval > ARCHIVE_MAX_INTERVAL || strlen(path) >= sizeof(writer->path))
+    {
+        return -1;
+    }
+    strcpy(writer->path, path);
+    memset(&placeholder, 0, sizeof(placeholder));
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    writer->interval = interval;
+    writer->ticks = 0;
+    writer->blockCount = 0;
+    writer->indexCapacity = 0;
+    writer->keyframe.runCount = 0;
+    writer->runs = malloc(2 * interval);
+    writer->file = writer->runs ? fopen(temporary, "wb") : 0;
+    if (!writer->file || fwrite(&placeholder, sizeof(placeholder), 1, writer->file) != 1)
+    {
+        archive_abandon(writer);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+* @brief Whether the next tick starts a block, so it needs a keyframe
+*/
+int archive_keyframe_due(const ArchiveWriter *writer)
+{
+    return writer->ticks % writer->interval == 0;
+}
+
+/* Writes the open block, if any, and indexes it */
+static int flush_block(ArchiveWriter *writer)
+{
+    ArchiveKeyframe *keyframe = &writer->keyframe;
+
+    if (writer->ticks == 0)
+    {
+        return 0;
+    }
+    if (writer->blockCount == writer->indexCapacity)
+    {
+        uint32_t capacity = writer->indexCapacity ? writer->indexCapacity * 2 : 64;
+        ArchiveIndexEntry *index = realloc(writer->index, capacity * sizeof(*index));
+        if (!index)
+        {
+            return -1;
+        }
+        writer->index = index;
+        writer->indexCapacity = capacity;
+    }
+
+    ArchiveIndexEntry *entry = &writer->index[writer->blockCount++];
+    entry->firstTick = keyframe->firstTick;
+    entry->offset = ftello(writer->file);
+    entry->length = sizeof(*keyframe) + keyframe->stateLength + 2 * keyframe->runCount;
+    if (fwrite(keyframe, sizeof(*keyframe), 1, writer->file) != 1 ||
+        fwrite(writer->state, 1, keyframe->stateLength, writer->file) != keyframe->stateLength ||
+        fwrite(writer->runs, 2, keyframe->runCount, writer->file) != keyframe->runCount)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+* @brief Ends the open block and begins the next at its keyframe
+*
+* Call exactly when archive_keyframe_due(), before the tick's
+* input.
+*
+* @param keyframe Edge state and counts before this tick;
+*                 firstTick and runCount are filled in here
+* @param state keyframe->stateLength bytes of snapshot_save()
+* @return 0, or -1 on a write error
+*/
+int archive_add_keyframe(ArchiveWriter *writer, const ArchiveKeyframe *keyframe, const uint8_t *state)
+{
+    if (flush_block(writer) != 0 || keyframe->stateLength > SESSION_STATE_BYTES)
+    {
+        return -1;
+    }
+    writer->keyframe = *keyframe;
+    writer->keyframe.firstTick = writer->ticks;
+    writer->keyframe.runCount = 0;
+    memcpy(writer->state, state, keyframe->stateLength);
+    return 0;
+}
+
+/**
+* @brief Adds one tick's packed input to the open block
+*/
+void archive_add_tick(ArchiveWriter *writer, uint8_t input)
+{
+    uint8_t *run = writer->runs + 2 * writer->keyframe.runCount;
+
+    if (writer->keyframe.runCount > 0 && run[-2] == input && run[-1] < 255)
+    {
+        run[-1]++;
+    }
+    else
+    {
+        run[0] = input;
+        run[1] = 1;
+        writer->keyframe.runCount++;
+    }
+    writer->ticks++;
+}
+
+/**
+* @brief Writes the last block, the index, the trailer and the header
+*
+* @param claims Header of the game (replay.h); ticks must equal
+*               the inputs added
+* @return 0, or -1 on any error (the archive is then abandoned)
+*/
+int archive_finish(ArchiveWriter *writer, const ReplayHeader *claims)
+{
+    ArchiveHeader header;
+    ArchiveTrailer trailer;
+    char temporary[sizeof(writer->path) + 4];
+
+    header.claims = *claims;
+    header.claims.magic = ARCHIVE_MAGIC;
+    header.interval = writer->interval;
+    header.unused = 0;
+
+    if (claims->ticks != writer->ticks || flush_block(writer) != 0)
+    {
+        archive_abandon(writer);
+        return -1;
+    }
+    trailer.indexOffset = ftello(writer->file);
+    trailer.blockCount = writer->blockCount;
+    trailer.magic = ARCHIVE_MAGIC;
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", writer->path);
+    int written = fwrite(writer->index, sizeof(ArchiveIndexEntry), writer->blockCount, writer->file) == writer->blockCount &&
+                  fwrite(&trailer, sizeof(trailer), 1, writer->file) == 1 &&
+                  fseek(writer->file, 0, SEEK_SET) == 0 &&
+                  fwrite(&header, sizeof(header), 1, writer->file) == 1;
+    int closed = fclose(writer->file) == 0;
+    writer->file = 0;
+    if (!written || !closed || rename(temporary, writer->path) != 0)
+    {
+        unlink(temporary);
+        archive_abandon(writer);
+        return -1;
+    }
+    archive_abandon(writer); // Only frees the buffers now that the file is closed
+    return 0;
+}
+
+/**
+* @brief Drops an unfinished archive and frees the writer's buffers
+*
+* Safe after archive_finish() and after a failed archive_create().
+*/
+void archive_abandon(ArchiveWriter *writer)
+{
+    char temporary[sizeof(writer->path) + 4];
+
+    if (writer->file)
+    {
+        fclose(writer->file);
+        writer->file = 0;
+        snprintf(temporary, sizeof(temporary), "%s.tmp", writer->path);
+        unlink(temporary);
+    }
+    free(writer->runs);
+    free(writer->index);
+    writer->runs = 0;
+    writer->index = 0;
+}
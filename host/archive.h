@@ -0,0 +1,118 @@
+/**
+* @brief   Seekable replay archives
+*
+*
+* A replay (replay.h) can only be played from tick zero. An
+* archive splits the same game into blocks that each start
+* from a keyframe, so any tick is reached by playing at most
+* one block:
+*
+*   ArchiveHeader | block 0 | block 1 | ... | index | ArchiveTrailer
+*
+*   block    ArchiveKeyframe | stateLength bytes of snapshot |
+*            runCount (input, ticks) byte pairs
+*   index    blockCount ArchiveIndexEntry, in tick order
+*
+* A keyframe holds the packed game (snapshot_save) at its first
+* tick plus what a snapshot leaves out: the input edge state and
+* the counts so far. Inputs are run-length coded, one pair per
+* stretch of up to 255 ticks with the same input.
+*
+* Blocks depend on nothing but their own keyframe, so they can
+* be read and played independently and in parallel. The trailer
+* sits at the very end so a reader finds the index with one seek.
+* Fields are in host byte order, as in replay.h.
+*/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "replay.h"
+#include "session.h"
+
+#define ARCHIVE_MAGIC 0x31415254 // "TRA1"
+#define ARCHIVE_INTERVAL 1000    // Default ticks per block
+#define ARCHIVE_SUFFIX ".archive"
+
+typedef struct
+{
+    ReplayHeader claims;  // As in the replay, magic set to ARCHIVE_MAGIC
+    uint32_t interval;    // Ticks per block, the last block may be shorter
+    uint32_t unused;
+} ArchiveHeader;
+
+typedef struct
+{
+    uint32_t firstTick;
+    uint32_t pieces;      // Counts before firstTick
+    uint32_t lines;
+    uint16_t lastSwitches; // Input edge state before firstTick
+    uint8_t lastButton;
+    uint8_t unused;
+    uint16_t stateLength;
+    uint16_t runCount;
+} ArchiveKeyframe;
+
+typedef struct
+{
+    uint32_t firstTick;
+    uint32_t length;      // Bytes of the block
+    uint64_t offset;      // From the start of the file
+} ArchiveIndexEntry;
+
+typedef struct
+{
+    uint64_t indexOffset;
+    uint32_t blockCount;
+    uint32_t magic;       // ARCHIVE_MAGIC again, to recognise a complete file
+} ArchiveTrailer;
+
+/* An open archive: header and index in memory, blocks on disk */
+typedef struct
+{
+    int fd;
+    ArchiveHeader header;
+    uint32_t blockCount;
+    ArchiveIndexEntry *index;
+} Archive;
+
+/* One block read back: keyframe, snapshot and decoded inputs */
+typedef struct
+{
+    ArchiveKeyframe keyframe;
+    uint8_t state[SESSION_STATE_BYTES];
+    uint32_t ticks;
+    uint8_t *inputs;      // ticks bytes, owned by the block
+} ArchiveBlock;
+
+/* Archive being written; each block goes out when the next begins */
+typedef struct
+{
+    FILE *file;
+    char path[4096];
+    uint32_t interval;
+    uint32_t ticks;            // Inputs added so far
+    ArchiveIndexEntry *index;
+    uint32_t blockCount;
+    uint32_t indexCapacity;
+    ArchiveKeyframe keyframe;  // Of the open block
+    uint8_t state[SESSION_STATE_BYTES];
+    uint8_t *runs;             // (input, ticks) pairs of the open block
+} ArchiveWriter;
+
+int archive_open(Archive *archive, const char *path);
+void archive_close(Archive *archive);
+int archive_find_block(const Archive *archive, uint32_t tick);
+int archive_read_block(const Archive *archive, int block, ArchiveBlock *out);
+void archive_free_block(ArchiveBlock *block);
+
+int archive_create(ArchiveWriter *writer, const char *path, uint32_t interval);
+int archive_keyframe_due(const ArchiveWriter *writer);
+int archive_add_keyframe(ArchiveWriter *writer, const ArchiveKeyframe *keyframe, const uint8_t *state);
+void archive_add_tick(ArchiveWriter *writer, uint8_t input);
+int archive_finish(ArchiveWriter *writer, const ReplayHeader *claims);
+void archive_abandon(ArchiveWriter *writer);
+
+#endif
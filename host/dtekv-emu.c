@@ -0,0 +1,859 @@
+/**
+* @brief   DTEK-V system emulator for cycle measurements
+*
+*
+* Runs the board ELF (built with dtekv-script.lds) on an RV32IM
+* core with the devices the game uses, and reports where the
+* cycles went, function by function, without the board:
+*
+*   0x00000000  32 MB RAM
+*   0x04000010  switch PIO (data)
+*   0x04000020  interval timer (status, control, periodl, periodh)
+*   0x04000040  JTAG UART (data, control); output goes to stdout
+*   0x040000d0  button PIO (data)
+*   0x04000100  VGA DMA (buffer, backbuffer, resolution, status)
+*   0x08000000  VGA pixel buffer, 640x480 bytes
+*
+* Cycles follow a simple cost model of the in-order core: one
+* cycle per instruction plus the extra cycles below for memory,
+* taken branches, jumps, multiplies, divides and device accesses.
+* The figures are estimates; override them with -DCOST_...=n to
+* match a measured board. Absolute counts are only as good as the
+* model, differences between two builds of the game are what it
+* is for.
+*
+* The timer counts emulated cycles, so delay() loops, frame pacing
+* and piece gravity behave as on the board at 30 MHz. As in the
+* host build, a period write takes effect at the next reload
+* instead of stopping the timer. The timer raises interrupt 16
+* when ITO is set and the core has it enabled in mie and mstatus.
+*
+* Each instruction's cycles are charged to the function symbol
+* holding its address (self cost); a call is counted whenever a
+* jal or jalr that links lands on a function's first address.
+* The run ends after -c cycles or -f frames (VGA buffer swaps),
+* at an ebreak, or when the program parks in a jump-to-self loop
+* such as the one in handle_exception().
+*
+* Usage:
+*   dtekv-emu [-c cycles] [-f frames] [-b ms] [-m mode] [-o frame.ppm] [-n rows] main.elf
+*     -b ms    press the button for 100 ms every ms milliseconds
+*     -m mode  VIDEO_MODE the ELF was built with, for -o
+*     -n rows  functions in the report, 0 for all
+*
+* Environment:
+*   TETRIS_SWITCHES  switch bits, as for tetris-host
+*   TETRIS_SEED      timer status bits above RUN, as for tetris-host
+*
+* Build (from the repository root):
+*   cc -O2 -o dtekv-emu host/dtekv-emu.c
+*/
+
+#define _DEFAULT_SOURCE
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CLOCK_HZ 30000000
+#define RAM_BYTES (32u << 20)
+#define IO_BASE 0x04000000u
+#define IO_BYTES 0x1000u
+#define PIXEL_BASE 0x08000000u
+#define PIXEL_BYTES (640 * 480)
+
+#define TIMER_IRQ 16
+#define SEED_SHIFT 2 // As in dtekv-host.c
+
+/* Extra cycles on top of one per instruction */
+#ifndef COST_LOAD
+#define COST_LOAD 2     // Load from RAM, including the use stall
+#endif
+#ifndef COST_STORE
+#define COST_STORE 1
+#endif
+#ifndef COST_DEVICE
+#define COST_DEVICE 8   // Any I/O or pixel buffer access, on top of the load or store
+#endif
+#ifndef COST_BRANCH
+#define COST_BRANCH 2   // Taken branch, refetch
+#endif
+#ifndef COST_JUMP
+#define COST_JUMP 2     // jal and jalr
+#endif
+#ifndef COST_MUL
+#define COST_MUL 2
+#endif
+#ifndef COST_DIV
+#define COST_DIV 33     // One bit per cycle
+#endif
+#ifndef COST_TRAP
+#define COST_TRAP 3     // Trap entry and mret
+#endif
+
+#define MSTATUS_MIE 0x8
+#define MSTATUS_MPIE 0x80
+#define MSTATUS_MPP 0x1800
+
+typedef struct
+{
+    uint32_t address;
+    const char *name;
+    uint64_t cycles;      // Self cost
+    uint64_t instructions;
+    uint64_t calls;
+} Symbol;
+
+/* Core */
+static uint8_t *ram;
+static uint32_t regs[32];
+static uint32_t pc;
+static uint64_t cycles = 0;
+static uint64_t instructions = 0;
+static uint32_t mstatus, mie, mtvec, mscratch, mepc, mcause, mtval;
+static uint64_t stalled = 0; // Extra cycles of the current instruction
+static int halted = 0;
+
+/* Devices */
+static uint8_t pixels[PIXEL_BYTES];
+static uint32_t switches = 0;
+static uint32_t timerStatus = 0;  // TO only; RUN and the seed bits are added on read
+static uint32_t timerSeed = 0;
+static uint32_t timerControl = 0;
+static uint32_t timerPeriod[2] = {0, 0};
+static int timerRunning = 0;
+static uint64_t timerDeadline = 0;
+static uint32_t vgaFront = PIXEL_BASE;
+static uint32_t vgaBack = PIXEL_BASE;
+static uint64_t frames = 0;
+static int videoMode = 0;
+static uint64_t buttonPeriod = 0; // Cycles, 0 leaves the button up
+
+/* Symbols */
+static Symbol *symbols;
+static int symbolCount = 0;
+static int32_t *symbolAt;   // Per instruction word below textEnd
+static uint32_t textEnd = 0;
+static Symbol outside = {0, "(outside text)", 0, 0, 0};
+
+static uint32_t timer_period(void)
+{
+    return ((timerPeriod[1] & 0xFFFF) << 16 | (timerPeriod[0] & 0xFFFF)) + 1;
+}
+
+/* Sets TO for every period boundary passed; a one-shot timer stops at the first */
+static void timer_update(void)
+{
+    if (!timerRunning || cycles < timerDeadline)
+    {
+        return;
+    }
+    timerStatus |= 0x1;
+    if (timerControl & 0x2)
+    {
+        uint64_t period = timer_period();
+        timerDeadline += (cycles - timerDeadline) / period * period + period;
+    }
+    else
+    {
+        timerRunning = 0;
+    }
+}
+
+static uint32_t button_level(void)
+{
+    return buttonPeriod && cycles % buttonPeriod < CLOCK_HZ / 10;
+}
+
+static uint32_t io_read(uint32_t offset)
+{
+    switch (offset)
+    {
+    case 0x10:
+        return switches;
+    case 0x20:
+        timer_update();
+        return timerSeed | (timerRunning ? 0x2 : 0) | timerStatus;
+    case 0x24:
+        return timerControl;
+    case 0x28:
+    case 0x2C:
+        return timerPeriod[(offset - 0x28) / 4];
+    case 0x40:
+        return 0; // No input: RVALID clear
+    case 0x44:
+        return 0xFFFF0000; // Always room to write
+    case 0xD0:
+        return button_level();
+    case 0x100:
+        return vgaFront;
+    case 0x104:
+        return vgaBack;
+    case 0x108:
+        return videoMode ? (480 << 16 | 640) : (240 << 16 | 320);
+    default:
+        return 0; // Includes the swap-pending bit of the VGA status
+    }
+}
+
+static void io_write(uint32_t offset, uint32_t value)
+{
+    switch (offset)
+    {
+    case 0x20:
+        timerStatus = 0; // Any write clears TO
+        break;
+    case 0x24:
+        timerControl = value & 0xF;
+        if (value & 0x8)
+        {
+            timerRunning = 0;
+        }
+        else if (value & 0x4)
+        {
+            timerRunning = 1;
+            timerDeadline = cycles + timer_period();
+        }
+        break;
+    case 0x28:
+    case 0x2C:
+        timerPeriod[(offset - 0x28) / 4] = value & 0xFFFF;
+        break;
+    case 0x40:
+        putchar(value & 0xFF);
+        break;
+    case 0x100:
+        vgaFront = vgaBack; // Swap on the next vertical blank, which is now
+        frames++;
+        break;
+    case 0x104:
+        vgaBack = value;
+        break;
+    }
+}
+
+static void trap(uint32_t cause, uint32_t value)
+{
+    mepc = pc;
+    mcause = cause;
+    mtval = value;
+    mstatus = (mstatus & ~(MSTATUS_MPIE | MSTATUS_MIE)) | MSTATUS_MPP | ((mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+    pc = mtvec & ~3u;
+    stalled += COST_TRAP;
+}
+
+/**
+* @brief Loads size bytes, zero-extended
+*
+* @return 0 on success, or -1 after raising a load access fault
+*/
+static int load(uint32_t address, int size, uint32_t *value)
+{
+    *value = 0;
+    if (address < RAM_BYTES && address + size <= RAM_BYTES)
+    {
+        memcpy(value, ram + address, size);
+        stalled += COST_LOAD;
+        return 0;
+    }
+    stalled += COST_LOAD + COST_DEVICE;
+    if (address >= PIXEL_BASE && address - PIXEL_BASE + size <= PIXEL_BYTES)
+    {
+        memcpy(value, pixels + (address - PIXEL_BASE), size);
+        return 0;
+    }
+    if (address >= IO_BASE && address - IO_BASE < IO_BYTES)
+    {
+        uint32_t offset = address - IO_BASE;
+        uint32_t word = io_read(offset & ~3u);
+        *value = (word >> (8 * (offset & 3))) & (size == 4 ? 0xFFFFFFFF : (1u << (8 * size)) - 1);
+        return 0;
+    }
+    trap(5, address);
+    return -1;
+}
+
+/**
+* @brief Stores the low size bytes of value
+*
+* @return 0 on success, or -1 after raising a store access fault
+*/
+static int store(uint32_t address, int size, uint32_t value)
+{
+    if (address < RAM_BYTES && address + size <= RAM_BYTES)
+    {
+        memcpy(ram + address, &value, size);
+        stalled += COST_STORE;
+        return 0;
+    }
+    stalled += COST_STORE + COST_DEVICE;
+    if (address >= PIXEL_BASE && address - PIXEL_BASE + size <= PIXEL_BYTES)
+    {
+        memcpy(pixels + (address - PIXEL_BASE), &value, size);
+    }
+    else if (address >= IO_BASE && address - IO_BASE < IO_BYTES)
+    {
+        io_write((address - IO_BASE) & ~3u, value << (8 * (address & 3)));
+    }
+    else
+    {
+        trap(7, address);
+        return -1;
+    }
+    return 0;
+}
+
+/* CSR read; unknown ones, the hardware performance counters among them, read as zero */
+static uint32_t csr_read(int csr)
+{
+    switch (csr)
+    {
+    case 0x300: return mstatus;
+    case 0x301: return 0x40001100; // misa: RV32IM
+    case 0x304: return mie;
+    case 0x305: return mtvec;
+    case 0x340: return mscratch;
+    case 0x341: return mepc;
+    case 0x342: return mcause;
+    case 0x343: return mtval;
+    case 0x344: return (timerStatus & timerControl & 0x1) ? 1u << TIMER_IRQ : 0;
+    case 0xB00: case 0xC00: return (uint32_t)cycles;
+    case 0xB80: case 0xC80: return (uint32_t)(cycles >> 32);
+    case 0xB02: case 0xC02: return (uint32_t)instructions;
+    case 0xB82: case 0xC82: return (uint32_t)(instructions >> 32);
+    default: return 0;
+    }
+}
+
+static void csr_write(int csr, uint32_t value)
+{
+    switch (csr)
+    {
+    case 0x300: mstatus = value; break;
+    case 0x304: mie = value; break;
+    case 0x305: mtvec = value; break;
+    case 0x340: mscratch = value; break;
+    case 0x341: mepc = value; break;
+    case 0x342: mcause = value; break;
+    case 0x343: mtval = value; break;
+    }
+}
+
+static Symbol *symbol_of(uint32_t address)
+{
+    if (address < textEnd && symbolAt[address >> 2] >= 0)
+    {
+        return &symbols[symbolAt[address >> 2]];
+    }
+    return &outside;
+}
+
+/**
+* @brief Executes one instruction
+*
+*
+* Step function that:
+* 1. Takes the timer interrupt if it is pending and enabled
+* 2. Fetches, decodes and executes the instruction at pc
+* 3. Charges its cycles to the clock and to its function
+* 4. Counts a call when a linking jump lands on a function entry
+*/
+static void step(void)
+{
+    uint32_t instruction, value;
+    int link = 0;
+
+    stalled = 0;
+    timer_update();
+    if ((mstatus & MSTATUS_MIE) && (mie >> TIMER_IRQ & 1) && (timerStatus & timerControl & 0x1))
+    {
+        trap(0x80000000u | TIMER_IRQ, 0);
+    }
+
+    uint32_t at = pc;
+    uint32_t next = at + 4;
+    Symbol *symbol = symbol_of(at);
+    if ((at & 3) || at >= RAM_BYTES)
+    {
+        trap(1, at);
+        goto charge;
+    }
+    memcpy(&instruction, ram + at, 4);
+
+    int rd = (instruction >> 7) & 31;
+    int funct3 = (instruction >> 12) & 7;
+    uint32_t a = regs[(instruction >> 15) & 31];
+    uint32_t b = regs[(instruction >> 20) & 31];
+    int32_t immI = (int32_t)instruction >> 20;
+    int32_t immS = ((int32_t)instruction >> 25 << 5) | ((instruction >> 7) & 31);
+    int32_t immB = ((int32_t)(instruction & 0x80000000) >> 19) | ((instruction & 0x80) << 4) |
+                   ((instruction >> 20) & 0x7E0) | ((instruction >> 7) & 0x1E);
+    int32_t immJ = ((int32_t)(instruction & 0x80000000) >> 11) | (instruction & 0xFF000) |
+                   ((instruction >> 9) & 0x800) | ((instruction >> 20) & 0x7FE);
+    uint32_t result = 0;
+    int writes = 1;
+
+    switch (instruction & 0x7F)
+    {
+    case 0x37: // lui
+        result = instruction & 0xFFFFF000;
+        break;
+    case 0x17: // auipc
+        result = at + (instruction & 0xFFFFF000);
+        break;
+    case 0x6F: // jal
+        if (immJ == 0 && rd == 0)
+        {
+            halted = 1; // Parked for good; the interrupt check above already ran
+            return;
+        }
+        result = next;
+        next = at + immJ;
+        link = rd != 0;
+        stalled += COST_JUMP;
+        break;
+    case 0x67: // jalr
+        result = next;
+        next = (a + immI) & ~1u;
+        link = rd != 0;
+        stalled += COST_JUMP;
+        break;
+    case 0x63: // Branches
+    {
+        int taken;
+        switch (funct3)
+        {
+        case 0: taken = a == b; break;
+        case 1: taken = a != b; break;
+        case 4: taken = (int32_t)a < (int32_t)b; break;
+        case 5: taken = (int32_t)a >= (int32_t)b; break;
+        case 6: taken = a < b; break;
+        case 7: taken = a >= b; break;
+        default: trap(2, instruction); goto charge;
+        }
+        if (taken)
+        {
+            next = at + immB;
+            stalled += COST_BRANCH;
+        }
+        writes = 0;
+        break;
+    }
+    case 0x03: // Loads
+    {
+        static const int SIZES[8] = {1, 2, 4, 0, 1, 2, 0, 0};
+        if (!SIZES[funct3])
+        {
+            trap(2, instruction);
+            goto charge;
+        }
+        if (load(a + immI, SIZES[funct3], &value) != 0)
+        {
+            goto charge;
+        }
+        result = funct3 == 0 ? (uint32_t)(int8_t)value : funct3 == 1 ? (uint32_t)(int16_t)value : value;
+        break;
+    }
+    case 0x23: // Stores
+        if (funct3 > 2)
+        {
+            trap(2, instruction);
+            goto charge;
+        }
+        if (store(a + immS, 1 << funct3, b) != 0)
+        {
+            goto charge;
+        }
+        writes = 0;
+        break;
+    case 0x13: // Register-immediate
+    case 0x33: // Register-register and M
+    {
+        int immediate = (instruction & 0x7F) == 0x13;
+        uint32_t operand = immediate ? (uint32_t)immI : b;
+        int funct7 = instruction >> 25;
+
+        if (!immediate && funct7 == 1)
+        {
+            int64_t sa = (int32_t)a, sb = (int32_t)b;
+            stalled += funct3 < 4 ? COST_MUL : COST_DIV;
+            switch (funct3)
+            {
+            case 0: result = a * b; break;
+            case 1: result = (uint32_t)((sa * sb) >> 32); break;
+            case 2: result = (uint32_t)((sa * (int64_t)(uint64_t)b) >> 32); break;
+            case 3: result = (uint32_t)(((uint64_t)a * b) >> 32); break;
+            case 4: result = b == 0 ? 0xFFFFFFFF : (a == 0x80000000 && b == 0xFFFFFFFF) ? a : (uint32_t)((int32_t)a / (int32_t)b); break;
+            case 5: result = b == 0 ? 0xFFFFFFFF : a / b; break;
+            case 6: result = b == 0 ? a : (a == 0x80000000 && b == 0xFFFFFFFF) ? 0 : (uint32_t)((int32_t)a % (int32_t)b); break;
+            case 7: result = b == 0 ? a : a % b; break;
+            }
+            break;
+        }
+        switch (funct3)
+        {
+        case 0: result = (!immediate && funct7 == 0x20) ? a - operand : a + operand; break;
+        case 1: result = a << (operand & 31); break;
+        case 2: result = (int32_t)a < (int32_t)operand; break;
+        case 3: result = a < operand; break;
+        case 4: result = a ^ operand; break;
+        case 5: result = (funct7 & 0x20) ? (uint32_t)((int32_t)a >> (operand & 31)) : a >> (operand & 31); break;
+        case 6: result = a | operand; break;
+        case 7: result = a & operand; break;
+        }
+        break;
+    }
+    case 0x0F: // fence: nothing to order on one hart without caches
+        writes = 0;
+        break;
+    case 0x73: // System
+    {
+        int csr = instruction >> 20;
+        uint32_t source = (funct3 & 4) ? (uint32_t)((instruction >> 15) & 31) : a;
+        int sourceZero = ((instruction >> 15) & 31) == 0;
+
+        if (funct3 == 0)
+        {
+            writes = 0;
+            if (instruction == 0x00000073) // ecall
+            {
+                trap(11, 0);
+                goto charge;
+            }
+            if (instruction == 0x00100073) // ebreak
+            {
+                halted = 1;
+                return;
+            }
+            if (instruction == 0x30200073) // mret
+            {
+                next = mepc;
+                mstatus = (mstatus & ~MSTATUS_MIE) | ((mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0) | MSTATUS_MPIE;
+                stalled += COST_TRAP;
+                break;
+            }
+            if (instruction == 0x10500073) // wfi: idle until the timer fires
+            {
+                if (timerRunning && timerDeadline > cycles)
+                {
+                    stalled += timerDeadline - cycles;
+                }
+                break;
+            }
+            trap(2, instruction);
+            goto charge;
+        }
+        if (funct3 == 4)
+        {
+            trap(2, instruction);
+            goto charge;
+        }
+        result = csr_read(csr);
+        switch (funct3 & 3)
+        {
+        case 1: csr_write(csr, source); break;
+        case 2: if (!sourceZero) csr_write(csr, result | source); break;
+        case 3: if (!sourceZero) csr_write(csr, result & ~source); break;
+        }
+        break;
+    }
+    default:
+        trap(2, instruction);
+        goto charge;
+    }
+
+    if (writes && rd != 0)
+    {
+        regs[rd] = result;
+    }
+    pc = next;
+    if (link && next < textEnd && symbolAt[next >> 2] >= 0 && symbols[symbolAt[next >> 2]].address == next)
+    {
+        symbols[symbolAt[next >> 2]].calls++;
+    }
+
+charge:
+    cycles += 1 + stalled;
+    instructions++;
+    symbol->cycles += 1 + stalled;
+    symbol->instructions++;
+}
+
+static int by_address(const void *x, const void *y)
+{
+    const Symbol *a = x, *b = y;
+    return a->address < b->address ? -1 : a->address > b->address;
+}
+
+static int by_cycles(const void *x, const void *y)
+{
+    const Symbol *a = *(Symbol *const *)x, *b = *(Symbol *const *)y;
+    return a->cycles < b->cycles ? 1 : a->cycles > b->cycles ? -1 : 0;
+}
+
+/**
+* @brief Loads the ELF into RAM and collects its function symbols
+*
+*
+* Load function that:
+* 1. Checks for a 32-bit little-endian RISC-V executable
+* 2. Copies every PT_LOAD segment to its address; the rest of
+*    RAM stays zero, which covers .bss
+* 3. Takes the function and label symbols of executable sections,
+*    sorts them by address and maps every instruction word below
+*    the end of the code to the symbol it belongs to
+*
+* @return 0, or -1 with a message
+*/
+static int load_elf(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    long size;
+    uint8_t *image;
+
+    if (!file || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < (long)sizeof(Elf32_Ehdr))
+    {
+        fprintf(stderr, "%s: cannot read\n", path);
+        if (file)
+        {
+            fclose(file);
+        }
+        return -1;
+    }
+    image = malloc(size);
+    rewind(file);
+    if (!image || fread(image, 1, size, file) != (size_t)size)
+    {
+        fprintf(stderr, "%s: cannot read\n", path);
+        fclose(file);
+        free(image);
+        return -1;
+    }
+    fclose(file);
+
+    const Elf32_Ehdr *header = (const Elf32_Ehdr *)image;
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS32 ||
+        header->e_ident[EI_DATA] != ELFDATA2LSB || header->e_machine != EM_RISCV ||
+        header->e_phoff + (uint64_t)header->e_phnum * sizeof(Elf32_Phdr) > (uint64_t)size ||
+        header->e_shoff + (uint64_t)header->e_shnum * sizeof(Elf32_Shdr) > (uint64_t)size)
+    {
+        fprintf(stderr, "%s: not an RV32 little-endian ELF\n", path);
+        free(image);
+        return -1;
+    }
+
+    const Elf32_Phdr *segments = (const Elf32_Phdr *)(image + header->e_phoff);
+    for (int i = 0; i < header->e_phnum; i++)
+    {
+        const Elf32_Phdr *segment = &segments[i];
+        if (segment->p_type != PT_LOAD || segment->p_filesz == 0)
+        {
+            continue;
+        }
+        if ((uint64_t)segment->p_paddr + segment->p_memsz > RAM_BYTES || segment->p_filesz > segment->p_memsz ||
+            (uint64_t)segment->p_offset + segment->p_filesz > (uint64_t)size)
+        {
+            fprintf(stderr, "%s: segment %d does not fit in RAM\n", path, i);
+            free(image);
+            return -1;
+        }
+        memcpy(ram + segment->p_paddr, image + segment->p_offset, segment->p_filesz);
+    }
+    pc = header->e_entry;
+
+    const Elf32_Shdr *sections = (const Elf32_Shdr *)(image + header->e_shoff);
+    for (int i = 0; i < header->e_shnum; i++)
+    {
+        if ((sections[i].sh_flags & SHF_EXECINSTR) && sections[i].sh_addr + sections[i].sh_size > textEnd)
+        {
+            textEnd = sections[i].sh_addr + sections[i].sh_size;
+        }
+    }
+    textEnd = (textEnd + 3) & ~3u;
+    for (int i = 0; i < header->e_shnum; i++)
+    {
+        const Elf32_Shdr *table = &sections[i];
+        if (table->sh_type != SHT_SYMTAB || table->sh_link >= header->e_shnum ||
+            table->sh_offset + (uint64_t)table->sh_size > (uint64_t)size)
+        {
+            continue;
+        }
+        const Elf32_Shdr *strings = &sections[table->sh_link];
+        const Elf32_Sym *entries = (const Elf32_Sym *)(image + table->sh_offset);
+        int count = table->sh_size / sizeof(Elf32_Sym);
+
+        symbols = realloc(symbols, (symbolCount + count) * sizeof(Symbol));
+        for (int j = 0; j < count; j++)
+        {
+            const Elf32_Sym *entry = &entries[j];
+            int type = ELF32_ST_TYPE(entry->st_info);
+            if ((type != STT_FUNC && type != STT_NOTYPE) || entry->st_shndx == SHN_UNDEF ||
+                entry->st_shndx >= header->e_shnum || !(sections[entry->st_shndx].sh_flags & SHF_EXECINSTR) ||
+                entry->st_name >= strings->sh_size)
+            {
+                continue;
+            }
+            const char *name = (const char *)image + strings->sh_offset + entry->st_name;
+            if (name[0] == '\0' || name[0] == '$' || strncmp(name, ".L", 2) == 0)
+            {
+                continue;
+            }
+            symbols[symbolCount++] = (Symbol){entry->st_value, strdup(name), 0, 0, 0};
+        }
+    }
+    free(image);
+
+    qsort(symbols, symbolCount, sizeof(Symbol), by_address);
+    symbolAt = malloc((textEnd / 4 + 1) * sizeof(int32_t));
+    int current = -1;
+    for (uint32_t word = 0, next = 0; word < textEnd / 4; word++)
+    {
+        while (next < (uint32_t)symbolCount && symbols[next].address <= word * 4)
+        {
+            current = next++; // Several names at one address: the last one sorted wins
+        }
+        symbolAt[word] = current;
+    }
+    return 0;
+}
+
+/* Writes the buffer the game last presented as a binary PPM (RGB332) */
+static void save_frame(const char *path)
+{
+    int width = videoMode ? 640 : 320;
+    int height = videoMode ? 480 : 240;
+    FILE *file = fopen(path, "wb");
+
+    if (!file)
+    {
+        perror(path);
+        return;
+    }
+    fprintf(file, "P6 %d %d 255\n", width, height);
+    for (int i = 0; i < width * height; i++)
+    {
+        uint32_t offset = vgaFront - PIXEL_BASE + i;
+        unsigned char c = offset < PIXEL_BYTES ? pixels[offset] : 0;
+        unsigned char rgb[3] = {(c >> 5) * 36, ((c >> 2) & 7) * 36, (c & 3) * 85};
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+}
+
+/**
+* @brief Prints totals and the functions by self cycles
+*
+* Report format, on stderr:
+*   cycles  share  instructions  CPI  calls  cycles/call  function
+*/
+static void report(int rows)
+{
+    Symbol **order = malloc((symbolCount + 1) * sizeof(Symbol *));
+    int count = 0;
+
+    for (int i = 0; i < symbolCount; i++)
+    {
+        if (symbols[i].instructions)
+        {
+            order[count++] = &symbols[i];
+        }
+    }
+    if (outside.instructions)
+    {
+        order[count++] = &outside;
+    }
+    qsort(order, count, sizeof(Symbol *), by_cycles);
+
+    fprintf(stderr, "\n%llu cycles (%.3f s at 30 MHz), %llu instructions, CPI %.2f",
+            (unsigned long long)cycles, (double)cycles / CLOCK_HZ, (unsigned long long)instructions,
+            instructions ? (double)cycles / instructions : 0.0);
+    if (frames)
+    {
+        fprintf(stderr, ", %llu frames, %llu cycles per frame", (unsigned long long)frames,
+                (unsigned long long)(cycles / frames));
+    }
+    fprintf(stderr, "\n\n%12s %6s %12s %5s %10s %10s  %s\n", "cycles", "share", "instructions", "CPI",
+            "calls", "per call", "function");
+    for (int i = 0; i < count && (rows == 0 || i < rows); i++)
+    {
+        const Symbol *symbol = order[i];
+        fprintf(stderr, "%12llu %5.1f%% %12llu %5.2f %10llu ", (unsigned long long)symbol->cycles,
+                100.0 * symbol->cycles / cycles, (unsigned long long)symbol->instructions,
+                (double)symbol->cycles / symbol->instructions, (unsigned long long)symbol->calls);
+        if (symbol->calls)
+        {
+            fprintf(stderr, "%10llu", (unsigned long long)(symbol->cycles / symbol->calls));
+        }
+        else
+        {
+            fprintf(stderr, "%10s", "-");
+        }
+        fprintf(stderr, "  %s\n", symbol->name);
+    }
+    free(order);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t cycleLimit = 60ull * CLOCK_HZ;
+    uint64_t frameLimit = 0;
+    const char *framePath = 0;
+    int rows = 30;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:f:b:m:o:n:")) != -1)
+    {
+        switch (option)
+        {
+        case 'c': cycleLimit = strtoull(optarg, 0, 0); break;
+        case 'f': frameLimit = strtoull(optarg, 0, 0); break;
+        case 'b': buttonPeriod = strtoull(optarg, 0, 0) * (CLOCK_HZ / 1000); break;
+        case 'm': videoMode = atoi(optarg) != 0; break;
+        case 'o': framePath = optarg; break;
+        case 'n': rows = atoi(optarg); break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-c cycles] [-f frames] [-b ms] [-m mode] [-o frame.ppm] [-n rows] main.elf\n", argv[0]);
+        return 2;
+    }
+
+    const char *text = getenv("TETRIS_SWITCHES");
+    if (text)
+    {
+        switches = strtoul(text, 0, 0) & 0x3FF;
+    }
+    text = getenv("TETRIS_SEED");
+    if (text)
+    {
+        timerSeed = (uint32_t)strtoul(text, 0, 0) << SEED_SHIFT;
+    }
+
+    ram = calloc(1, RAM_BYTES);
+    if (!ram || load_elf(argv[optind]) != 0)
+    {
+        return 1;
+    }
+    regs[2] = RAM_BYTES; // boot.S sets its own stack; this covers bare test programs
+
+    while (!halted && cycles < cycleLimit && (frameLimit == 0 || frames < frameLimit))
+    {
+        step();
+    }
+    fflush(stdout);
+    if (halted)
+    {
+        fprintf(stderr, "\nstopped at 0x%08x in %s\n", pc, symbol_of(pc)->name);
+    }
+
+    if (framePath)
+    {
+        save_frame(framePath);
+    }
+    report(rows);
+    return 0;
+}
@@ -0,0 +1,277 @@
+/**
+* @brief   Host implementation of the DTEK-V I/O used by tetris.c
+*
+*
+* See dtekv-host.h. The interval timer follows the board's
+* register layout closely enough for the game: TO (bit 0 of
+* status) is set whenever the simulated clock passes a full
+* period while control has START (bit 2) set, and stays set
+* until the game clears it.
+*
+* Status bits above RUN do not exist on the board and read as
+* zero there; the host fills them from TETRIS_SEED so that the
+* seed taken at game start can differ between instances.
+*
+* Environment:
+*   TETRIS_SWITCHES  initial switch bits (e.g. 0x100 for versus)
+*   TETRIS_SEED      timer status seed bits
+*   TETRIS_FAST      when set, delay() does not sleep
+*   TETRIS_INJECT    snapshot file loaded into the first game
+*
+* The 's' key writes a snapshot of the running game to
+* tetris-host.snap, which TETRIS_INJECT can load again later.
+*/
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "dtekv-host.h"
+
+#if defined(VIDEO_MODE) && VIDEO_MODE == 1
+#define HOST_WIDTH 640
+#define HOST_HEIGHT 480
+#else
+#define HOST_WIDTH 320
+#define HOST_HEIGHT 240
+#endif
+
+#define HOST_CLOCK_HZ 30000000
+#define BUTTON_HOLD_MS 100 // Long enough for the restart debounce
+#define SEED_SHIFT 4
+#define HOST_SNAPSHOT_BYTES 1024 // Above SNAPSHOT_MAX_BYTES for every board preset
+
+/* Game hooks from tetris.c */
+extern int snapshot_save(uint8_t *out);
+extern int snapshot_restore(const uint8_t *in, int length);
+
+volatile char hostPixels[HOST_PIXEL_BYTES];
+volatile uint32_t hostVgaCtrl[4];
+SESSION_LOCAL volatile int hostSwitches = 0;
+SESSION_LOCAL volatile int hostButton = 0;
+SESSION_LOCAL volatile int hostTimer[4];
+
+static int inputReady = 0;
+static int inputDetached = 0;
+static int sleepEnabled = 1;
+static int buttonMs = 0;
+static uint64_t timerCycles = 0;
+static struct termios savedTermios;
+static int termiosSaved = 0;
+
+static void restore_terminal(void)
+{
+    if (termiosSaved)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+    }
+}
+
+/* One-time setup: environment, raw non-blocking stdin */
+static void host_init(void)
+{
+    const char *value;
+
+    inputReady = 1;
+    if ((value = getenv("TETRIS_SWITCHES")))
+    {
+        hostSwitches = strtol(value, 0, 0);
+    }
+    if ((value = getenv("TETRIS_SEED")))
+    {
+        hostTimer[0] |= (int)(strtoul(value, 0, 0) << SEED_SHIFT);
+    }
+    sleepEnabled = getenv("TETRIS_FAST") == 0;
+
+    if (inputDetached)
+    {
+        return;
+    }
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &savedTermios) == 0)
+    {
+        struct termios raw = savedTermios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        termiosSaved = 1;
+        atexit(restore_terminal);
+    }
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+* @brief Stops this instance from reading the keyboard
+*
+* @param seed Timer status seed bits for this instance
+*
+* Used by the loopback link for the forked peer, which must not
+* compete with the player for stdin.
+*/
+void host_detach_input(unsigned int seed)
+{
+    inputDetached = 1;
+    if (!inputReady)
+    {
+        host_init();
+    }
+    hostTimer[0] = (int)(seed << SEED_SHIFT);
+}
+
+/* Writes the frame the game last presented as a binary PPM */
+static void save_frame(void)
+{
+    FILE *file = fopen("tetris-host.ppm", "wb");
+    if (!file)
+    {
+        return;
+    }
+    fprintf(file, "P6 %d %d 255\n", HOST_WIDTH, HOST_HEIGHT);
+    for (int i = 0; i < HOST_WIDTH * HOST_HEIGHT; i++)
+    {
+        unsigned char c = hostPixels[i];
+        unsigned char rgb[3] = {(c >> 5) * 36, ((c >> 2) & 7) * 36, (c & 3) * 85};
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+}
+
+/* Writes the running game to tetris-host.snap */
+static void save_snapshot(void)
+{
+    uint8_t blob[HOST_SNAPSHOT_BYTES];
+    int length = snapshot_save(blob);
+    FILE *file;
+
+    if (length > 0 && (file = fopen("tetris-host.snap", "wb")))
+    {
+        fwrite(blob, 1, length, file);
+        fclose(file);
+        fprintf(stderr, "snapshot: %d bytes\n", length);
+    }
+}
+
+/**
+* @brief Loads the TETRIS_INJECT snapshot into the running game
+*
+* Called by tetris.c once a game has been set up; only the
+* first call does anything, so restarts begin fresh.
+*/
+void host_inject_snapshot(void)
+{
+    static int injected = 0;
+    const char *path = getenv("TETRIS_INJECT");
+    uint8_t blob[HOST_SNAPSHOT_BYTES];
+    FILE *file;
+
+    if (injected || !path || !(file = fopen(path, "rb")))
+    {
+        return;
+    }
+    injected = 1;
+
+    int length = fread(blob, 1, sizeof(blob), file);
+    fclose(file);
+    if (!snapshot_restore(blob, length))
+    {
+        fprintf(stderr, "snapshot: %s does not match this build\n", path);
+    }
+}
+
+/* Applies every key waiting on stdin */
+static void poll_keys(void)
+{
+    char key;
+
+    while (!inputDetached && read(STDIN_FILENO, &key, 1) == 1)
+    {
+        if (key >= '1' && key <= '9')
+        {
+            hostSwitches ^= 1 << (key - '1');
+        }
+        else if (key == '0')
+        {
+            hostSwitches ^= 1 << 9;
+        }
+        else if (key == ' ')
+        {
+            hostButton = 1;
+            buttonMs = BUTTON_HOLD_MS;
+        }
+        else if (key == 'p')
+        {
+            save_frame();
+        }
+        else if (key == 's')
+        {
+            save_snapshot();
+        }
+        else if (key == 'q')
+        {
+            exit(0);
+        }
+    }
+}
+
+/**
+* @brief Advances simulated time by ms milliseconds
+*
+* Runs the interval timer for the elapsed cycles, releases the
+* button once its hold time is over and handles pending keys.
+*/
+void delay(int ms)
+{
+    if (!inputReady)
+    {
+        host_init();
+    }
+
+    if (hostTimer[1] & 0x4)
+    {
+        uint64_t period = (((uint32_t)hostTimer[3] & 0xFFFF) << 16 | ((uint32_t)hostTimer[2] & 0xFFFF)) + 1;
+        timerCycles += (uint64_t)ms * (HOST_CLOCK_HZ / 1000);
+        if (timerCycles >= period)
+        {
+            timerCycles %= period;
+            hostTimer[0] |= 0x1;
+        }
+    }
+
+    if (buttonMs > 0 && (buttonMs -= ms) <= 0)
+    {
+        hostButton = 0;
+    }
+
+    poll_keys();
+
+    if (sleepEnabled && ms > 0)
+    {
+        usleep(ms * 1000);
+    }
+}
+
+/**
+* @brief Wall-clock time in 30 MHz cycles, standing in for mcycle
+*/
+uint32_t host_cycles(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * HOST_CLOCK_HZ + (uint64_t)now.tv_nsec * 3 / 100);
+}
+
+void print(const char *s)
+{
+    fputs(s, stdout);
+    fflush(stdout);
+}
+
+void print_dec(unsigned int x)
+{
+    printf("%u", x);
+    fflush(stdout);
+}
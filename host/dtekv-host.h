@@ -0,0 +1,60 @@
+/**
+* @brief   Host stand-in for the DTEK-V memory-mapped I/O
+*
+*
+* Compiling tetris.c with -DHOST_BUILD replaces the hardware
+* register addresses with the plain variables below, so the game
+* runs unmodified as a desktop process. dtekv-host.c implements
+* the variables together with print(), print_dec() and delay():
+*
+* - delay() advances a simulated 30 MHz clock that drives the
+*   interval timer, then sleeps for the same wall-clock time
+* - keys read during delay() flip switches 1-10 ('1'..'9', '0')
+*   and press the button (space); 'p' saves the frame to
+*   tetris-host.ppm, 's' the game state to tetris-host.snap
+*   and 'q' quits
+*
+* Build (from the repository root):
+*   cc -O2 -DHOST_BUILD -o tetris-host tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/dtekv-host.c host/link-pipe.c
+*/
+
+#ifndef DTEKV_HOST_H
+#define DTEKV_HOST_H
+
+#include <stdint.h>
+
+#define HOST_PIXEL_BYTES (640 * 480)
+
+/* The session server (-DSERVER_BUILD, host/session-server.c) steps
+   many games on a pool of threads. Each thread keeps its own copy
+   of the game state and of the input and timer registers; the
+   server never draws, so the framebuffer stays shared. The same
+   goes for -DRENDER_THREAD (host/render-thread.c), where the
+   render thread keeps the copy it draws from and the framebuffer
+   is written by one thread at a time. */
+#if defined(SERVER_BUILD) || defined(RENDER_THREAD)
+#define SESSION_LOCAL _Thread_local
+#else
+#define SESSION_LOCAL
+#endif
+
+extern volatile char hostPixels[HOST_PIXEL_BYTES];
+extern volatile uint32_t hostVgaCtrl[4];
+extern SESSION_LOCAL volatile int hostSwitches;
+extern SESSION_LOCAL volatile int hostButton;
+extern SESSION_LOCAL volatile int hostTimer[4]; // status, control, periodl, periodh
+
+#define VGA_PIXELS (hostPixels)
+#define VGA_CTRL (hostVgaCtrl)
+#define SWITCH_ADDRESS (&hostSwitches)
+#define BUTTON_ADDRESS (&hostButton)
+#define TIMER_STATUS (&hostTimer[0])
+#define TIMER_CONTROL (&hostTimer[1])
+#define TIMER_PERIODL (&hostTimer[2])
+#define TIMER_PERIODH (&hostTimer[3])
+
+void host_detach_input(unsigned int seed);
+void host_inject_snapshot(void);
+uint32_t host_cycles(void);
+
+#endif
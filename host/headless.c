@@ -0,0 +1,129 @@
+/**
+* @brief   Headless game driver for the host tools
+*
+*
+* See headless.h. A tick presents one packed input (session.h)
+* on the switch and button registers, raises the timer flag so
+* exactly one timer period elapses, and runs one frame. The
+* inputs and timer are thread-local like the game state they
+* feed; nothing draws, so the framebuffer stand-in is shared
+* and never written.
+*/
+
+#include "headless.h"
+#include "session.h"
+
+/* Game hooks from tetris.c */
+extern void init_preview_tiles(void);
+extern void init_shape_tables(void);
+extern void init_timer(void);
+extern void init_particles(void);
+extern void start_game(unsigned int seed, int switches);
+extern void run_frame(void);
+extern int take_telemetry(int *pieces, int *lines);
+
+volatile char hostPixels[HOST_PIXEL_BYTES];
+volatile uint32_t hostVgaCtrl[4];
+SESSION_LOCAL volatile int hostSwitches;
+SESSION_LOCAL volatile int hostButton;
+SESSION_LOCAL volatile int hostTimer[4];
+
+/* The game's console and clock; nothing to show, nothing to wait for */
+void print(const char *s)
+{
+}
+
+void print_dec(unsigned int x)
+{
+}
+
+void delay(int ms)
+{
+}
+
+uint32_t host_cycles(void)
+{
+    return 0;
+}
+
+/**
+* @brief Builds the shared lookup tables, once before any game
+*/
+void headless_init(void)
+{
+    init_preview_tiles();
+    init_shape_tables();
+}
+
+/**
+* @brief Starts a fresh game on this thread
+*
+* @param switches Start switches, already limited to
+*                 SESSION_START_SWITCHES
+* @param counts Reset for the new game
+*/
+void headless_start(uint32_t seed, int switches, HeadlessCounts *counts)
+{
+    int pieces, lines;
+
+    hostTimer[0] = 0;
+    init_timer();
+    start_game(seed, switches);
+    take_telemetry(&pieces, &lines); // Counts are per game from here on
+    counts->pieces = 0;
+    counts->lines = 0;
+    counts->endCause = -1;
+}
+
+/**
+* @brief Continues a saved game on this thread
+*
+* A snapshot leaves out the input edge state, so it is passed
+* alongside. Particles are cosmetic and start over.
+*
+* @param state snapshot_save() blob
+* @param lastButton Button level before the next tick
+* @param lastSwitches Switch state before the next tick
+* @return 1, or 0 if the snapshot does not fit this build
+*/
+int headless_resume(const uint8_t *state, int length, int lastButton, int lastSwitches)
+{
+    if (!snapshot_load(state, length))
+    {
+        return 0;
+    }
+    init_particles();
+    lastButtonState = lastButton;
+    lastSwitchState = lastSwitches;
+    return 1;
+}
+
+/**
+* @brief Runs one tick of this thread's game
+*
+* Only the play switches come from input; the others keep
+* their start value, so no mode or quick-save switch ever
+* changes mid-game.
+*
+* @param input Play switches plus SESSION_TICK_BUTTON
+* @param startSwitches Switches the game was started with
+* @param counts Receives the pieces, lines and end of the tick
+*/
+void headless_tick(int input, int startSwitches, HeadlessCounts *counts)
+{
+    int pieces, lines;
+
+    hostSwitches = (input & SESSION_PLAY_SWITCHES) | (startSwitches & ~SESSION_PLAY_SWITCHES);
+    hostButton = (input & SESSION_TICK_BUTTON) ? 1 : 0;
+    hostTimer[0] |= 1;
+
+    run_frame();
+
+    int cause = take_telemetry(&pieces, &lines);
+    counts->pieces += pieces;
+    counts->lines += lines;
+    if (cause >= 0)
+    {
+        counts->endCause = cause;
+    }
+}
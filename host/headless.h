@@ -0,0 +1,42 @@
+/**
+* @brief   Headless game driver for the host tools
+*
+*
+* Plays games without a screen or a clock, one tick per call,
+* on the calling thread's copy of the game state. Shared by the
+* session server and the replay tools, so a replay re-simulates
+* exactly what the server played. Build with -DHOST_BUILD
+* -DSERVER_BUILD; headless.c also provides the register
+* stand-ins, print() and delay().
+*/
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdint.h>
+#include "dtekv-host.h"
+
+/* Game hooks from tetris.c */
+extern int snapshot_save(uint8_t *out);
+extern int snapshot_load(const uint8_t *in, int length);
+extern SESSION_LOCAL int gameOver;
+extern SESSION_LOCAL int roundWon;
+extern SESSION_LOCAL int score;
+extern SESSION_LOCAL int gameMode;
+extern SESSION_LOCAL int lastButtonState;
+extern SESSION_LOCAL int lastSwitchState;
+
+/* Per-game counts gathered by headless_tick() */
+typedef struct
+{
+    uint32_t pieces;  // Pieces locked
+    uint32_t lines;   // Rows plus columns cleared
+    int endCause;     // END_* of tetris.c, -1 while running
+} HeadlessCounts;
+
+void headless_init(void);
+void headless_start(uint32_t seed, int switches, HeadlessCounts *counts);
+int headless_resume(const uint8_t *state, int length, int lastButton, int lastSwitches);
+void headless_tick(int input, int startSwitches, HeadlessCounts *counts);
+
+#endif
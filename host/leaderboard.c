@@ -0,0 +1,348 @@
+/**
+* @brief   Memory-mapped leaderboard and session store
+*
+*
+* See leaderboard.h for the file layout. Writers in any number
+* of threads or processes append with leaderboard_append(); the
+* file lock is held only while leaderboard_open() creates or
+* checks the header, never on the append or query paths.
+*
+* A writer that dies between claiming and completing a record
+* leaves that record unpublished, and publication stops there
+* until the file is recreated. Records past it are still
+* written, but no snapshot includes them.
+*
+* Building with -DLEADERBOARD_TOOL adds a query program:
+*   cc -O2 -DLEADERBOARD_TOOL -o tetris-scores host/leaderboard.c
+*   tetris-scores [file] [mode|-] [seed|-] [count]
+*/
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "leaderboard.h"
+
+/* Maps the header and capacity records of an open file */
+static int map_file(Leaderboard *lb, int fd, uint32_t capacity)
+{
+    size_t bytes = LEADERBOARD_HEADER_BYTES + (size_t)capacity * sizeof(LeaderboardRecord);
+    void *base = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        return -1;
+    }
+    lb->header = base;
+    lb->records = (LeaderboardRecord *)((uint8_t *)base + LEADERBOARD_HEADER_BYTES);
+    lb->mappedBytes = bytes;
+    return 0;
+}
+
+/**
+* @brief Maps a leaderboard file, creating it when it is empty
+*
+*
+* Open function that:
+* 1. Takes the file lock, so only one process sets up a new file
+* 2. New file: sizes it for capacity records and writes the
+*    header, the magic last
+* 3. Existing file: checks magic, version and record size and
+*    keeps the capacity it was created with
+*
+* @param capacity Records a new file has room for; 0 opens an
+*                 existing file only
+* @return 0, or -1 if the file cannot be opened or is not a
+*         leaderboard of this version
+*/
+int leaderboard_open(Leaderboard *lb, const char *path, uint32_t capacity)
+{
+    struct stat info;
+    int fd = open(path, O_RDWR | O_CLOEXEC | (capacity > 0 ? O_CREAT : 0), 0644);
+    int result = -1;
+
+    lb->header = 0;
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (info.st_size == 0 && capacity > 0)
+    {
+        if (ftruncate(fd, LEADERBOARD_HEADER_BYTES + (off_t)(capacity * sizeof(LeaderboardRecord))) == 0 &&
+            map_file(lb, fd, capacity) == 0)
+        {
+            lb->header->version = LEADERBOARD_VERSION;
+            lb->header->recordSize = sizeof(LeaderboardRecord);
+            lb->header->capacity = capacity;
+            lb->header->magic = LEADERBOARD_MAGIC;
+            result = 0;
+        }
+    }
+    else if (info.st_size >= LEADERBOARD_HEADER_BYTES)
+    {
+        LeaderboardHeader header;
+
+        if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+            header.magic == LEADERBOARD_MAGIC &&
+            header.version == LEADERBOARD_VERSION &&
+            header.recordSize == sizeof(LeaderboardRecord) &&
+            info.st_size >= LEADERBOARD_HEADER_BYTES + (off_t)(header.capacity * sizeof(LeaderboardRecord)))
+        {
+            result = map_file(lb, fd, header.capacity);
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd); // The mapping stays valid
+    if (result != 0)
+    {
+        lb->header = 0;
+    }
+    return result;
+}
+
+void leaderboard_close(Leaderboard *lb)
+{
+    if (lb->header)
+    {
+        munmap(lb->header, lb->mappedBytes);
+        lb->header = 0;
+    }
+}
+
+/* Moves published over every record completed right after it */
+static void publish(LeaderboardHeader *header, LeaderboardRecord *records)
+{
+    uint32_t next = atomic_load(&header->published);
+
+    while (next < header->capacity && atomic_load(&records[next].sequence) == next + 1)
+    {
+        // On failure next is reloaded and the check repeats from there
+        if (atomic_compare_exchange_weak(&header->published, &next, next + 1))
+        {
+            next++;
+        }
+    }
+}
+
+/**
+* @brief Appends one record without locking
+*
+*
+* Append function that:
+* 1. Claims the next index by compare-and-swap on reserved,
+*    failing once the file is full
+* 2. Copies the record in and links it at the head of its seed
+*    bucket; readers skip it there until it is published
+* 3. Completes it by storing its sequence number (index + 1)
+* 4. Advances published over every completed record, including
+*    those of writers that finished out of order. Sequentially
+*    consistent atomics ensure that of two writers completing
+*    neighbouring records, at least one sees both.
+*
+* @param record Contents; sequence and nextSameBucket are ignored
+* @return Index of the record, or -1 if the file is full
+*/
+int leaderboard_append(Leaderboard *lb, const LeaderboardRecord *record)
+{
+    LeaderboardHeader *header = lb->header;
+    uint32_t index = atomic_load(&header->reserved);
+
+    do
+    {
+        if (index >= header->capacity)
+        {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&header->reserved, &index, index + 1));
+
+    LeaderboardRecord *slot = &lb->records[index];
+    slot->endTime = record->endTime;
+    slot->seed = record->seed;
+    slot->switches = record->switches;
+    slot->mode = record->mode;
+    slot->endCause = record->endCause;
+    slot->score = record->score;
+    slot->ticks = record->ticks;
+    slot->pieces = record->pieces;
+    slot->lines = record->lines;
+    slot->inputHash = record->inputHash;
+    slot->stateHash = record->stateHash;
+
+    _Atomic uint32_t *head = &header->seedHeads[record->seed % LEADERBOARD_SEED_BUCKETS];
+    uint32_t older = atomic_load(head);
+    do
+    {
+        atomic_store(&slot->nextSameBucket, older);
+    } while (!atomic_compare_exchange_weak(head, &older, index + 1));
+
+    atomic_store(&slot->sequence, index + 1);
+
+    publish(header, lb->records);
+    return index;
+}
+
+/**
+* @brief Number of records in a consistent read snapshot
+*
+* Records [0, count) are complete and never change again, so
+* lb->records can be read in place up to count.
+*/
+uint32_t leaderboard_snapshot(const Leaderboard *lb)
+{
+    return atomic_load(&lb->header->published);
+}
+
+/* Whether a ranks above b: higher score, then the older record */
+static int ranks_above(const LeaderboardRecord *a, const LeaderboardRecord *b)
+{
+    return a->score > b->score || (a->score == b->score && a < b);
+}
+
+/* Inserts record into out[0..*count), kept best first */
+static void keep_best(const LeaderboardRecord **out, int *count, int n, const LeaderboardRecord *record)
+{
+    int i = *count;
+
+    if (i == n)
+    {
+        if (!ranks_above(record, out[n - 1]))
+        {
+            return;
+        }
+        i--;
+    }
+    else
+    {
+        (*count)++;
+    }
+    while (i > 0 && ranks_above(record, out[i - 1]))
+    {
+        out[i] = out[i - 1];
+        i--;
+    }
+    out[i] = record;
+}
+
+/**
+* @brief Best scores of a snapshot, optionally for one mode and seed
+*
+*
+* Query function that:
+* 1. Takes a snapshot (leaderboard_snapshot)
+* 2. With a seed, follows that seed's bucket chain and skips
+*    records of other seeds or past the snapshot; otherwise
+*    scans the snapshot
+* 3. Keeps the n best matching records, older first on ties
+*
+* @param mode MODE_* to match, or LEADERBOARD_ANY
+* @param seed Seed to match, or LEADERBOARD_ANY
+* @param out Receives pointers into the mapping, best first
+* @return Number of records written to out (at most n)
+*/
+int leaderboard_top(const Leaderboard *lb, int mode, int64_t seed, const LeaderboardRecord **out, int n)
+{
+    uint32_t count = leaderboard_snapshot(lb);
+    int found = 0;
+
+    if (n <= 0)
+    {
+        return 0;
+    }
+
+    if (seed != LEADERBOARD_ANY)
+    {
+        uint32_t link = atomic_load(&lb->header->seedHeads[(uint32_t)seed % LEADERBOARD_SEED_BUCKETS]);
+
+        while (link != 0)
+        {
+            uint32_t index = link - 1;
+            const LeaderboardRecord *record = &lb->records[index];
+            link = atomic_load(&record->nextSameBucket);
+            if (index < count && record->seed == (uint32_t)seed &&
+                (mode == LEADERBOARD_ANY || record->mode == mode))
+            {
+                keep_best(out, &found, n, record);
+            }
+        }
+        return found;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const LeaderboardRecord *record = &lb->records[i];
+        if (mode == LEADERBOARD_ANY || record->mode == mode)
+        {
+            keep_best(out, &found, n, record);
+        }
+    }
+    return found;
+}
+
+/**
+* @brief FNV-1a over length bytes, continuing from hash
+*
+* Start with LEADERBOARD_HASH_INIT.
+*/
+uint32_t leaderboard_hash(uint32_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+#ifdef LEADERBOARD_TOOL
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TOOL_MAX_COUNT 1000
+
+static const char *const END_NAMES[] = {"topout", "garbage", "no pieces", "won"};
+
+int main(int argc, char **argv)
+{
+    static const LeaderboardRecord *best[TOOL_MAX_COUNT];
+    const char *path = argc > 1 ? argv[1] : "tetris-leaderboard.bin";
+    int mode = (argc > 2 && strcmp(argv[2], "-") != 0) ? atoi(argv[2]) : LEADERBOARD_ANY;
+    int64_t seed = (argc > 3 && strcmp(argv[3], "-") != 0) ? (int64_t)strtoul(argv[3], 0, 0) : LEADERBOARD_ANY;
+    int count = argc > 4 ? atoi(argv[4]) : 10;
+    Leaderboard lb;
+
+    if (leaderboard_open(&lb, path, 0) != 0)
+    {
+        fprintf(stderr, "%s: not a leaderboard file\n", path);
+        return 1;
+    }
+    count = count < 1 ? 1 : count > TOOL_MAX_COUNT ? TOOL_MAX_COUNT : count;
+
+    int found = leaderboard_top(&lb, mode, seed, best, count);
+    printf("%u games, %u slots\n", leaderboard_snapshot(&lb), lb.header->capacity);
+    for (int i = 0; i < found; i++)
+    {
+        const LeaderboardRecord *r = best[i];
+        char when[32];
+        time_t endTime = r->endTime;
+
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&endTime));
+        printf("%3d. %7d  mode %u  seed 0x%08x  switches 0x%03x  %6u ticks  %5u pieces  %4u lines  %-9s  %s  inputs %08x  state %08x\n",
+               i + 1, r->score, r->mode, r->seed, r->switches, r->ticks, r->pieces, r->lines,
+               r->endCause < 4 ? END_NAMES[r->endCause] : "?", when, r->inputHash, r->stateHash);
+    }
+    leaderboard_close(&lb);
+    return 0;
+}
+#endif
@@ -0,0 +1,82 @@
+/**
+* @brief   Memory-mapped leaderboard and session store
+*
+*
+* One fixed-size record per finished game, appended to a file
+* that every process maps with MAP_SHARED:
+*
+*   header (LEADERBOARD_HEADER_BYTES) | record 0 | record 1 | ...
+*
+* Appending never takes a lock: a writer claims an index with a
+* compare-and-swap on header.reserved, fills the record, then
+* marks it complete by storing its sequence number. Completed
+* records are published in index order through
+* header.published, so a reader that loads published once sees
+* a fixed prefix of whole records that never change again.
+*
+* Queries read the records in place and hand out pointers into
+* the mapping; nothing is copied or parsed.
+*
+* See leaderboard.c.
+*/
+
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LEADERBOARD_MAGIC 0x3142544C // "LTB1"
+#define LEADERBOARD_VERSION 1
+#define LEADERBOARD_HEADER_BYTES 4096
+#define LEADERBOARD_SEED_BUCKETS 512
+#define LEADERBOARD_ANY -1 // Wildcard mode or seed for leaderboard_top()
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t capacity;                  // Records the file has room for
+    _Atomic uint32_t reserved;          // Records claimed by writers
+    _Atomic uint32_t published;         // Records [0, published) are complete
+    uint32_t unused;
+    _Atomic uint32_t seedHeads[LEADERBOARD_SEED_BUCKETS]; // Newest record + 1 per seed bucket
+} LeaderboardHeader;
+
+/* One finished game: score, replay metadata and session stats */
+typedef struct
+{
+    _Atomic uint32_t sequence;          // Index + 1 once the record is complete
+    _Atomic uint32_t nextSameBucket;    // Older record + 1 in this seed bucket, 0 at the end
+    int64_t endTime;                    // Unix time the game ended
+    uint32_t seed;
+    uint16_t switches;                  // Switches the game was started with
+    uint8_t mode;                       // MODE_* of tetris.c
+    uint8_t endCause;                   // END_* of tetris.c
+    int32_t score;
+    uint32_t ticks;                     // Frames played
+    uint32_t pieces;                    // Pieces locked
+    uint32_t lines;                     // Rows plus columns cleared
+    uint32_t inputHash;                 // FNV-1a over the packed tick inputs (replay.h)
+    uint32_t stateHash;                 // FNV-1a over the final snapshot
+} LeaderboardRecord;
+
+typedef struct
+{
+    LeaderboardHeader *header;
+    LeaderboardRecord *records;
+    size_t mappedBytes;
+} Leaderboard;
+
+int leaderboard_open(Leaderboard *lb, const char *path, uint32_t capacity);
+void leaderboard_close(Leaderboard *lb);
+int leaderboard_append(Leaderboard *lb, const LeaderboardRecord *record);
+uint32_t leaderboard_snapshot(const Leaderboard *lb);
+int leaderboard_top(const Leaderboard *lb, int mode, int64_t seed, const LeaderboardRecord **out, int n);
+uint32_t leaderboard_hash(uint32_t hash, const void *data, size_t length);
+
+#define LEADERBOARD_HASH_INIT 2166136261u
+
+#endif
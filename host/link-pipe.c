@@ -0,0 +1,107 @@
+/**
+* @brief   Host transport for the versus link
+*
+*
+* Provides link_default_transport() for HOST_BUILD, carrying the
+* link bytes over a non-blocking socket instead of the JTAG UART:
+*
+* - TETRIS_LINK_FD=n uses an already connected socket (for
+*   example one end of a socketpair set up by a launcher, or a
+*   socat bridge to another machine)
+* - TETRIS_VERSUS_LOOPBACK=1 forks a second instance of the game
+*   connected through a socketpair. The peer plays with a
+*   different seed and no input, which is enough to exercise
+*   garbage exchange and top-out handling on one machine.
+*
+* Without either variable there is no peer and the link stays
+* silent. A closed connection reads as "no data"; the forked
+* peer exits once its parent is gone.
+*/
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../link.h"
+#include "dtekv-host.h"
+
+static int linkFd = -1;
+static int isLoopbackPeer = 0;
+
+static int pipe_send(const uint8_t *data, int len)
+{
+    ssize_t sent = write(linkFd, data, len);
+    return sent > 0 ? (int)sent : 0;
+}
+
+static int pipe_recv(uint8_t *data, int max)
+{
+    ssize_t received = read(linkFd, data, max);
+    if (received == 0 && isLoopbackPeer)
+    {
+        exit(0);
+    }
+    return received > 0 ? (int)received : 0;
+}
+
+static int silent_send(const uint8_t *data, int len)
+{
+    return len;
+}
+
+static int silent_recv(uint8_t *data, int max)
+{
+    return 0;
+}
+
+static const LinkTransport pipeTransport = {pipe_send, pipe_recv};
+static const LinkTransport silentTransport = {silent_send, silent_recv};
+
+const LinkTransport *link_default_transport(void)
+{
+    const char *value;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((value = getenv("TETRIS_LINK_FD")))
+    {
+        linkFd = atoi(value);
+    }
+    else if (getenv("TETRIS_VERSUS_LOOPBACK"))
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            return &silentTransport;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            close(fds[0]);
+            close(fds[1]);
+            return &silentTransport;
+        }
+        if (pid == 0)
+        {
+            close(fds[0]);
+            linkFd = fds[1];
+            isLoopbackPeer = 1;
+            host_detach_input((unsigned int)getpid());
+        }
+        else
+        {
+            close(fds[1]);
+            linkFd = fds[0];
+        }
+    }
+    else
+    {
+        return &silentTransport;
+    }
+
+    fcntl(linkFd, F_SETFL, fcntl(linkFd, F_GETFL) | O_NONBLOCK);
+    return &pipeTransport;
+}
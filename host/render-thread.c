@@ -0,0 +1,212 @@
+/**
+* @brief   Render thread for the host build
+*
+*
+* See render-thread.h. The triple buffer has three snapshot
+* slots: the simulation thread fills its back slot and swaps it
+* into the middle, the render thread swaps the middle out for
+* its front slot whenever the middle is marked fresh. Both swaps
+* are one atomic exchange of a slot number plus the fresh bit,
+* so neither side ever holds a lock or waits for the other.
+*
+* Pausing is the only blocking step, once per game: the
+* simulation thread waits until the render thread has finished
+* its frame, so the game over screen is never drawn by both.
+*/
+
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "dtekv-host.h"
+#include "render-thread.h"
+
+#define RENDER_STATE_BYTES 1024 // Above SNAPSHOT_MAX_BYTES for every board preset
+#define SLOT_FRESH 4            // Middle slot holds a snapshot not yet rendered
+#define RENDER_IDLE_US 1000     // Wait between polls when no snapshot is fresh
+
+/* Game hooks from tetris.c */
+extern int snapshot_save(uint8_t *out);
+extern void render_frame(const uint8_t *in, int length, int full);
+
+typedef struct
+{
+    int length;
+    uint8_t state[RENDER_STATE_BYTES];
+} RenderSlot;
+
+static RenderSlot slots[3];
+static atomic_int middleSlot = 1;   // Slot number, plus SLOT_FRESH
+static int backSlot = 0;            // Simulation thread only
+static int frontSlot = 2;           // Render thread only
+
+static pthread_t renderThread;
+static int renderStarted = 0;
+static pthread_mutex_t pauseLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pauseChanged = PTHREAD_COND_INITIALIZER;
+static atomic_int pauseRequested = 1;
+static int renderIdle = 0;          // Parked, under pauseLock
+static atomic_int screenOwned = 0;  // Render thread draws the frames
+
+/* Rates, over the time the render thread was running */
+static uint64_t simulatedFrames = 0;
+static atomic_ullong renderedFrames = 0;
+static double activeSeconds = 0;
+static struct timespec resumedAt;
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+* @brief Hands this frame's game to the render thread
+*
+* Called by run_frame() on the simulation thread.
+*
+* @return 1, or 0 if the game has no snapshot (versus, hyper)
+*         and the caller must draw the frame itself
+*/
+int render_publish(void)
+{
+    RenderSlot *slot = &slots[backSlot];
+
+    if (atomic_load_explicit(&pauseRequested, memory_order_relaxed))
+    {
+        return 0;
+    }
+    slot->length = snapshot_save(slot->state);
+    if (slot->length == 0)
+    {
+        atomic_store(&screenOwned, 0);
+        return 0;
+    }
+    backSlot = atomic_exchange_explicit(&middleSlot, backSlot | SLOT_FRESH, memory_order_acq_rel) & ~SLOT_FRESH;
+    atomic_store(&screenOwned, 1);
+    simulatedFrames++;
+    return 1;
+}
+
+/**
+* @brief Whether a redraw on this thread would race the render thread
+*/
+int render_owns_screen(void)
+{
+    return atomic_load(&screenOwned) && !(renderStarted && pthread_equal(pthread_self(), renderThread));
+}
+
+/**
+* @brief Render thread: composes the newest snapshot, forever
+*
+*
+* Loop that:
+* 1. Parks while paused and asks for a full redraw after
+* 2. Swaps the fresh middle slot for its front slot, or sleeps
+*    briefly when the simulation has not published since
+* 3. Renders the front slot with render_frame()
+*/
+static void *render_main(void *unused)
+{
+    int full = 1;
+
+    (void)unused;
+    while (1)
+    {
+        if (atomic_load(&pauseRequested))
+        {
+            pthread_mutex_lock(&pauseLock);
+            renderIdle = 1;
+            pthread_cond_broadcast(&pauseChanged);
+            while (atomic_load(&pauseRequested))
+            {
+                pthread_cond_wait(&pauseChanged, &pauseLock);
+            }
+            renderIdle = 0;
+            pthread_mutex_unlock(&pauseLock);
+            full = 1;
+        }
+
+        if (!(atomic_load_explicit(&middleSlot, memory_order_relaxed) & SLOT_FRESH))
+        {
+            usleep(RENDER_IDLE_US);
+            continue;
+        }
+        frontSlot = atomic_exchange_explicit(&middleSlot, frontSlot, memory_order_acq_rel) & ~SLOT_FRESH;
+        render_frame(slots[frontSlot].state, slots[frontSlot].length, full);
+        full = 0;
+        atomic_fetch_add_explicit(&renderedFrames, 1, memory_order_relaxed);
+    }
+    return 0;
+}
+
+/* Prints both rates; frames the render thread never took were overtaken by newer ones */
+static void print_rates(void)
+{
+    double seconds = activeSeconds + (atomic_load(&pauseRequested) ? 0 : seconds_since(&resumedAt));
+    unsigned long long rendered = atomic_load(&renderedFrames);
+
+    if (seconds <= 0)
+    {
+        return;
+    }
+    fprintf(stderr, "render thread: %llu frames simulated (%.1f/s), %llu rendered (%.1f/s), %llu skipped\n",
+            (unsigned long long)simulatedFrames, simulatedFrames / seconds, rendered, rendered / seconds,
+            simulatedFrames > rendered ? (unsigned long long)simulatedFrames - rendered : 0);
+}
+
+/**
+* @brief Lets the render thread draw from the next published frame
+*
+* Starts the thread on first use. Called by main() once a game
+* is set up and drawn.
+*/
+void render_resume(void)
+{
+    if (!renderStarted)
+    {
+        if (pthread_create(&renderThread, 0, render_main, 0) != 0)
+        {
+            perror("render thread");
+            return; // render_publish() keeps declining; frames draw inline
+        }
+        renderStarted = 1;
+        atexit(print_rates);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &resumedAt);
+    pthread_mutex_lock(&pauseLock);
+    atomic_store(&pauseRequested, 0);
+    pthread_cond_broadcast(&pauseChanged);
+    pthread_mutex_unlock(&pauseLock);
+}
+
+/**
+* @brief Stops the render thread after its current frame
+*
+* Returns once it is parked, with the screen back on this
+* thread and any unrendered snapshot dropped, so the next game
+* does not start with a frame of this one.
+*/
+void render_pause(void)
+{
+    if (!renderStarted || atomic_load(&pauseRequested))
+    {
+        return;
+    }
+    pthread_mutex_lock(&pauseLock);
+    atomic_store(&pauseRequested, 1);
+    while (!renderIdle)
+    {
+        pthread_cond_wait(&pauseChanged, &pauseLock);
+    }
+    pthread_mutex_unlock(&pauseLock);
+
+    atomic_fetch_and(&middleSlot, ~SLOT_FRESH);
+    atomic_store(&screenOwned, 0);
+    activeSeconds += seconds_since(&resumedAt);
+}
@@ -0,0 +1,37 @@
+/**
+* @brief   Render thread for the host build
+*
+*
+* Building tetris-host with -DRENDER_THREAD and
+* host/render-thread.c splits the game over two threads: main()
+* simulates on the main thread, and every frame run_frame()
+* publishes a snapshot of the game that a second thread loads
+* into its own copy of the game state and composes onto the
+* framebuffer. The two meet only in a lock-free triple buffer,
+* so the simulation never waits for a frame to be drawn; when
+* it runs ahead, the render thread skips to the newest
+* snapshot. Both rates are printed at exit.
+*
+* Versus and hyper games have no snapshot and keep drawing on
+* the simulation thread, as does the game over screen.
+*
+* Build (from the repository root):
+*   cc -O2 -pthread -DHOST_BUILD -DRENDER_THREAD -o tetris-host tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/dtekv-host.c host/link-pipe.c host/render-thread.c
+*/
+
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#if !defined(HOST_BUILD) || defined(SERVER_BUILD)
+#error "RENDER_THREAD is for the interactive host build"
+#endif
+#ifdef PROFILE_TRACE
+#error "PROFILE_TRACE records a single thread; build without RENDER_THREAD"
+#endif
+
+int render_publish(void);
+int render_owns_screen(void);
+void render_resume(void);
+void render_pause(void);
+
+#endif
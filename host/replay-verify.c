@@ -0,0 +1,326 @@
+/**
+* @brief   Parallel replay verifier
+*
+*
+* Plays every replay of the given directories (and files) again
+* and checks the results it claims: end tick, score, lines,
+* pieces, end cause and the hash of the final state. Serves as
+* anti-cheat for recorded games and as a regression gate for
+* rule changes: a corpus recorded by an earlier build must still
+* verify.
+*
+* Threads:
+* - The main thread lists the directories one entry at a time
+*   (readdir) and feeds the paths through a bounded queue
+* - Worker threads play one replay each on their own copy of
+*   the game state (headless.h), streaming its inputs through a
+*   fixed buffer (ReplayReader)
+* Memory stays the same however large the corpus is.
+*
+* Each mismatch is printed as one line, "path: what, claimed X,
+* replayed Y", followed by a throughput summary. Exits with 1 if
+* any replay failed to verify.
+*
+* Build (from the repository root, same BOARD_CONFIG as the
+* recorder):
+*   cc -O2 -pthread -DHOST_BUILD -DSERVER_BUILD -o tetris-verify tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/headless.c host/leaderboard.c host/replay.c host/replay-verify.c
+*
+* Usage: tetris-verify [-j threads] directory|file...
+*/
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "headless.h"
+#include "leaderboard.h"
+#include "replay.h"
+#include "session.h"
+
+#define QUEUE_SLOTS 256
+#define MAX_WORKERS 64
+#define SNAPSHOT_BYTES 1024 // Above SNAPSHOT_MAX_BYTES for every board preset
+
+/* Paths waiting for a worker, guarded by queueLock */
+static char *queue[QUEUE_SLOTS];
+static int queueHead = 0;
+static int queueCount = 0;
+static int queueClosed = 0;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queueNotFull = PTHREAD_COND_INITIALIZER;
+
+/* Totals and the output, guarded by reportLock */
+static long replaysVerified = 0;
+static long replaysFailed = 0;
+static unsigned long long ticksPlayed = 0;
+static unsigned long long bytesRead = 0;
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void queue_push(char *path)
+{
+    pthread_mutex_lock(&queueLock);
+    while (queueCount == QUEUE_SLOTS)
+    {
+        pthread_cond_wait(&queueNotFull, &queueLock);
+    }
+    queue[(queueHead + queueCount++) % QUEUE_SLOTS] = path;
+    pthread_cond_signal(&queueNotEmpty);
+    pthread_mutex_unlock(&queueLock);
+}
+
+/* Next path to verify, 0 once the queue is closed and empty */
+static char *queue_pop(void)
+{
+    char *path = 0;
+
+    pthread_mutex_lock(&queueLock);
+    while (queueCount == 0 && !queueClosed)
+    {
+        pthread_cond_wait(&queueNotEmpty, &queueLock);
+    }
+    if (queueCount > 0)
+    {
+        path = queue[queueHead];
+        queueHead = (queueHead + 1) % QUEUE_SLOTS;
+        queueCount--;
+        pthread_cond_signal(&queueNotFull);
+    }
+    pthread_mutex_unlock(&queueLock);
+    return path;
+}
+
+static void queue_close(void)
+{
+    pthread_mutex_lock(&queueLock);
+    queueClosed = 1;
+    pthread_cond_broadcast(&queueNotEmpty);
+    pthread_mutex_unlock(&queueLock);
+}
+
+/* Prints one mismatch with reportLock held; returns 1 to count it */
+static int mismatch(const char *path, const char *what, long claimed, long replayed)
+{
+    printf("%s: %s, claimed %ld, replayed %ld\n", path, what, claimed, replayed);
+    return 1;
+}
+
+/**
+* @brief Plays one replay on this thread and checks its claims
+*
+*
+* Verify function that:
+* 1. Reads the header and rejects replays for another board
+*    size or with start switches a session could not use
+* 2. Starts the game and plays the inputs as they stream in;
+*    the game must still be running before each one
+* 3. Compares the end tick, score, lines, pieces, end cause and
+*    final state hash with the claims
+*/
+static void verify_replay(const char *path)
+{
+    ReplayReader reader;
+    HeadlessCounts counts;
+    uint8_t snapshot[SNAPSHOT_BYTES];
+    int status = replay_open(&reader, path);
+
+    if (status != 0)
+    {
+        pthread_mutex_lock(&reportLock);
+        printf("%s: %s\n", path, status == -1 ? "cannot read" : "not a replay");
+        replaysFailed++;
+        pthread_mutex_unlock(&reportLock);
+        return;
+    }
+
+    const ReplayHeader *claim = &reader.header;
+    headless_start(claim->seed, claim->switches & SESSION_START_SWITCHES, &counts);
+    snapshot_save(snapshot);
+    int boardMatches = snapshot[2] == claim->boardWidth && snapshot[3] == claim->boardHeight;
+    int switchesValid = (claim->switches & ~SESSION_START_SWITCHES) == 0;
+
+    uint32_t tick = 0;
+    int input;
+    int endedEarly = 0;
+    if (boardMatches && switchesValid)
+    {
+        while ((input = replay_next(&reader)) >= 0)
+        {
+            if (gameOver)
+            {
+                endedEarly = 1;
+                break;
+            }
+            headless_tick(input, claim->switches, &counts);
+            tick++;
+        }
+    }
+    int length = snapshot_save(snapshot);
+    uint32_t stateHash = leaderboard_hash(LEADERBOARD_HASH_INIT, snapshot, length);
+    replay_close(&reader);
+
+    pthread_mutex_lock(&reportLock);
+    int failures = 0;
+    if (!boardMatches)
+    {
+        printf("%s: recorded on a %ux%u board, this build plays %ux%u\n",
+               path, claim->boardWidth, claim->boardHeight, snapshot[2], snapshot[3]);
+        failures++;
+    }
+    else if (!switchesValid)
+    {
+        printf("%s: start switches 0x%x not allowed\n", path, claim->switches);
+        failures++;
+    }
+    else
+    {
+        if (endedEarly)
+        {
+            failures += mismatch(path, "game over before the last input", claim->ticks, tick);
+        }
+        else if (tick != claim->ticks)
+        {
+            failures += mismatch(path, "inputs (file truncated)", claim->ticks, tick);
+        }
+        else if (!gameOver)
+        {
+            failures += mismatch(path, "game still running after the last input", claim->ticks, tick);
+        }
+        if (score != claim->score)
+        {
+            failures += mismatch(path, "score", claim->score, score);
+        }
+        if (counts.lines != claim->lines)
+        {
+            failures += mismatch(path, "lines", claim->lines, counts.lines);
+        }
+        if (counts.pieces != claim->pieces)
+        {
+            failures += mismatch(path, "pieces", claim->pieces, counts.pieces);
+        }
+        if (counts.endCause != claim->endCause)
+        {
+            failures += mismatch(path, "end cause", claim->endCause, counts.endCause);
+        }
+        if (stateHash != claim->stateHash)
+        {
+            failures += mismatch(path, "final state hash", claim->stateHash, stateHash);
+        }
+    }
+    if (failures)
+    {
+        replaysFailed++;
+    }
+    else
+    {
+        replaysVerified++;
+    }
+    ticksPlayed += tick;
+    bytesRead += sizeof(ReplayHeader) + tick;
+    pthread_mutex_unlock(&reportLock);
+}
+
+static void *worker_main(void *arg)
+{
+    char *path;
+
+    while ((path = queue_pop()) != 0)
+    {
+        verify_replay(path);
+        free(path);
+    }
+    return 0;
+}
+
+/* Whether name ends in REPLAY_SUFFIX */
+static int is_replay_name(const char *name)
+{
+    size_t length = strlen(name);
+    size_t suffix = strlen(REPLAY_SUFFIX);
+
+    return length > suffix && strcmp(name + length - suffix, REPLAY_SUFFIX) == 0;
+}
+
+/* Queues every replay of a directory, one entry at a time */
+static void queue_directory(const char *dir)
+{
+    DIR *listing = opendir(dir);
+    struct dirent *entry;
+
+    if (!listing)
+    {
+        perror(dir);
+        return;
+    }
+    while ((entry = readdir(listing)) != 0)
+    {
+        char *path;
+        if (is_replay_name(entry->d_name) && asprintf(&path, "%s/%s", dir, entry->d_name) >= 0)
+        {
+            queue_push(path);
+        }
+    }
+    closedir(listing);
+}
+
+int main(int argc, char **argv)
+{
+    int workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t workers[MAX_WORKERS];
+    struct timespec start, end;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-j") == 0)
+    {
+        workerCount = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: %s [-j threads] directory|file...\n", argv[0]);
+        return 2;
+    }
+    workerCount = workerCount < 1 ? 1 : workerCount > MAX_WORKERS ? MAX_WORKERS : workerCount;
+
+    headless_init();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < workerCount; i++)
+    {
+        pthread_create(&workers[i], 0, worker_main, 0);
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        struct stat info;
+        if (stat(argv[i], &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            queue_directory(argv[i]);
+        }
+        else
+        {
+            queue_push(strdup(argv[i]));
+        }
+    }
+    queue_close();
+    for (int i = 0; i < workerCount; i++)
+    {
+        pthread_join(workers[i], 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    fflush(stdout); // Mismatches before the summary
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (seconds <= 0)
+    {
+        seconds = 1e-9;
+    }
+    fprintf(stderr, "%ld verified, %ld failed, %llu ticks in %.2f s with %d threads: %.0f replays/s, %.0f ticks/s, %.1f MB/s\n",
+            replaysVerified, replaysFailed, ticksPlayed, seconds, workerCount,
+            (replaysVerified + replaysFailed) / seconds, ticksPlayed / seconds, bytesRead / seconds / 1e6);
+    return replaysFailed != 0;
+}
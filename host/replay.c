@@ -0,0 +1,104 @@
+/**
+* @brief   Replay files of the host tools
+*
+*
+* See replay.h.
+*/
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "replay.h"
+
+/**
+* @brief Opens a replay and reads its header
+*
+* @return 0, -1 if the file cannot be read, -2 if it is not a
+*         replay of this version
+*/
+int replay_open(ReplayReader *reader, const char *path)
+{
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0)
+    {
+        return -1;
+    }
+    if (read(reader->fd, &reader->header, sizeof(reader->header)) != sizeof(reader->header) ||
+        reader->header.magic != REPLAY_MAGIC || reader->header.version != REPLAY_VERSION)
+    {
+        replay_close(reader);
+        return -2;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    reader->remaining = reader->header.ticks;
+    reader->position = 0;
+    reader->length = 0;
+    return 0;
+}
+
+/**
+* @brief Next packed input, refilling the buffer as needed
+*
+* @return Input byte, or -1 after the last tick or when the
+*         file ends early
+*/
+int replay_next(ReplayReader *reader)
+{
+    if (reader->remaining == 0)
+    {
+        return -1;
+    }
+    if (reader->position == reader->length)
+    {
+        int wanted = reader->remaining < REPLAY_CHUNK ? (int)reader->remaining : REPLAY_CHUNK;
+        ssize_t got = read(reader->fd, reader->buffer, wanted);
+        if (got <= 0)
+        {
+            return -1;
+        }
+        reader->position = 0;
+        reader->length = (int)got;
+    }
+    reader->remaining--;
+    return reader->buffer[reader->position++];
+}
+
+void replay_close(ReplayReader *reader)
+{
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+}
+
+/**
+* @brief Writes a replay of header->ticks inputs
+*
+* Writes to path.tmp first and renames it into place, so tools
+* scanning the directory never see a partial replay.
+*
+* @return 0, or -1 on any error
+*/
+int replay_write(const char *path, const ReplayHeader *header, const uint8_t *inputs)
+{
+    char temporary[4096];
+    FILE *file;
+
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary) ||
+        !(file = fopen(temporary, "wb")))
+    {
+        return -1;
+    }
+    int written = fwrite(header, sizeof(*header), 1, file) == 1 &&
+                  fwrite(inputs, 1, header->ticks, file) == header->ticks;
+    if (fclose(file) != 0 || !written || rename(temporary, path) != 0)
+    {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
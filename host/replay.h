@@ -0,0 +1,60 @@
+/**
+* @brief   Replay files of the host tools
+*
+*
+* A replay holds what it takes to play a game again, and what
+* the recorder says came out of it:
+*
+*   ReplayHeader | ticks bytes of packed input (session.h)
+*
+* The claimed results are checked by re-simulation (see
+* replay-verify.c). Fields are in host byte order; the board
+* size must match the build that plays the replay back.
+*
+* ReplayReader streams the inputs through a small fixed buffer,
+* so a replay never has to fit in memory.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+
+#define REPLAY_MAGIC 0x31505254 // "TRP1"
+#define REPLAY_VERSION 1
+#define REPLAY_SUFFIX ".replay"
+#define REPLAY_CHUNK 4096
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t boardWidth;
+    uint8_t boardHeight;
+    uint8_t endCause;    // Claimed END_* of tetris.c
+    uint32_t seed;
+    uint16_t switches;   // Start switches
+    uint16_t unused;
+    uint32_t ticks;      // Input bytes that follow; the game ends on the last one
+    int32_t score;       // Claimed results from here on
+    uint32_t lines;
+    uint32_t pieces;
+    uint32_t stateHash;  // leaderboard_hash() of the final snapshot
+} ReplayHeader;
+
+typedef struct
+{
+    int fd;
+    ReplayHeader header;
+    uint32_t remaining;  // Ticks not read yet
+    int position;
+    int length;
+    uint8_t buffer[REPLAY_CHUNK];
+} ReplayReader;
+
+int replay_open(ReplayReader *reader, const char *path);
+int replay_next(ReplayReader *reader);
+void replay_close(ReplayReader *reader);
+int replay_write(const char *path, const ReplayHeader *header, const uint8_t *inputs);
+
+#endif
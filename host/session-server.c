@@ -0,0 +1,452 @@
+/**
+* @brief   Multi-session game server for the host build
+*
+*
+* Runs many independent games in one process. Each game is a
+* session, reached over its own connection to a Unix socket;
+* the frames are described in session.h.
+*
+* Threads:
+* - The main thread owns every socket. It waits in epoll, takes
+*   at most one input frame from each ready session and puts
+*   those sessions in a batch.
+* - A fixed pool of worker threads steps the batch. Each worker
+*   claims the next session with an atomic counter, loads its
+*   game from the packed snapshot into the thread's own copy of
+*   the game state (SESSION_LOCAL, see dtekv-host.h), runs one
+*   frame, packs the game again and sends the output frame.
+* - The main thread waits for the batch, closes the sessions
+*   that failed and goes back to epoll.
+*
+* A session costs a socket and a Session (about 1 KB), never a
+* thread or a stack, so thousands fit in one process once the
+* file descriptor limit allows it. Inputs a client sends ahead
+* stay queued in its socket and are stepped one per batch.
+*
+* The server is built without drawing (SERVER_BUILD), so the
+* shared framebuffer stand-in is never written.
+*
+* Every game that ends is appended to the leaderboard file
+* (leaderboard.h) by the worker that stepped it, with its
+* score, stats and the hashes that identify its replay. With
+* TETRIS_REPLAYS set, the worker also writes the replay
+* (replay.h) for replay-verify.c to check.
+*
+* Build (from the repository root):
+*   cc -O2 -pthread -DHOST_BUILD -DSERVER_BUILD -o tetris-server tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/headless.c host/leaderboard.c host/replay.c host/session-server.c
+*
+* Usage: tetris-server [socket path] [worker threads]
+*
+* Environment:
+*   TETRIS_LEADERBOARD  leaderboard file (tetris-leaderboard.bin)
+*   TETRIS_REPLAYS      directory for replays of finished games
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "headless.h"
+#include "leaderboard.h"
+#include "replay.h"
+#include "session.h"
+
+#define MAX_BATCH 1024 // Sessions stepped per batch (epoll events per wait)
+#define MAX_WORKERS 64
+#define LEADERBOARD_PATH "tetris-leaderboard.bin"
+#define LEADERBOARD_CAPACITY (1 << 18) // Games a new file has room for (12 MB)
+
+typedef struct
+{
+    int fd;
+    int started;              // Set by the first SESSION_START
+    int failed;               // Closed by the main thread after the batch
+    int gameOver;
+    int won;
+    int32_t score;            // As of the last step, sent in every reply
+    int lastButton;           // Input edge state, outside the snapshot
+    int lastSwitches;
+    int startSwitches;
+    uint32_t seed;
+    uint32_t tick;
+    HeadlessCounts counts;
+    uint32_t inputHash;       // Over the packed inputs so far
+    uint8_t *inputs;          // Packed input of every tick, for the replay
+    uint32_t inputCapacity;
+    int inputsLost;           // Out of memory; no replay for this game
+    SessionInput input;       // Frame being stepped in this batch
+    int length;               // Bytes used in state
+    uint8_t state[SESSION_STATE_BYTES];
+} Session;
+
+/* Batch shared with the workers, guarded by poolLock */
+static Session *batch[MAX_BATCH];
+static int batchCount = 0;
+static atomic_int batchNext;
+static unsigned int batchGeneration = 0;
+static int workersBusy = 0;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batchReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t batchDone = PTHREAD_COND_INITIALIZER;
+static int workerCount = 0;
+
+static Leaderboard leaderboard; // header is 0 when there is none
+static const char *replayDir = 0;
+static atomic_uint replaysWritten;
+
+/* Sends the session's state as one output frame */
+static void session_reply(Session *s, int flags)
+{
+    SessionOutput out;
+
+    out.type = s->input.type;
+    out.flags = flags | (s->gameOver ? SESSION_GAME_OVER : 0) | (s->won ? SESSION_WON : 0);
+    out.length = s->length;
+    out.tick = s->tick;
+    out.score = s->score;
+    memcpy(out.state, s->state, s->length);
+    if (send(s->fd, &out, SESSION_OUTPUT_HEADER + s->length, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    {
+        s->failed = 1; // Client gone, or not reading its outputs
+    }
+}
+
+/* Keeps the packed input of a tick for the replay */
+static void keep_input(Session *s, uint8_t input)
+{
+    if (s->inputsLost)
+    {
+        return;
+    }
+    if (s->tick >= s->inputCapacity)
+    {
+        uint32_t capacity = s->inputCapacity ? s->inputCapacity * 2 : 1024;
+        uint8_t *inputs = realloc(s->inputs, capacity);
+        if (!inputs)
+        {
+            s->inputsLost = 1;
+            return;
+        }
+        s->inputs = inputs;
+        s->inputCapacity = capacity;
+    }
+    s->inputs[s->tick] = input;
+}
+
+/* Records the session's finished game on the leaderboard and as a replay */
+static void record_game(Session *s)
+{
+    uint32_t stateHash = leaderboard_hash(LEADERBOARD_HASH_INIT, s->state, s->length);
+
+    if (leaderboard.header)
+    {
+        LeaderboardRecord record = {0};
+        record.endTime = time(0);
+        record.seed = s->seed;
+        record.switches = s->startSwitches;
+        record.mode = gameMode;
+        record.endCause = s->counts.endCause;
+        record.score = s->score;
+        record.ticks = s->tick;
+        record.pieces = s->counts.pieces;
+        record.lines = s->counts.lines;
+        record.inputHash = s->inputHash;
+        record.stateHash = stateHash;
+        leaderboard_append(&leaderboard, &record);
+    }
+
+    if (replayDir && !s->inputsLost)
+    {
+        ReplayHeader header = {0};
+        char path[4096];
+
+        header.magic = REPLAY_MAGIC;
+        header.version = REPLAY_VERSION;
+        header.boardWidth = s->state[2]; // From the snapshot header
+        header.boardHeight = s->state[3];
+        header.endCause = s->counts.endCause;
+        header.seed = s->seed;
+        header.switches = s->startSwitches;
+        header.ticks = s->tick;
+        header.score = s->score;
+        header.lines = s->counts.lines;
+        header.pieces = s->counts.pieces;
+        header.stateHash = stateHash;
+        snprintf(path, sizeof(path), "%s/%08x-%d-%u" REPLAY_SUFFIX,
+                 replayDir, s->seed, (int)getpid(), atomic_fetch_add(&replaysWritten, 1));
+        replay_write(path, &header, s->inputs);
+    }
+}
+
+/**
+* @brief Runs one input frame of a session on the calling worker
+*
+*
+* Step function that:
+* 1. SESSION_START: seeds and sets up a fresh game with the
+*    allowed start switches
+* 2. SESSION_INPUT: resumes the session's game on this thread
+*    and runs one tick of it (headless_resume, headless_tick)
+* 3. Packs the game back into the session, records it if this
+*    tick ended it, and replies
+*/
+static void session_step(Session *s)
+{
+    SessionInput *in = &s->input;
+
+    if (in->type == SESSION_START)
+    {
+        s->startSwitches = in->switches & SESSION_START_SWITCHES;
+        s->seed = in->seed;
+        headless_start(s->seed, s->startSwitches, &s->counts);
+        s->started = 1;
+        s->tick = 0;
+        s->lastButton = 0;
+        s->lastSwitches = s->startSwitches;
+        s->inputHash = LEADERBOARD_HASH_INIT;
+        s->inputsLost = 0;
+    }
+    else if (!s->started || s->gameOver)
+    {
+        session_reply(s, s->started ? 0 : SESSION_NOT_STARTED);
+        return;
+    }
+    else
+    {
+        uint8_t input = (in->switches & SESSION_PLAY_SWITCHES) | ((in->button & 1) ? SESSION_TICK_BUTTON : 0);
+
+        headless_resume(s->state, s->length, s->lastButton, s->lastSwitches);
+        headless_tick(input, s->startSwitches, &s->counts);
+
+        s->lastButton = lastButtonState;
+        s->lastSwitches = lastSwitchState;
+        s->inputHash = leaderboard_hash(s->inputHash, &input, 1);
+        keep_input(s, input);
+        s->tick++;
+    }
+
+    s->gameOver = gameOver;
+    s->won = roundWon;
+    s->score = score;
+    s->length = snapshot_save(s->state);
+    if (s->gameOver && in->type == SESSION_INPUT)
+    {
+        record_game(s);
+    }
+    session_reply(s, 0);
+}
+
+/* Worker thread: steps sessions of each new batch until none are left */
+static void *worker_main(void *arg)
+{
+    unsigned int seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&poolLock);
+        while (batchGeneration == seen)
+        {
+            pthread_cond_wait(&batchReady, &poolLock);
+        }
+        seen = batchGeneration;
+        pthread_mutex_unlock(&poolLock);
+
+        int i;
+        while ((i = atomic_fetch_add(&batchNext, 1)) < batchCount)
+        {
+            session_step(batch[i]);
+        }
+
+        pthread_mutex_lock(&poolLock);
+        if (--workersBusy == 0)
+        {
+            pthread_cond_signal(&batchDone);
+        }
+        pthread_mutex_unlock(&poolLock);
+    }
+    return 0;
+}
+
+/* Hands the collected batch to the workers and waits until it is done */
+static void run_batch(void)
+{
+    pthread_mutex_lock(&poolLock);
+    atomic_store(&batchNext, 0);
+    workersBusy = workerCount;
+    batchGeneration++;
+    pthread_cond_broadcast(&batchReady);
+    while (workersBusy > 0)
+    {
+        pthread_cond_wait(&batchDone, &poolLock);
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+static void close_session(int epollFd, Session *s)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, s->fd, 0);
+    close(s->fd);
+    free(s->inputs);
+    free(s);
+}
+
+/* Accepts every pending connection as a new session */
+static void accept_sessions(int epollFd, int listenFd)
+{
+    int fd;
+
+    while ((fd = accept4(listenFd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        Session *s = calloc(1, sizeof(Session));
+        struct epoll_event event = {.events = EPOLLIN};
+
+        if (!s)
+        {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        event.data.ptr = s;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(s);
+        }
+    }
+}
+
+/**
+* @brief Reads one input frame of a ready session
+*
+* @return 1 if the session joins the batch, 0 if it was closed
+*         (hang-up, error or malformed frame)
+*/
+static int read_input(int epollFd, Session *s)
+{
+    ssize_t received = recv(s->fd, &s->input, sizeof(s->input), MSG_DONTWAIT);
+
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return 0;
+    }
+    if (received != sizeof(s->input) ||
+        (s->input.type != SESSION_START && s->input.type != SESSION_INPUT))
+    {
+        close_session(epollFd, s);
+        return 0;
+    }
+    return 1;
+}
+
+static int open_listener(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0 || strlen(path) >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : SESSION_SOCKET_PATH;
+    long threads = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    struct epoll_event events[MAX_BATCH];
+
+    const char *leaderboardPath = getenv("TETRIS_LEADERBOARD");
+
+    signal(SIGPIPE, SIG_IGN);
+    headless_init();
+    replayDir = getenv("TETRIS_REPLAYS");
+
+    if (!leaderboardPath)
+    {
+        leaderboardPath = LEADERBOARD_PATH;
+    }
+    if (leaderboard_open(&leaderboard, leaderboardPath, LEADERBOARD_CAPACITY) != 0)
+    {
+        fprintf(stderr, "tetris-server: %s is not a leaderboard file, games are not recorded\n", leaderboardPath);
+    }
+
+    int listenFd = open_listener(path);
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listenEvent = {.events = EPOLLIN, .data.ptr = 0};
+    if (listenFd < 0 || epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+
+    workerCount = threads < 1 ? 1 : threads > MAX_WORKERS ? MAX_WORKERS : (int)threads;
+    for (int i = 0; i < workerCount; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, worker_main, 0) != 0)
+        {
+            perror("pthread_create");
+            return 1;
+        }
+        pthread_detach(thread);
+    }
+    fprintf(stderr, "tetris-server: %s, %d workers\n", path, workerCount);
+
+    for (;;)
+    {
+        int ready = epoll_wait(epollFd, events, MAX_BATCH, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            return 1;
+        }
+
+        batchCount = 0;
+        for (int i = 0; i < ready; i++)
+        {
+            Session *s = events[i].data.ptr;
+            if (!s)
+            {
+                accept_sessions(epollFd, listenFd);
+            }
+            else if (read_input(epollFd, s))
+            {
+                batch[batchCount++] = s;
+            }
+        }
+        if (batchCount == 0)
+        {
+            continue;
+        }
+
+        run_batch();
+        for (int i = 0; i < batchCount; i++)
+        {
+            if (batch[i]->failed)
+            {
+                close_session(epollFd, batch[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/**
+* @brief   Wire format of the multi-session game server
+*
+*
+* Clients connect to the server's Unix socket with
+* SOCK_SEQPACKET, so every frame below is exactly one message.
+* A connection is one session and plays one game at a time:
+*
+*   SESSION_START  starts (or restarts) the game; seed seeds the
+*                  bag, switches select the mode and puzzle as
+*                  at game start on the board
+*   SESSION_INPUT  runs one tick: the direction and hold
+*                  switches and the button as they are now
+*
+* The server answers every frame with one SessionOutput,
+* header plus length bytes of state (a snapshot_save() blob of
+* the game after the tick). Fields are in host byte order;
+* client and server run on the same machine.
+*
+* See session-server.c.
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+
+#define SESSION_SOCKET_PATH "/tmp/tetris-sessions.sock"
+#define SESSION_STATE_BYTES 1024 // Above SNAPSHOT_MAX_BYTES for every board preset
+
+/* SessionInput.type */
+#define SESSION_START 1
+#define SESSION_INPUT 2
+
+/* Switches a session may set; versus and hyper need a link or
+   a screen and are masked off, as is the quick-save switch */
+#define SESSION_START_SWITCHES 0x27F // Puzzle select, puzzle and quad mode
+#define SESSION_PLAY_SWITCHES 0x1F   // Directions and hold
+
+/* One tick's input packed into a byte, as stored in replays:
+   the play switches plus the button */
+#define SESSION_TICK_BUTTON 0x20
+
+/* SessionOutput.flags */
+#define SESSION_GAME_OVER 0x1
+#define SESSION_WON 0x2        // Puzzle solved
+#define SESSION_NOT_STARTED 0x4 // SESSION_INPUT before any SESSION_START
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t button;    // Bit 0: button held
+    uint16_t switches;
+    uint32_t seed;     // SESSION_START only
+} SessionInput;
+
+typedef struct
+{
+    uint8_t type;      // Echo of the input type
+    uint8_t flags;
+    uint16_t length;   // Bytes of state that follow
+    uint32_t tick;     // Ticks run since SESSION_START
+    int32_t score;
+    uint8_t state[SESSION_STATE_BYTES];
+} SessionOutput;
+
+#define SESSION_OUTPUT_HEADER 12
+
+#endif
@@ -0,0 +1,166 @@
+/**
+* @brief   Chrome trace output for host builds with -DPROFILE_TRACE
+*
+*
+* Records every trace_begin()/trace_end() pair of tetris.c and
+* profile.c as a duration event and trace_counter() as a counter
+* event, in the JSON array format that chrome://tracing and
+* ui.perfetto.dev open directly.
+*
+* Events go into a fixed buffer holding only the name pointer, a
+* nanosecond timestamp and the value, so a span costs one
+* clock_gettime() and no formatting. The buffer is formatted and
+* written between frames once it is mostly full (or immediately
+* if it fills up mid-frame); each write shows up in the trace
+* itself as a "trace_flush" span. The array is closed at exit.
+*
+* Environment:
+*   TETRIS_TRACE  output file, default tetris-host.trace.json
+*
+* Build (from the repository root):
+*   cc -O2 -DHOST_BUILD -DPROFILE_TRACE -o tetris-host tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/dtekv-host.c host/link-pipe.c host/trace.c
+*/
+
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../profile.h"
+
+#define TRACE_EVENTS 8192                  // Buffered events
+#define TRACE_FLUSH_AT (TRACE_EVENTS * 3 / 4) // Written at the next frame end from here
+
+typedef struct
+{
+    const char *name;   // String literal, never copied
+    uint64_t time;      // Nanoseconds since the first event
+    int value;          // Counter value
+    char phase;         // 'B', 'E' or 'C'
+} TraceEvent;
+
+static TraceEvent events[TRACE_EVENTS];
+static int eventCount = 0;
+static FILE *traceFile = 0;
+static int traceFailed = 0;
+static int eventsWritten = 0;
+static uint64_t traceOrigin;
+
+static uint64_t trace_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/* Formats the buffered events, timestamps in microseconds with
+   nanosecond decimals, and empties the buffer */
+static void write_events(void)
+{
+    for (int i = 0; i < eventCount; i++)
+    {
+        const TraceEvent *event = &events[i];
+        fprintf(traceFile, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":1",
+                eventsWritten++ ? "," : "", event->name, event->phase,
+                (unsigned long long)(event->time / 1000), (unsigned)(event->time % 1000));
+        if (event->phase == 'C')
+        {
+            fprintf(traceFile, ",\"args\":{\"value\":%d}}", event->value);
+        }
+        else
+        {
+            fputs("}", traceFile);
+        }
+    }
+    eventCount = 0;
+}
+
+/**
+* @brief Writes the buffered events out
+*
+* The time the write took is recorded as a "trace_flush" span,
+* the first two events of the emptied buffer.
+*/
+static void trace_flush(void)
+{
+    uint64_t start = trace_now();
+
+    write_events();
+    events[0] = (TraceEvent){"trace_flush", start - traceOrigin, 0, 'B'};
+    events[1] = (TraceEvent){"trace_flush", trace_now() - traceOrigin, 0, 'E'};
+    eventCount = 2;
+}
+
+/* Closes the JSON array so the file opens even after a quit mid-game */
+static void trace_close(void)
+{
+    write_events();
+    fputs("\n]\n", traceFile);
+    fclose(traceFile);
+    traceFile = 0;
+}
+
+/* Opens the output on first use; on failure tracing stops quietly */
+static int trace_open(void)
+{
+    const char *path = getenv("TETRIS_TRACE");
+
+    if (traceFile || traceFailed)
+    {
+        return traceFile != 0;
+    }
+    traceFile = fopen(path ? path : "tetris-host.trace.json", "w");
+    if (!traceFile)
+    {
+        perror(path ? path : "tetris-host.trace.json");
+        traceFailed = 1;
+        return 0;
+    }
+    fputs("[", traceFile);
+    traceOrigin = trace_now();
+    atexit(trace_close);
+    return 1;
+}
+
+static void trace_event(const char *name, char phase, int value)
+{
+    if (!trace_open())
+    {
+        return;
+    }
+    if (eventCount == TRACE_EVENTS)
+    {
+        trace_flush();
+    }
+    events[eventCount++] = (TraceEvent){name, trace_now() - traceOrigin, value, phase};
+}
+
+void trace_begin(const char *name)
+{
+    trace_event(name, 'B', 0);
+}
+
+void trace_end(const char *name)
+{
+    trace_event(name, 'E', 0);
+}
+
+void trace_counter(const char *name, int value)
+{
+    trace_event(name, 'C', value);
+}
+
+/**
+* @brief Writes the buffer out between frames once it is mostly full
+*
+* Called by prof_frame_done(); flushing here keeps the writes
+* out of the frame spans in the common case.
+*/
+void trace_frame_done(void)
+{
+    if (traceFile && eventCount >= TRACE_FLUSH_AT)
+    {
+        trace_flush();
+    }
+}
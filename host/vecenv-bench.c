@@ -0,0 +1,106 @@
+/**
+* @brief   Throughput benchmark of the vectorized environment
+*
+*
+* Steps n games with random actions and reports steps per
+* second, games finished and a checksum of every reward, done
+* flag and the last observations. The checksum depends only on
+* the seed, the games and the steps, not on the thread count, so
+* comparing it across -j values checks that threads do not leak
+* state between games.
+*
+* Usage:
+*   tetris-vecbench [-n games] [-j threads] [-s steps] [-m switches] [-r seed]
+*
+* Build (from the repository root):
+*   cc -O2 -pthread -DHOST_BUILD -DSERVER_BUILD -o tetris-vecbench tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/headless.c host/leaderboard.c host/vecenv.c host/vecenv-bench.c
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "leaderboard.h"
+#include "session.h"
+#include "vecenv.h"
+
+int main(int argc, char **argv)
+{
+    int envCount = 4096;
+    int threadCount = 0;
+    long steps = 1000;
+    int switches = 0;
+    uint32_t seed = 1;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:j:s:m:r:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n': envCount = atoi(optarg); break;
+        case 'j': threadCount = atoi(optarg); break;
+        case 's': steps = atol(optarg); break;
+        case 'm': switches = strtol(optarg, 0, 0); break;
+        case 'r': seed = strtoul(optarg, 0, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-n games] [-j threads] [-s steps] [-m switches] [-r seed]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    VecEnv *env = vecenv_create(envCount, threadCount, seed, switches);
+    int observationBytes = vecenv_observation_bytes();
+    uint8_t *actions = malloc(envCount);
+    int32_t *rewards = malloc(envCount * sizeof(int32_t));
+    uint8_t *dones = malloc(envCount);
+    uint8_t *observations = malloc((size_t)envCount * observationBytes);
+    if (!env || !actions || !rewards || !dones || !observations)
+    {
+        fprintf(stderr, "%s: cannot create %d games\n", argv[0], envCount);
+        return 1;
+    }
+
+    struct timespec start, end;
+    uint32_t random = seed | 1;
+    uint32_t checksum = LEADERBOARD_HASH_INIT;
+    long finished = 0;
+    int64_t totalReward = 0;
+
+    vecenv_reset(env, observations);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long step = 0; step < steps; step++)
+    {
+        for (int i = 0; i < envCount; i++)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            actions[i] = random & (SESSION_PLAY_SWITCHES | SESSION_TICK_BUTTON);
+        }
+        vecenv_step(env, actions, rewards, dones, observations);
+        for (int i = 0; i < envCount; i++)
+        {
+            finished += dones[i];
+            totalReward += rewards[i];
+        }
+        checksum = leaderboard_hash(checksum, rewards, envCount * sizeof(int32_t));
+        checksum = leaderboard_hash(checksum, dones, envCount);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    checksum = leaderboard_hash(checksum, observations, (size_t)envCount * observationBytes);
+
+    int width, height;
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    vecenv_board_size(&width, &height);
+    printf("%d games of %dx%d, %ld steps: %.0f steps/s in %.3f s, %ld games finished, reward %lld, checksum %08x\n",
+           envCount, width, height, steps, envCount * (double)steps / seconds, seconds, finished,
+           (long long)totalReward, checksum);
+
+    vecenv_destroy(env);
+    free(actions);
+    free(rewards);
+    free(dones);
+    free(observations);
+    return 0;
+}
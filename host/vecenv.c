@@ -0,0 +1,311 @@
+/**
+* @brief   Vectorized game environment for training and evaluation
+*
+*
+* See vecenv.h. Games are kept packed (snapshot_save) between
+* steps, like the sessions of session-server.c, so any thread
+* can step any game: it resumes the game into its own
+* thread-local state, runs one tick with headless_tick() and
+* packs it again. Threads claim games in chunks from an atomic
+* counter; the calling thread steps games too, so one step call
+* costs one wake-up of the pool and no allocation.
+*/
+
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "headless.h"
+#include "session.h"
+#include "vecenv.h"
+
+#define VECENV_CHUNK 64        // Games claimed at a time, neighbours in the buffers
+#define VECENV_MAX_THREADS 256
+
+/* Game hooks from tetris.c */
+extern int observe_board(uint8_t *out);
+extern void board_dimensions(int *width, int *height);
+
+/* One game between steps */
+typedef struct
+{
+    uint32_t episode;        // Games finished so far, picks the next seed
+    int32_t score;           // After the last step, for the reward
+    uint16_t length;         // Of state
+    uint16_t lastSwitches;   // Input edge state after the last step
+    uint8_t lastButton;
+    HeadlessCounts counts;
+    uint8_t state[SESSION_STATE_BYTES];
+} VecGame;
+
+struct VecEnv
+{
+    int envCount;
+    int switches;            // Start switches of every game
+    uint32_t seed;
+    VecGame *games;
+
+    /* Buffers of the call being run; actions is 0 for a reset */
+    const uint8_t *actions;
+    int32_t *rewards;
+    uint8_t *dones;
+    uint8_t *observations;
+    atomic_int next;         // First game of the next unclaimed chunk
+
+    /* Helper threads; the caller is the last worker */
+    pthread_t threads[VECENV_MAX_THREADS];
+    int threadCount;
+    int busy;
+    unsigned int generation;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t done;
+};
+
+static pthread_once_t tablesBuilt = PTHREAD_ONCE_INIT;
+
+/* Seed of a game's episode: distinct per game and per episode, the same on every run */
+static uint32_t game_seed(const VecEnv *env, int index, uint32_t episode)
+{
+    return env->seed + (uint32_t)index * 0x9E3779B9u + episode * 0x85EBCA6Bu;
+}
+
+/* Starts game index's next episode on this thread and packs it */
+static void start_episode(VecEnv *env, int index)
+{
+    VecGame *game = &env->games[index];
+
+    headless_start(game_seed(env, index, game->episode), env->switches, &game->counts);
+    game->score = score;
+    game->lastButton = 0;
+    game->lastSwitches = env->switches;
+    game->length = snapshot_save(game->state);
+}
+
+/**
+* @brief Steps one game and writes its results
+*
+*
+* Step function that:
+* 1. Resumes the game on this thread and runs one tick with its
+*    action, or starts the first episode for a reset
+* 2. Writes the reward and done flag; a finished game starts its
+*    next episode right away
+* 3. Packs the game again and writes the observation of the game
+*    now on this thread
+*/
+static void step_game(VecEnv *env, int index, int observationBytes)
+{
+    VecGame *game = &env->games[index];
+
+    if (!env->actions)
+    {
+        game->episode = 0;
+        start_episode(env, index);
+    }
+    else
+    {
+        uint8_t action = env->actions[index] & (SESSION_PLAY_SWITCHES | SESSION_TICK_BUTTON);
+
+        headless_resume(game->state, game->length, game->lastButton, game->lastSwitches);
+        headless_tick(action, env->switches, &game->counts);
+        env->rewards[index] = score - game->score;
+        env->dones[index] = gameOver != 0;
+
+        if (gameOver)
+        {
+            game->episode++;
+            start_episode(env, index);
+        }
+        else
+        {
+            game->score = score;
+            game->lastButton = lastButtonState;
+            game->lastSwitches = lastSwitchState;
+            game->length = snapshot_save(game->state);
+        }
+    }
+    observe_board(env->observations + (size_t)index * observationBytes);
+}
+
+/* Claims chunks of games until none are left */
+static void run_games(VecEnv *env)
+{
+    int observationBytes = observe_board(0);
+    int first;
+
+    while ((first = atomic_fetch_add(&env->next, VECENV_CHUNK)) < env->envCount)
+    {
+        int last = first + VECENV_CHUNK < env->envCount ? first + VECENV_CHUNK : env->envCount;
+        for (int i = first; i < last; i++)
+        {
+            step_game(env, i, observationBytes);
+        }
+    }
+}
+
+/* Helper thread: works on each new call until the environment is destroyed */
+static void *vecenv_worker(void *arg)
+{
+    VecEnv *env = arg;
+    unsigned int seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&env->lock);
+        while (env->generation == seen && !env->stopping)
+        {
+            pthread_cond_wait(&env->ready, &env->lock);
+        }
+        if (env->stopping)
+        {
+            pthread_mutex_unlock(&env->lock);
+            return 0;
+        }
+        seen = env->generation;
+        pthread_mutex_unlock(&env->lock);
+
+        run_games(env);
+
+        pthread_mutex_lock(&env->lock);
+        if (--env->busy == 0)
+        {
+            pthread_cond_signal(&env->done);
+        }
+        pthread_mutex_unlock(&env->lock);
+    }
+}
+
+/* Runs the call set up in env on all threads and returns when every game is done */
+static void run_call(VecEnv *env)
+{
+    pthread_mutex_lock(&env->lock);
+    atomic_store(&env->next, 0);
+    env->busy = env->threadCount;
+    env->generation++;
+    pthread_cond_broadcast(&env->ready);
+    pthread_mutex_unlock(&env->lock);
+
+    run_games(env);
+
+    pthread_mutex_lock(&env->lock);
+    while (env->busy > 0)
+    {
+        pthread_cond_wait(&env->done, &env->lock);
+    }
+    pthread_mutex_unlock(&env->lock);
+}
+
+/**
+* @brief Creates envCount games, not yet started
+*
+* @param threadCount Threads stepping the games, the caller's
+*                    included; 0 for one per processor
+* @param seed Base of every game's seeds
+* @param switches Start switches of every game, limited to
+*                 SESSION_START_SWITCHES
+* @return The environment, or 0 if it cannot be created
+*/
+VecEnv *vecenv_create(int envCount, int threadCount, uint32_t seed, int switches)
+{
+    VecEnv *env;
+
+    if (envCount <= 0)
+    {
+        return 0;
+    }
+    if (threadCount <= 0)
+    {
+        threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threadCount = threadCount < 1 ? 1 : threadCount > VECENV_MAX_THREADS ? VECENV_MAX_THREADS : threadCount;
+
+    pthread_once(&tablesBuilt, headless_init);
+    env = calloc(1, sizeof(*env));
+    if (!env || !(env->games = calloc(envCount, sizeof(VecGame))))
+    {
+        free(env);
+        return 0;
+    }
+    env->envCount = envCount;
+    env->switches = switches & SESSION_START_SWITCHES;
+    env->seed = seed;
+    pthread_mutex_init(&env->lock, 0);
+    pthread_cond_init(&env->ready, 0);
+    pthread_cond_init(&env->done, 0);
+
+    for (int i = 0; i < threadCount - 1; i++)
+    {
+        if (pthread_create(&env->threads[i], 0, vecenv_worker, env) != 0)
+        {
+            break; // Fewer helpers; the games still all get stepped
+        }
+        env->threadCount++;
+    }
+    return env;
+}
+
+void vecenv_destroy(VecEnv *env)
+{
+    if (!env)
+    {
+        return;
+    }
+    pthread_mutex_lock(&env->lock);
+    env->stopping = 1;
+    pthread_cond_broadcast(&env->ready);
+    pthread_mutex_unlock(&env->lock);
+    for (int i = 0; i < env->threadCount; i++)
+    {
+        pthread_join(env->threads[i], 0);
+    }
+    pthread_mutex_destroy(&env->lock);
+    pthread_cond_destroy(&env->ready);
+    pthread_cond_destroy(&env->done);
+    free(env->games);
+    free(env);
+}
+
+/**
+* @brief Bytes of one game's observation
+*/
+int vecenv_observation_bytes(void)
+{
+    return observe_board(0);
+}
+
+/**
+* @brief Board size in cells, the size of each observation plane
+*/
+void vecenv_board_size(int *width, int *height)
+{
+    board_dimensions(width, height);
+}
+
+/**
+* @brief Starts the first episode of every game
+*
+* @param observations Receives every game's first observation
+*/
+void vecenv_reset(VecEnv *env, uint8_t *observations)
+{
+    env->actions = 0;
+    env->observations = observations;
+    run_call(env);
+}
+
+/**
+* @brief Runs one tick of every game
+*
+* Call vecenv_reset() first. Buffers are laid out as in vecenv.h.
+*/
+void vecenv_step(VecEnv *env, const uint8_t *actions, int32_t *rewards, uint8_t *dones, uint8_t *observations)
+{
+    env->actions = actions;
+    env->rewards = rewards;
+    env->dones = dones;
+    env->observations = observations;
+    run_call(env);
+}
@@ -0,0 +1,47 @@
+/**
+* @brief   Vectorized game environment for training and evaluation
+*
+*
+* Creates n games and steps all of them with one call on a pool
+* of threads, for reinforcement learning and policy evaluation
+* on the host:
+*
+*   VecEnv *env = vecenv_create(n, threads, seed, switches);
+*   vecenv_reset(env, observations);
+*   for (;;)
+*       vecenv_step(env, actions, rewards, dones, observations);
+*
+* All buffers belong to the caller and are written in place, one
+* contiguous array per quantity with game i at index i:
+*
+*   actions       n bytes, packed tick inputs (session.h): play
+*                 switches plus SESSION_TICK_BUTTON
+*   rewards       n int32, score gained by the step
+*   dones         n bytes, 1 when the step ended the game
+*   observations  n * vecenv_observation_bytes() bytes, the board
+*                 planes of observe_board() in tetris.c
+*
+* A game that ends starts over on the same call with its next
+* seed, so its observation already shows the new game. Nothing
+* is allocated after vecenv_create(), and each game is written
+* straight into the caller's buffers by the thread that steps it.
+*
+* Build the library and a caller with -DHOST_BUILD -DSERVER_BUILD
+* (see vecenv-bench.c).
+*/
+
+#ifndef VECENV_H
+#define VECENV_H
+
+#include <stdint.h>
+
+typedef struct VecEnv VecEnv;
+
+VecEnv *vecenv_create(int envCount, int threadCount, uint32_t seed, int switches);
+void vecenv_destroy(VecEnv *env);
+int vecenv_observation_bytes(void);
+void vecenv_board_size(int *width, int *height);
+void vecenv_reset(VecEnv *env, uint8_t *observations);
+void vecenv_step(VecEnv *env, const uint8_t *actions, int32_t *rewards, uint8_t *dones, uint8_t *observations);
+
+#endif
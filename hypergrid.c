@@ -0,0 +1,465 @@
+/**
+* @brief   4D hypergrid mode: tetracubes in an N x N x N x N grid
+*
+*
+* The grid is addressed as (x, y, z, w) with gravity along +y.
+* It is shown as an N x N grid of 2D slices on the VGA: slice
+* column z, slice row w, and inside each slice x to the right
+* and y downward, so every piece falls down in all the slices
+* it occupies.
+*
+* Bit-packed representation:
+* - One (x, y) slice is N*N bits of a uint64_t, bit y*N + x
+* - Cell colors (1-7, 0 = empty) are stored as three such
+*   bitplanes per slice; occupancy is their OR
+* - A 6^4 grid (1296 cells) takes 3 * 36 * 8 = 864 bytes
+*
+* This keeps the per-frame work small on the rv32 core:
+* - Collision tests one bit per piece cell
+* - Full hyperplanes (all N^3 cells with the same y) are found
+*   by ANDing the occupancy of every slice once and testing
+*   each row of the result
+* - Clearing a hyperplane is a mask and shift per bitplane
+*   per slice
+*/
+
+#include "hypergrid.h"
+
+#ifdef HOST_BUILD
+#include "host/dtekv-host.h" // SESSION_LOCAL
+#else
+#define SESSION_LOCAL
+#endif
+
+/* Shared with tetris.c */
+extern void fill_rect(int x, int y, int w, int h, char vgaColor);
+extern char get_vga_color(char piece_color);
+extern int my_rand(void);
+extern void score_lines(int linesCleared);
+extern void end_game(int cause, int direction);
+extern SESSION_LOCAL int scoreDirty; // Score bar repainted by the frame loop
+
+#define END_TOPOUT 0 // As in tetris.c
+#define DIR_DOWN 0   // Pieces fall along y, counted as downward
+
+#define AXIS_X 0
+#define AXIS_Y 1
+#define AXIS_Z 2
+#define AXIS_W 3
+
+#define CUBE_TYPES 8
+#define CUBE_CELLS 4
+
+#define ROW_MASK ((1ull << HYPER_N) - 1)
+#define CELL_BIT(x, y) (1ull << ((y) * HYPER_N + (x)))
+
+/* Movement and plane switches, read as state changes like the
+   2D direction switches */
+#define HYPER_SWITCH_X_PLUS 0x1  // Switch 1
+#define HYPER_SWITCH_X_MINUS 0x2 // Switch 2
+#define HYPER_SWITCH_Z_PLUS 0x4  // Switch 3
+#define HYPER_SWITCH_Z_MINUS 0x8 // Switch 4
+#define HYPER_SWITCH_W_PLUS 0x10 // Switch 5
+#define HYPER_SWITCH_W_MINUS 0x20 // Switch 6
+#define HYPER_SWITCH_PLANE 0x40  // Switch 7, next rotation plane
+
+#define EMPTY_CELL_VGA 0x24 // Dark slice background
+
+/* The eight one-sided tetracubes as (x, y, z) offsets, w = 0.
+   Cell 1 is the rotation pivot. */
+const int8_t TETRACUBES[CUBE_TYPES][CUBE_CELLS][3] = {
+    {{0, 0, 0}, {1, 0, 0}, {2, 0, 0}, {3, 0, 0}}, // I
+    {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}}, // O
+    {{0, 0, 0}, {1, 0, 0}, {2, 0, 0}, {1, 1, 0}}, // T
+    {{0, 0, 0}, {1, 0, 0}, {2, 0, 0}, {0, 1, 0}}, // L
+    {{1, 0, 0}, {2, 0, 0}, {0, 1, 0}, {1, 1, 0}}, // S
+    {{1, 0, 0}, {0, 0, 0}, {0, 1, 0}, {0, 0, 1}}, // Branch
+    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}}, // Right screw
+    {{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {1, 1, 0}}  // Left screw
+};
+
+/* Rotation planes as axis pairs, cycled by HYPER_SWITCH_PLANE */
+const int8_t HYPER_PLANE_AXES[HYPER_PLANES][2] = {
+    {AXIS_X, AXIS_Y}, {AXIS_X, AXIS_Z}, {AXIS_X, AXIS_W},
+    {AXIS_Z, AXIS_W}, {AXIS_Y, AXIS_Z}, {AXIS_Y, AXIS_W}};
+
+/* Axis colors for the rotation plane indicator */
+const char AXIS_COLORS[HYPER_AXES] = {7, 5, 2, 4}; // Red x, green y, blue z, yellow w
+
+typedef struct
+{
+    int8_t cells[CUBE_CELLS][HYPER_AXES]; // Absolute grid coordinates
+    int8_t type;
+} HyperPiece;
+
+uint64_t hyperPlanes[3][HYPER_N][HYPER_N]; // [color bit][w][z]
+HyperPiece hyperPiece;
+int hyperPlane = 0;
+
+// Screen layout, set by hyper_init()
+static int cellPx;
+static int slicePitch;
+static int gridX;
+static int gridY;
+
+/* Occupancy of slice (z, w) */
+static uint64_t slice_occupancy(int z, int w)
+{
+    return hyperPlanes[0][w][z] | hyperPlanes[1][w][z] | hyperPlanes[2][w][z];
+}
+
+/* Color index of one cell, 0 when empty */
+static int cell_color(int x, int y, int z, int w)
+{
+    uint64_t bit = CELL_BIT(x, y);
+    return ((hyperPlanes[0][w][z] & bit) ? 1 : 0) |
+           ((hyperPlanes[1][w][z] & bit) ? 2 : 0) |
+           ((hyperPlanes[2][w][z] & bit) ? 4 : 0);
+}
+
+static int piece_color(void)
+{
+    return hyperPiece.type % 7 + 1;
+}
+
+/* Fills one cell on screen with a raw VGA color */
+static void draw_cell(int x, int y, int z, int w, char vgaColor)
+{
+    int px = gridX + z * slicePitch + x * cellPx;
+    int py = gridY + w * slicePitch + y * cellPx;
+    fill_rect(px, py, cellPx - 1, cellPx - 1, vgaColor);
+}
+
+/* Shows the axes of the current rotation plane in the top-left corner */
+static void draw_plane_indicator(void)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        char color = AXIS_COLORS[HYPER_PLANE_AXES[hyperPlane][i]];
+        fill_rect(gridX + i * cellPx * 2, gridY - cellPx * 2, cellPx * 2 - 1, cellPx - 1, get_vga_color(color));
+    }
+}
+
+/**
+* @brief Tests a piece placement against the walls and the grid
+*
+* @param p Candidate piece
+* @return 1 if any cell is outside the grid or occupied
+*
+* One bit test per cell against the slice occupancy
+*/
+static int hyper_collides(const HyperPiece *p)
+{
+    for (int i = 0; i < CUBE_CELLS; i++)
+    {
+        const int8_t *c = p->cells[i];
+        for (int axis = 0; axis < HYPER_AXES; axis++)
+        {
+            if (c[axis] < 0 || c[axis] >= HYPER_N)
+            {
+                return 1;
+            }
+        }
+        if (slice_occupancy(c[AXIS_Z], c[AXIS_W]) & CELL_BIT(c[AXIS_X], c[AXIS_Y]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+* @brief Starts a random tetracube at the top of the grid
+*
+* Centers the piece in x, z and w at y = 0 and ends the game
+* if that placement is already blocked
+*/
+static void hyper_spawn(void)
+{
+    hyperPiece.type = my_rand() % CUBE_TYPES;
+    for (int i = 0; i < CUBE_CELLS; i++)
+    {
+        hyperPiece.cells[i][AXIS_X] = TETRACUBES[hyperPiece.type][i][0] + (HYPER_N - 2) / 2;
+        hyperPiece.cells[i][AXIS_Y] = TETRACUBES[hyperPiece.type][i][1];
+        hyperPiece.cells[i][AXIS_Z] = TETRACUBES[hyperPiece.type][i][2] + (HYPER_N - 2) / 2;
+        hyperPiece.cells[i][AXIS_W] = HYPER_N / 2;
+    }
+
+    if (hyper_collides(&hyperPiece))
+    {
+        end_game(END_TOPOUT, DIR_DOWN);
+    }
+}
+
+/**
+* @brief Clears the grid, lays out the slices and spawns a piece
+*
+* @param screenWidth Visible frame width in pixels
+* @param screenHeight Visible frame height in pixels
+* @param uiScale Pixels per 320x240 layout pixel
+*
+* Picks the largest cell size that fits all N x N slices, with
+* a one-cell gap between slices, and centers the grid
+*/
+void hyper_init(int screenWidth, int screenHeight, int uiScale)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        for (int w = 0; w < HYPER_N; w++)
+        {
+            for (int z = 0; z < HYPER_N; z++)
+            {
+                hyperPlanes[plane][w][z] = 0;
+            }
+        }
+    }
+    hyperPlane = 0;
+
+    // N slices of N cells plus N-1 gaps, and 3 cells for the indicator
+    int cellsAcross = HYPER_N * HYPER_N + HYPER_N - 1;
+    int fitX = screenWidth / cellsAcross;
+    int fitY = (screenHeight - 4 * uiScale) / (cellsAcross + 3);
+    cellPx = fitX < fitY ? fitX : fitY;
+    slicePitch = (HYPER_N + 1) * cellPx;
+    gridX = (screenWidth - cellsAcross * cellPx) / 2;
+    gridY = (screenHeight - cellsAcross * cellPx + 3 * cellPx) / 2;
+
+    hyper_spawn();
+}
+
+/**
+* @brief Redraws every slice, the settled cells and the indicator
+*
+* Called at game start and whenever hyperplanes were cleared
+*/
+void hyper_draw_grid(void)
+{
+    for (int w = 0; w < HYPER_N; w++)
+    {
+        for (int z = 0; z < HYPER_N; z++)
+        {
+            for (int y = 0; y < HYPER_N; y++)
+            {
+                for (int x = 0; x < HYPER_N; x++)
+                {
+                    int color = cell_color(x, y, z, w);
+                    draw_cell(x, y, z, w, color ? get_vga_color(color) : EMPTY_CELL_VGA);
+                }
+            }
+        }
+    }
+    draw_plane_indicator();
+}
+
+/**
+* @brief Draws or erases the falling tetracube
+*
+* @param erase Non-zero to paint its cells as empty
+*/
+void hyper_draw_piece(int erase)
+{
+    char vgaColor = erase ? EMPTY_CELL_VGA : get_vga_color(piece_color());
+    for (int i = 0; i < CUBE_CELLS; i++)
+    {
+        const int8_t *c = hyperPiece.cells[i];
+        draw_cell(c[AXIS_X], c[AXIS_Y], c[AXIS_Z], c[AXIS_W], vgaColor);
+    }
+}
+
+/* Moves the piece one cell along an axis if the target is free */
+static int hyper_shift(int axis, int delta)
+{
+    HyperPiece moved = hyperPiece;
+    for (int i = 0; i < CUBE_CELLS; i++)
+    {
+        moved.cells[i][axis] += delta;
+    }
+    if (hyper_collides(&moved))
+    {
+        return 0;
+    }
+    hyperPiece = moved;
+    return 1;
+}
+
+/**
+* @brief Applies movement and plane switches
+*
+* @param switchChanges Switch bits that changed since the last frame
+*
+* Each toggled movement switch moves the piece one cell along
+* x, z or w; the plane switch selects the next rotation plane
+*/
+void hyper_switch_changes(int switchChanges)
+{
+    if (switchChanges & HYPER_SWITCH_X_PLUS)
+    {
+        hyper_shift(AXIS_X, 1);
+    }
+    if (switchChanges & HYPER_SWITCH_X_MINUS)
+    {
+        hyper_shift(AXIS_X, -1);
+    }
+    if (switchChanges & HYPER_SWITCH_Z_PLUS)
+    {
+        hyper_shift(AXIS_Z, 1);
+    }
+    if (switchChanges & HYPER_SWITCH_Z_MINUS)
+    {
+        hyper_shift(AXIS_Z, -1);
+    }
+    if (switchChanges & HYPER_SWITCH_W_PLUS)
+    {
+        hyper_shift(AXIS_W, 1);
+    }
+    if (switchChanges & HYPER_SWITCH_W_MINUS)
+    {
+        hyper_shift(AXIS_W, -1);
+    }
+    if (switchChanges & HYPER_SWITCH_PLANE)
+    {
+        hyperPlane = (hyperPlane + 1) % HYPER_PLANES;
+        draw_plane_indicator();
+    }
+}
+
+/**
+* @brief Rotates the piece a quarter turn in the selected plane
+*
+*
+* Rotation function that:
+* 1. Maps (a, b) to (-b, a) around the pivot cell for the two
+*    axes of the current plane
+* 2. Tries the rotated piece in place, then shifted one cell
+*    along either plane axis, like a minimal wall kick
+* 3. Leaves the piece unchanged if every placement collides
+*/
+void hyper_rotate(void)
+{
+    static const int8_t KICKS[5][2] = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    int a = HYPER_PLANE_AXES[hyperPlane][0];
+    int b = HYPER_PLANE_AXES[hyperPlane][1];
+    const int8_t *pivot = hyperPiece.cells[1];
+    HyperPiece rotated = hyperPiece;
+
+    for (int i = 0; i < CUBE_CELLS; i++)
+    {
+        int da = hyperPiece.cells[i][a] - pivot[a];
+        int db = hyperPiece.cells[i][b] - pivot[b];
+        rotated.cells[i][a] = pivot[a] - db;
+        rotated.cells[i][b] = pivot[b] + da;
+    }
+
+    for (int k = 0; k < 5; k++)
+    {
+        HyperPiece kicked = rotated;
+        for (int i = 0; i < CUBE_CELLS; i++)
+        {
+            kicked.cells[i][a] += KICKS[k][0];
+            kicked.cells[i][b] += KICKS[k][1];
+        }
+        if (!hyper_collides(&kicked))
+        {
+            hyperPiece = kicked;
+            return;
+        }
+    }
+}
+
+/**
+* @brief Removes every full hyperplane and drops the rest
+*
+* @return Number of hyperplanes cleared
+*
+*
+* Clear function that:
+* 1. ANDs the occupancy of all N*N slices; a row of the
+*    result is all ones exactly when its hyperplane is full
+* 2. For each full y, top to bottom, every bitplane of every
+*    slice keeps the rows below y and shifts the rows above
+*    it down by one row (N bits)
+*/
+static int hyper_clear_planes(void)
+{
+    uint64_t full = ~0ull;
+    for (int w = 0; w < HYPER_N; w++)
+    {
+        for (int z = 0; z < HYPER_N; z++)
+        {
+            full &= slice_occupancy(z, w);
+        }
+    }
+
+    int cleared = 0;
+    for (int y = 0; y < HYPER_N; y++)
+    {
+        if (((full >> (y * HYPER_N)) & ROW_MASK) != ROW_MASK)
+        {
+            continue;
+        }
+
+        uint64_t above = CELL_BIT(0, y) - 1; // Rows 0 .. y-1
+        uint64_t below = (y + 1 < HYPER_N) ? ~(CELL_BIT(0, y + 1) - 1) : 0; // Rows y+1 ..
+        for (int plane = 0; plane < 3; plane++)
+        {
+            for (int w = 0; w < HYPER_N; w++)
+            {
+                for (int z = 0; z < HYPER_N; z++)
+                {
+                    uint64_t bits = hyperPlanes[plane][w][z];
+                    hyperPlanes[plane][w][z] = (bits & below) | ((bits & above) << HYPER_N);
+                }
+            }
+        }
+        cleared++;
+    }
+    return cleared;
+}
+
+/**
+* @brief Advances the piece one cell along +y
+*
+*
+* Gravity step that:
+* 1. Moves the piece down when the cells below are free
+* 2. Otherwise writes its color into the bitplanes, clears
+*    full hyperplanes, scores them like lines and spawns the
+*    next piece
+*
+* Called on every game tick in the 4D mode
+*/
+void hyper_tick(void)
+{
+    if (hyper_shift(AXIS_Y, 1))
+    {
+        return;
+    }
+
+    int color = piece_color();
+    for (int i = 0; i < CUBE_CELLS; i++)
+    {
+        const int8_t *c = hyperPiece.cells[i];
+        uint64_t bit = CELL_BIT(c[AXIS_X], c[AXIS_Y]);
+        for (int plane = 0; plane < 3; plane++)
+        {
+            if (color & (1 << plane))
+            {
+                hyperPlanes[plane][c[AXIS_W]][c[AXIS_Z]] |= bit;
+            }
+        }
+    }
+
+    int cleared = hyper_clear_planes();
+    if (cleared > 0)
+    {
+        score_lines(cleared);
+        scoreDirty = 1;
+        hyper_draw_grid();
+    }
+    else
+    {
+        hyper_draw_piece(0); // Now part of the grid
+    }
+
+    hyper_spawn();
+}
@@ -0,0 +1,25 @@
+#ifndef HYPERGRID_H
+#define HYPERGRID_H
+
+#include <stdint.h>
+
+/* Edge length of the 4D grid, select with -DHYPER_N=n (2..8) */
+#ifndef HYPER_N
+#define HYPER_N 6
+#endif
+
+#if HYPER_N < 2 || HYPER_N > 8
+#error "HYPER_N must be 2..8, one (x, y) slice is packed into 64 bits"
+#endif
+
+#define HYPER_AXES 4 // x, y (gravity), z, w
+#define HYPER_PLANES 6
+
+void hyper_init(int screenWidth, int screenHeight, int uiScale);
+void hyper_draw_grid(void);
+void hyper_draw_piece(int erase);
+void hyper_switch_changes(int switchChanges);
+void hyper_rotate(void);
+void hyper_tick(void);
+
+#endif
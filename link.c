@@ -0,0 +1,328 @@
+/**
+* @brief Versus-mode link between two game instances
+*
+*
+* Game events are exchanged as tiny framed packets:
+*
+*   0xA5 | len | len bytes of (type, arg) pairs | checksum
+*
+* The checksum is the 8-bit sum of len and payload, inverted.
+* Bytes outside a valid frame (for example print() text sharing
+* the JTAG UART) are skipped by the receiver, which resyncs on
+* the next 0xA5.
+*
+* Nothing here ever waits on the transport:
+* - link_queue_event() only updates counters
+* - link_flush() builds at most one packet per frame and hands
+*   the transport whatever it accepts right now, keeping the
+*   rest for the next frame
+* - link_poll() drains only the bytes already received
+*
+* On the board the transport is the JTAG UART (the two boards
+* are bridged through their host terminals); the host build
+* provides its own link_default_transport() over a pipe.
+*/
+
+#include "link.h"
+
+#define LINK_SYNC 0xA5
+#define LINK_MAX_PAYLOAD 16
+#define LINK_MAX_PACKET (LINK_MAX_PAYLOAD + 3)
+#define LINK_TX_SIZE 64
+
+#define RX_WAIT_SYNC 0
+#define RX_LENGTH 1
+#define RX_PAYLOAD 2
+#define RX_CHECKSUM 3
+
+static const LinkTransport *linkTransport = 0;
+static LinkInbox inbox;
+
+// Outgoing events, coalesced until the next link_flush()
+static int outHello = 0;
+static int outTopout = 0;
+static int outGarbage = 0;
+
+// Packet bytes the transport has not accepted yet
+static uint8_t txBuffer[LINK_TX_SIZE];
+static int txLength = 0;
+
+// Receive parser state
+static int rxState = RX_WAIT_SYNC;
+static int rxLength = 0;
+static int rxPos = 0;
+static uint8_t rxPayload[LINK_MAX_PAYLOAD];
+
+#ifndef HOST_BUILD
+#define JTAG_UART ((volatile unsigned int *)0x04000040)
+#define JTAG_CTRL ((volatile unsigned int *)0x04000044)
+
+/* Writes while the UART reports free FIFO space (WSPACE) */
+static int uart_send(const uint8_t *data, int len)
+{
+    int sent = 0;
+    while (sent < len && ((*JTAG_CTRL) & 0xffff0000) != 0)
+    {
+        *JTAG_UART = data[sent++];
+    }
+    return sent;
+}
+
+/* Reads while the data register has RVALID (bit 15) set */
+static int uart_recv(uint8_t *data, int max)
+{
+    int received = 0;
+    while (received < max)
+    {
+        unsigned int value = *JTAG_UART;
+        if ((value & 0x8000) == 0)
+        {
+            break;
+        }
+        data[received++] = value & 0xff;
+    }
+    return received;
+}
+
+static const LinkTransport uartTransport = {uart_send, uart_recv};
+
+const LinkTransport *link_default_transport(void)
+{
+    return &uartTransport;
+}
+#endif
+
+/**
+* @brief Selects the transport and clears all link state
+*
+* @param transport Byte transport used by link_poll/link_flush
+*/
+void link_init(const LinkTransport *transport)
+{
+    linkTransport = transport;
+    link_reset();
+}
+
+/**
+* @brief Forgets queued events and peer state, for a new round
+*
+* Bytes already handed to the transport cannot be recalled;
+* a partially sent packet is dropped and the peer resyncs.
+*/
+void link_reset(void)
+{
+    inbox.peerPresent = 0;
+    inbox.peerToppedOut = 0;
+    inbox.garbage = 0;
+    outHello = 0;
+    outTopout = 0;
+    outGarbage = 0;
+    txLength = 0;
+    rxState = RX_WAIT_SYNC;
+}
+
+/**
+* @brief Records an event for the next packet
+*
+* @param type LINK_EV_* event type
+* @param arg Event argument (garbage line count)
+*/
+void link_queue_event(int type, int arg)
+{
+    switch (type)
+    {
+    case LINK_EV_HELLO:
+        outHello = 1;
+        break;
+    case LINK_EV_GARBAGE:
+        outGarbage += arg;
+        break;
+    case LINK_EV_TOPOUT:
+        outTopout = 1;
+        break;
+    }
+}
+
+/* Applies one received (type, arg) pair to the inbox */
+static void link_apply_event(int type, int arg)
+{
+    switch (type)
+    {
+    case LINK_EV_HELLO:
+        inbox.peerPresent = 1;
+        break;
+    case LINK_EV_GARBAGE:
+        inbox.peerPresent = 1;
+        inbox.garbage += arg;
+        break;
+    case LINK_EV_TOPOUT:
+        inbox.peerPresent = 1;
+        inbox.peerToppedOut = 1;
+        break;
+    }
+}
+
+/**
+* @brief Parses every byte the transport has received so far
+*
+* Runs the frame parser over the available bytes and applies
+* the events of each packet whose checksum matches. Returns as
+* soon as the transport has nothing more, so it costs a single
+* register read per frame when the line is idle.
+*/
+void link_poll(void)
+{
+    uint8_t chunk[16];
+    int count;
+
+    if (!linkTransport)
+    {
+        return;
+    }
+
+    while ((count = linkTransport->recv(chunk, sizeof(chunk))) > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            uint8_t byte = chunk[i];
+            switch (rxState)
+            {
+            case RX_WAIT_SYNC:
+                if (byte == LINK_SYNC)
+                {
+                    rxState = RX_LENGTH;
+                }
+                break;
+            case RX_LENGTH:
+                if (byte > LINK_MAX_PAYLOAD || (byte & 1))
+                {
+                    rxState = (byte == LINK_SYNC) ? RX_LENGTH : RX_WAIT_SYNC;
+                    break;
+                }
+                rxLength = byte;
+                rxPos = 0;
+                rxState = rxLength ? RX_PAYLOAD : RX_CHECKSUM;
+                break;
+            case RX_PAYLOAD:
+                rxPayload[rxPos++] = byte;
+                if (rxPos == rxLength)
+                {
+                    rxState = RX_CHECKSUM;
+                }
+                break;
+            case RX_CHECKSUM:
+            {
+                uint8_t sum = rxLength;
+                for (int j = 0; j < rxLength; j++)
+                {
+                    sum += rxPayload[j];
+                }
+                sum = ~sum;
+                if (sum == byte)
+                {
+                    for (int j = 0; j < rxLength; j += 2)
+                    {
+                        link_apply_event(rxPayload[j], rxPayload[j + 1]);
+                    }
+                }
+                rxState = RX_WAIT_SYNC;
+                break;
+            }
+            }
+        }
+    }
+}
+
+/* Appends one (type, arg) pair if it fits in the payload */
+static int put_event(uint8_t *payload, int len, int type, int arg)
+{
+    if (len + 2 > LINK_MAX_PAYLOAD)
+    {
+        return len;
+    }
+    payload[len] = type;
+    payload[len + 1] = arg;
+    return len + 2;
+}
+
+/**
+* @brief Sends this frame's events as one packet, without blocking
+*
+*
+* Flush function that:
+* 1. Builds a packet from the coalesced events when there are
+*    any and the transmit buffer has room for it; large garbage
+*    counts are split over several 255-line events
+* 2. Offers the transmit buffer to the transport once and keeps
+*    the unaccepted tail for the next frame
+*
+* Called once at the end of every frame
+*/
+void link_flush(void)
+{
+    if (!linkTransport)
+    {
+        return;
+    }
+
+    if ((outHello || outTopout || outGarbage) && txLength + LINK_MAX_PACKET <= LINK_TX_SIZE)
+    {
+        uint8_t payload[LINK_MAX_PAYLOAD];
+        int len = 0;
+
+        if (outHello)
+        {
+            len = put_event(payload, len, LINK_EV_HELLO, 0);
+            outHello = 0;
+        }
+        while (outGarbage > 0 && len + 2 <= LINK_MAX_PAYLOAD)
+        {
+            int lines = outGarbage > 255 ? 255 : outGarbage;
+            len = put_event(payload, len, LINK_EV_GARBAGE, lines);
+            outGarbage -= lines;
+        }
+        if (outTopout && len + 2 <= LINK_MAX_PAYLOAD)
+        {
+            len = put_event(payload, len, LINK_EV_TOPOUT, 0);
+            outTopout = 0;
+        }
+
+        uint8_t sum = len;
+        txBuffer[txLength++] = LINK_SYNC;
+        txBuffer[txLength++] = len;
+        for (int i = 0; i < len; i++)
+        {
+            txBuffer[txLength++] = payload[i];
+            sum += payload[i];
+        }
+        txBuffer[txLength++] = ~sum;
+    }
+
+    if (txLength > 0)
+    {
+        int sent = linkTransport->send(txBuffer, txLength);
+        for (int i = sent; i < txLength; i++)
+        {
+            txBuffer[i - sent] = txBuffer[i];
+        }
+        txLength -= sent;
+    }
+}
+
+/**
+* @brief Returns and clears the garbage lines received so far
+*/
+int link_take_garbage(void)
+{
+    int lines = inbox.garbage;
+    inbox.garbage = 0;
+    return lines;
+}
+
+/**
+* @brief Peer state as seen by the last link_poll()
+*/
+LinkInbox *link_inbox(void)
+{
+    return &inbox;
+}
@@ -0,0 +1,36 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+
+/* Event types carried in link packets */
+#define LINK_EV_HELLO 1   // Sent once at game start, arg unused
+#define LINK_EV_GARBAGE 2 // arg = number of garbage lines for the peer
+#define LINK_EV_TOPOUT 3  // Sender lost, arg unused
+
+/* Non-blocking byte transport. Both calls return at once with the
+   number of bytes actually moved, which may be zero. */
+typedef struct
+{
+    int (*send)(const uint8_t *data, int len);
+    int (*recv)(uint8_t *data, int max);
+} LinkTransport;
+
+/* What the peer told us since the last link_take_* call */
+typedef struct
+{
+    int peerPresent;
+    int peerToppedOut;
+    int garbage;
+} LinkInbox;
+
+const LinkTransport *link_default_transport(void);
+void link_init(const LinkTransport *transport);
+void link_reset(void);
+void link_poll(void);
+void link_queue_event(int type, int arg);
+void link_flush(void);
+int link_take_garbage(void);
+LinkInbox *link_inbox(void);
+
+#endif
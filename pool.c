@@ -0,0 +1,73 @@
+/**
+* @brief   Fixed-capacity pool allocator
+*
+*
+* The game has no heap to speak of (the linker script reserves
+* 0x800 bytes), so short-lived objects such as clear particles
+* come from pools over static arrays instead. See pool.h.
+*/
+
+#include "pool.h"
+
+/* Item size rounded up so every item stays word aligned */
+static int pool_stride(int itemSize)
+{
+    int stride = (itemSize + 3) & ~3;
+    return stride < (int)sizeof(int16_t) ? (int)sizeof(int16_t) : stride;
+}
+
+/**
+* @brief Threads every item of the storage onto the free list
+*
+* @param pool Pool to set up
+* @param storage At least capacity word-aligned items (POOL_STORAGE)
+* @param itemSize Size of one item in bytes
+* @param capacity Number of items
+*/
+void pool_init(Pool *pool, void *storage, int itemSize, int capacity)
+{
+    int stride = pool_stride(itemSize);
+
+    pool->storage = storage;
+    pool->itemSize = stride;
+    pool->capacity = capacity;
+    pool->used = 0;
+    pool->freeHead = capacity > 0 ? 0 : -1;
+
+    for (int i = 0; i < capacity; i++)
+    {
+        *(int16_t *)(pool->storage + i * stride) = (i + 1 < capacity) ? i + 1 : -1;
+    }
+}
+
+/**
+* @brief Takes one item off the free list
+*
+* @return The item, or 0 when the pool is exhausted
+*/
+void *pool_alloc(Pool *pool)
+{
+    if (pool->freeHead < 0)
+    {
+        return 0;
+    }
+
+    uint8_t *item = pool->storage + pool->freeHead * pool->itemSize;
+    pool->freeHead = *(int16_t *)item;
+    pool->used++;
+    return item;
+}
+
+/**
+* @brief Returns an item to the front of the free list
+*
+* @param item Pointer previously returned by pool_alloc()
+*/
+void pool_free(Pool *pool, void *item)
+{
+    int index = ((uint8_t *)item - pool->storage) / pool->itemSize;
+
+    *(int16_t *)item = pool->freeHead;
+    pool->freeHead = index;
+    pool->used--;
+}
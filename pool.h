@@ -0,0 +1,26 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+/* Fixed-capacity allocator over caller-provided storage. Free
+   items hold the index of the next free item, so alloc and free
+   are O(1) and nothing ever comes from the heap. */
+typedef struct
+{
+    uint8_t *storage;
+    uint16_t itemSize;
+    uint16_t capacity;
+    int16_t freeHead; // -1 when exhausted
+    uint16_t used;
+} Pool;
+
+/* Storage for capacity items of type, sized and aligned for the pool */
+#define POOL_STORAGE(name, type, capacity) \
+    uint32_t name[((sizeof(type) + 3) / 4) * (capacity)]
+
+void pool_init(Pool *pool, void *storage, int itemSize, int capacity);
+void *pool_alloc(Pool *pool);
+void pool_free(Pool *pool, void *item);
+
+#endif
@@ -0,0 +1,112 @@
+/**
+* @brief   Cycle-counting section profiler
+*
+*
+* Each section accumulates the cycles between prof_begin() and
+* prof_end() and remembers its slowest single run. After every
+* PROFILE_REPORT_FRAMES frames the averages per frame and the
+* maxima are printed and the counters restart, so a report
+* describes the recent frames only.
+*
+* Cycles come from the mcycle CSR on the DTEK-V core (30 MHz)
+* and from the host stand-in clock in HOST_BUILD.
+*/
+
+#include "profile.h"
+
+#ifdef HOST_BUILD
+#include "host/dtekv-host.h"
+#endif
+
+extern void print(const char *);
+extern void print_dec(unsigned int);
+
+#ifndef PROFILE_REPORT_FRAMES
+#define PROFILE_REPORT_FRAMES 128
+#endif
+
+/**
+* @brief Current value of the cycle counter (low 32 bits)
+*/
+uint32_t read_cycles(void)
+{
+#ifdef HOST_BUILD
+    return host_cycles();
+#else
+    uint32_t cycles;
+    asm volatile("csrr %0, mcycle" : "=r"(cycles));
+    return cycles;
+#endif
+}
+
+#if defined(PROFILE) || defined(PROFILE_TRACE)
+
+static const char *const SECTION_NAMES[PROF_SECTIONS] = {
+    "frame", "input", "rules", "render", "particles"};
+
+#ifdef PROFILE
+static uint32_t sectionStart[PROF_SECTIONS];
+static uint32_t sectionTotal[PROF_SECTIONS]; // Wraps only past ~140 s per report
+static uint32_t sectionMax[PROF_SECTIONS];
+static int reportFrames = 0;
+#endif
+
+void prof_begin(int section)
+{
+    trace_begin(SECTION_NAMES[section]);
+#ifdef PROFILE
+    sectionStart[section] = read_cycles();
+#endif
+}
+
+void prof_end(int section)
+{
+#ifdef PROFILE
+    uint32_t elapsed = read_cycles() - sectionStart[section];
+
+    sectionTotal[section] += elapsed;
+    if (elapsed > sectionMax[section])
+    {
+        sectionMax[section] = elapsed;
+    }
+#endif
+    trace_end(SECTION_NAMES[section]);
+}
+
+/**
+* @brief Counts a finished frame and prints the report when due
+*
+* Report format, one line per section:
+*   prof <name> avg <cycles per frame> max <cycles>
+*
+* With PROFILE_TRACE this is also where the trace is written
+* out, between frames.
+*/
+void prof_frame_done(void)
+{
+#ifdef PROFILE_TRACE
+    trace_frame_done();
+#endif
+#ifdef PROFILE
+    if (++reportFrames < PROFILE_REPORT_FRAMES)
+    {
+        return;
+    }
+
+    for (int i = 0; i < PROF_SECTIONS; i++)
+    {
+        print("prof ");
+        print(SECTION_NAMES[i]);
+        print(" avg ");
+        print_dec(sectionTotal[i] / reportFrames);
+        print(" max ");
+        print_dec(sectionMax[i]);
+        print("\n");
+        sectionTotal[i] = 0;
+        sectionMax[i] = 0;
+    }
+    reportFrames = 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/* Profiled sections of the frame loop */
+#define PROF_FRAME 0      // Whole loop iteration, without the frame delay
+#define PROF_INPUT 1      // Button and switch handling
+#define PROF_RULES 2      // Tick movement, locks, clears and gravity
+#define PROF_RENDER 3     // Pieces, queue and hold
+#define PROF_PARTICLES 4  // Particle update and draw
+#define PROF_SECTIONS 5
+
+uint32_t read_cycles(void);
+
+/* Build with -DPROFILE to collect per-section cycle counts and
+   print a report over the UART every PROFILE_REPORT_FRAMES
+   frames; otherwise the hooks compile away. */
+#if defined(PROFILE) || defined(PROFILE_TRACE)
+void prof_begin(int section);
+void prof_end(int section);
+void prof_frame_done(void);
+#else
+#define prof_begin(section) ((void)0)
+#define prof_end(section) ((void)0)
+#define prof_frame_done() ((void)0)
+#endif
+
+/* Host builds with -DPROFILE_TRACE also stream every section
+   and the named spans below to a Chrome trace file (see
+   host/trace.c), one event per begin and end. */
+#ifdef PROFILE_TRACE
+#ifndef HOST_BUILD
+#error "PROFILE_TRACE needs HOST_BUILD"
+#endif
+void trace_begin(const char *name);
+void trace_end(const char *name);
+void trace_counter(const char *name, int value);
+void trace_frame_done(void);
+#else
+#define trace_begin(name) ((void)0)
+#define trace_end(name) ((void)0)
+#define trace_counter(name, value) ((void)0)
+#endif
+
+#endif
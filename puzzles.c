@@ -0,0 +1,75 @@
+/**
+* @brief   Puzzle mode boards
+*
+*
+* Each puzzle is a start board, a fixed piece sequence and a
+* number of lines to clear with it; see puzzles.h for the
+* encoding. The boards are const, so they stay in .rodata and
+* tetris.c decodes them straight into the board cells.
+*
+* The set below is laid out for the default 20x20 board; puzzle
+* mode only offers puzzles whose size matches BOARD_WIDTH and
+* BOARD_HEIGHT.
+*/
+
+#include "puzzles.h"
+
+/* Single: bottom row with a four-wide gap under the spawn point */
+static const uint8_t PUZZLE_0_CELLS[] = {
+    0x0F, 0xFF, 0x0F, 0x5D, 0x87, 0x03, 0x87};
+static const uint8_t PUZZLE_0_PIECES[] = {PUZZLE_PIECE(PZ_I, PZ_DOWN)};
+
+/* Box: two rows with a 2x2 gap, for the O piece */
+static const uint8_t PUZZLE_1_CELLS[] = {
+    0x0F, 0xFF, 0x0F, 0x49, 0x88, 0x01, 0x8F, 0x02, 0x01, 0x88};
+static const uint8_t PUZZLE_1_PIECES[] = {PUZZLE_PIECE(PZ_O, PZ_DOWN)};
+
+/* Wall: left wall column open in the middle; stand the I piece up */
+static const uint8_t PUZZLE_2_CELLS[] = {
+    0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03,
+    0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x53,
+    0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03,
+    0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03, 0x80, 0x0F, 0x03};
+static const uint8_t PUZZLE_2_PIECES[] = {PUZZLE_PIECE(PZ_I, PZ_LEFT)};
+
+/* Tetris: four rows with a one-wide well: a tetris */
+static const uint8_t PUZZLE_3_CELLS[] = {
+    0x0F, 0xFF, 0x0F, 0x21, 0x89, 0x00, 0x8F, 0x03, 0x00, 0x8F, 0x03, 0x00,
+    0x8F, 0x03, 0x00, 0x88};
+static const uint8_t PUZZLE_3_PIECES[] = {PUZZLE_PIECE(PZ_I, PZ_DOWN)};
+
+/* T-slot: two rows with a T-shaped gap; turn the T upside down */
+static const uint8_t PUZZLE_4_CELLS[] = {
+    0x0F, 0xFF, 0x0F, 0x49, 0x87, 0x02, 0x8F, 0x02, 0x00, 0x89};
+static const uint8_t PUZZLE_4_PIECES[] = {PUZZLE_PIECE(PZ_T, PZ_DOWN)};
+
+/* Stack: two rows sharing a four-wide gap, two I pieces */
+static const uint8_t PUZZLE_5_CELLS[] = {
+    0x0F, 0xFF, 0x0F, 0x49, 0x87, 0x03, 0x8F, 0x00, 0x03, 0x87};
+static const uint8_t PUZZLE_5_PIECES[] = {PUZZLE_PIECE(PZ_I, PZ_DOWN), PUZZLE_PIECE(PZ_I, PZ_DOWN)};
+
+/* Columns: two right wall columns open in the middle */
+static const uint8_t PUZZLE_6_CELLS[] = {
+    0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81,
+    0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81,
+    0x0F, 0x52, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81,
+    0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81, 0x0F, 0x02, 0x81};
+static const uint8_t PUZZLE_6_PIECES[] = {PUZZLE_PIECE(PZ_I, PZ_RIGHT), PUZZLE_PIECE(PZ_I, PZ_RIGHT)};
+
+/* Mirror: top and bottom rows with gaps, one I piece each way */
+static const uint8_t PUZZLE_7_CELLS[] = {
+    0x87, 0x03, 0x87, 0x0F, 0xFF, 0x0F, 0x49, 0x87, 0x03, 0x87};
+static const uint8_t PUZZLE_7_PIECES[] = {PUZZLE_PIECE(PZ_I, PZ_UP), PUZZLE_PIECE(PZ_I, PZ_DOWN)};
+
+const Puzzle PUZZLES[] = {
+    {20, 20, 1, 1, PUZZLE_0_PIECES, PUZZLE_0_CELLS},
+    {20, 20, 2, 1, PUZZLE_1_PIECES, PUZZLE_1_CELLS},
+    {20, 20, 1, 1, PUZZLE_2_PIECES, PUZZLE_2_CELLS},
+    {20, 20, 4, 1, PUZZLE_3_PIECES, PUZZLE_3_CELLS},
+    {20, 20, 2, 1, PUZZLE_4_PIECES, PUZZLE_4_CELLS},
+    {20, 20, 2, 2, PUZZLE_5_PIECES, PUZZLE_5_CELLS},
+    {20, 20, 2, 2, PUZZLE_6_PIECES, PUZZLE_6_CELLS},
+    {20, 20, 2, 2, PUZZLE_7_PIECES, PUZZLE_7_CELLS},
+};
+
+const int PUZZLE_COUNT = sizeof(PUZZLES) / sizeof(PUZZLES[0]);
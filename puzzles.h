@@ -0,0 +1,48 @@
+#ifndef PUZZLES_H
+#define PUZZLES_H
+
+#include <stdint.h>
+
+/*
+* Puzzle boards are run-length encoded, one byte per run:
+*   high nibble: color index of the run (BLACK..GARBAGE)
+*   low nibble:  run length - 1 for runs of 1-15 cells;
+*                0xF means 16 + the next byte (16-271 cells)
+* Runs cover the board row by row and may continue into the
+* next row, so a width x height puzzle decodes as one fill per
+* run over the contiguous board cells.
+*
+* Piece sequences are one byte per piece, tetromino index in
+* the low 3 bits and movement direction above.
+*/
+#define PUZZLE_PIECE(type, direction) ((type) | ((direction) << 3))
+#define PUZZLE_PIECE_TYPE(entry) ((entry) & 0x7)
+#define PUZZLE_PIECE_DIRECTION(entry) ((entry) >> 3)
+
+/* Tetromino indices and directions, as TETROMINOS and DIR_* in tetris.c */
+#define PZ_I 0
+#define PZ_J 1
+#define PZ_L 2
+#define PZ_O 3
+#define PZ_S 4
+#define PZ_T 5
+#define PZ_Z 6
+#define PZ_DOWN 0
+#define PZ_UP 1
+#define PZ_LEFT 2
+#define PZ_RIGHT 3
+
+typedef struct
+{
+    uint8_t width;         // Board size the puzzle was laid out for
+    uint8_t height;
+    uint8_t goalLines;     // Lines to clear with the given pieces
+    uint8_t pieceCount;
+    const uint8_t *pieces; // PUZZLE_PIECE entries, spawned in order
+    const uint8_t *cells;  // Run-length encoded board
+} Puzzle;
+
+extern const Puzzle PUZZLES[];
+extern const int PUZZLE_COUNT;
+
+#endif
@@ -15,9 +15,9 @@
 * - Hardware-specific optimizations for DE10-Lite
 *
 * Technical Specifications:
-* - Display: VGA 320x240 pixels
-* - Game board: 20x20 grid
-* - Block size: 8x8 pixels
+* - Display: VGA 320x240 pixels (640x480 with VIDEO_MODE=1)
+* - Game board: 20x20 grid (default, see BOARD_CONFIG)
+* - Block size: 8x8 pixels (default, see BOARD_CONFIG)
 * - Controls: Hardware switches and buttons
 * - Memory-mapped I/O for hardware interface
 * 
@@ -28,6 +28,11 @@
 */
 
 #include <stdint.h>
+#include "link.h"
+#include "hypergrid.h"
+#include "puzzles.h"
+#include "pool.h"
+#include "profile.h"
 
 /* External functions */
 extern void print(const char *);
@@ -39,6 +44,12 @@ extern void delay(int);
 extern int nextprime(int);
 
 /* Hardware interface definitions */
+#ifdef HOST_BUILD
+#include "host/dtekv-host.h" // Desktop stand-ins for the registers below
+#ifdef RENDER_THREAD
+#include "host/render-thread.h" // Frames composed on a second thread
+#endif
+#else
 #define VGA_PIXELS ((volatile char *)0x08000000)
 #define VGA_CTRL ((volatile uint32_t *)0x04000100)
 #define SWITCH_ADDRESS ((volatile int *)0x04000010)
@@ -47,18 +58,111 @@ extern int nextprime(int);
 #define TIMER_CONTROL ((volatile int *)0x04000024)
 #define TIMER_PERIODL ((volatile int *)0x04000028)
 #define TIMER_PERIODH ((volatile int *)0x0400002C)
+#define SESSION_LOCAL // Game state is plain globals on the board
+#endif
+
+/*
+* Output resolution, select with -DVIDEO_MODE=n:
+*   0: 320x240 (original)
+*   1: 640x480, every block, glyph and margin scaled by 2
+* SCREEN_STRIDE is the distance in bytes between framebuffer
+* rows and may be overridden for padded pixel buffers.
+*/
+#ifndef VIDEO_MODE
+#define VIDEO_MODE 0
+#endif
+#if VIDEO_MODE == 0
+#define SCREEN_WIDTH 320
+#define SCREEN_HEIGHT 240
+#define UI_SCALE 1
+#elif VIDEO_MODE == 1
+#define SCREEN_WIDTH 640
+#define SCREEN_HEIGHT 480
+#define UI_SCALE 2
+#else
+#error "Unknown VIDEO_MODE"
+#endif
+#ifndef SCREEN_STRIDE
+#define SCREEN_STRIDE SCREEN_WIDTH
+#endif
+
+#define UI_PX(n) ((n) * UI_SCALE)           // Layout distance in 320x240 pixels, scaled
+#define GLYPH_SCALE UI_SCALE                // Screen pixels per glyph bitmap pixel
+#define BEVEL UI_PX(2)                      // Light/dark block edge thickness
+#define VGA_ROW(y) (VGA_PIXELS + (y) * SCREEN_STRIDE)
+
+/* Compositor tiles, see compose_tile() */
+#define TILE_PX 8
+#define TILES_X (SCREEN_WIDTH / TILE_PX)
+#define TILES_Y (SCREEN_HEIGHT / TILE_PX)
+#define TILE_ROW_WORDS ((TILES_X + 31) / 32) // Dirty bits per tile row
+
+/* Compositor layers, bottom to top */
+#define LAYER_BACKGROUND 0
+#define LAYER_BORDER 1
+#define LAYER_BOARD 2
+#define LAYER_PIECES 3
+#define LAYER_HUD 4     // Score bar, queue and hold
+#define LAYER_EFFECTS 5 // Line-clear particles
+#define LAYERS 6
+
+// Pixel (x, y) of the current render target, in screen coordinates
+#define TARGET_PIXEL(x, y) (targetPixels + ((y) - targetY) * targetStride + ((x) - targetX))
 
 #define LARGE_CHAR_WIDTH 12
 #define LARGE_CHAR_HEIGHT 12
-#define GAME_OVER_X ((SCREEN_WIDTH - (9 * LARGE_CHAR_WIDTH)) / 2)
-#define GAME_OVER_Y ((SCREEN_HEIGHT - LARGE_CHAR_HEIGHT) / 2)
+#define LARGE_CHAR_PX (LARGE_CHAR_WIDTH * GLYPH_SCALE)
+#define GAME_OVER_X ((SCREEN_WIDTH - (9 * LARGE_CHAR_PX)) / 2)
+#define GAME_OVER_Y ((SCREEN_HEIGHT - LARGE_CHAR_PX) / 2)
+
+/*
+* Board geometry is fixed at build time. Pick a preset with
+* -DBOARD_CONFIG=n, or define BOARD_WIDTH, BOARD_HEIGHT and
+* BLOCK_SIZE directly. Every loop bound below is a constant,
+* so each configuration gets its own fully specialized code.
+*   0: 20x20 blocks at 8 px (original layout)
+*   1: 30x28 blocks at 6 px
+*   2: 38x28 blocks at 8 px (fills the frame, no side panels)
+* Preset block sizes are multiplied by UI_SCALE.
+*/
+#ifndef BOARD_WIDTH
+#ifndef BOARD_CONFIG
+#define BOARD_CONFIG 0
+#endif
+#if BOARD_CONFIG == 0
+#define BLOCK_SIZE UI_PX(8)
+#define BOARD_WIDTH 20
+#define BOARD_HEIGHT 20
+#elif BOARD_CONFIG == 1
+#define BLOCK_SIZE UI_PX(6)
+#define BOARD_WIDTH 30
+#define BOARD_HEIGHT 28
+#elif BOARD_CONFIG == 2
+#define BLOCK_SIZE UI_PX(8)
+#define BOARD_WIDTH 38
+#define BOARD_HEIGHT 28
+#else
+#error "Unknown BOARD_CONFIG"
+#endif
+#endif
+
+// Gravity pulls away from this cell toward the edges; pieces spawn around it
+#ifndef GRAVITY_CENTER_X
+#define GRAVITY_CENTER_X (BOARD_WIDTH / 2)
+#endif
+#ifndef GRAVITY_CENTER_Y
+#define GRAVITY_CENTER_Y (BOARD_HEIGHT / 2)
+#endif
+#define SPAWN_X (GRAVITY_CENTER_X - 2)
+#define SPAWN_Y (GRAVITY_CENTER_Y - 2)
+
+#if (BOARD_WIDTH + 2) * BLOCK_SIZE > SCREEN_WIDTH || (BOARD_HEIGHT + 2) * BLOCK_SIZE > SCREEN_HEIGHT
+#error "Board plus border does not fit on the screen"
+#endif
+#if BLOCK_SIZE < 2 * BEVEL + 1
+#error "BLOCK_SIZE must leave room for the bevel on each side"
+#endif
 
-/* Screen and game dimensions */
-#define SCREEN_WIDTH 320
-#define SCREEN_HEIGHT 240
-#define BLOCK_SIZE 8                                                    
-#define BOARD_WIDTH 20                                                
-#define BOARD_HEIGHT 20                                                 
 #define BOARD_START_X ((SCREEN_WIDTH - BOARD_WIDTH * BLOCK_SIZE) / 2)   // Center horizontally
 #define BOARD_START_Y ((SCREEN_HEIGHT - BOARD_HEIGHT * BLOCK_SIZE) / 2) // Center vertically
 
@@ -71,6 +175,7 @@ extern int nextprime(int);
 #define GREEN 5     // S piece
 #define PURPLE 6    // T piece
 #define RED 7       // Z piece
+#define GARBAGE 8   // Versus garbage
 #define WHITE 0xBBB // Border
 
 /* Game scoring */
@@ -90,6 +195,60 @@ extern int nextprime(int);
 #define SWITCH_RIGHT 0x1
 #define SWITCH_DOWN 0x4 // Using switch 3
 #define SWITCH_UP 0x8   // Using switch 4
+#define SWITCH_HOLD 0x10 // Using switch 5
+#define SWITCH_SNAPSHOT 0x20 // Switch 6: quick save, or resume with the button held
+#define SWITCH_MODE_PUZZLE 0x40 // Switch 7, sampled at game start
+#define SWITCH_MODE_HYPER 0x80 // Switch 8, sampled at game start
+#define SWITCH_PUZZLE_SELECT 0x3F // Switches 1-6 at game start pick the puzzle
+#define SWITCH_MODE_VERSUS 0x100 // Switch 9, sampled at game start
+#define SWITCH_MODE_QUAD 0x200 // Switch 10, sampled at game start
+
+/* Game modes */
+#define MODE_CLASSIC 0  // One piece at a time
+#define MODE_QUAD 1     // One concurrent piece per movement direction
+#define MODE_VERSUS 2   // Classic rules, garbage exchanged over the link
+#define MODE_HYPER 3    // Tetracubes in the 4D grid of hypergrid.c
+#define MODE_PUZZLE 4   // Preset board and piece sequence from puzzles.c
+
+/* check_collision() results */
+#define COLLIDE_NONE 0
+#define COLLIDE_BOARD 1 // Wall or locked cell
+#define COLLIDE_PIECE 2 // Another in-flight piece
+
+#define MAX_ACTIVE_PIECES 4
+
+/* Packed game snapshots, see snapshot_save() */
+#define SNAPSHOT_MAGIC 0xA7
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_BYTES 20
+#define SNAPSHOT_CELL_BYTES ((BOARD_WIDTH * BOARD_HEIGHT + 7) / 8)
+#define SNAPSHOT_MAX_BYTES (SNAPSHOT_HEADER_BYTES + 3 * MAX_ACTIVE_PIECES + 6 + 5 + 3 + \
+                            SNAPSHOT_CELL_BYTES + (BOARD_WIDTH * BOARD_HEIGHT + 1) / 2)
+#define SNAPSHOT_SLOTS 2
+
+/* Line-clear particles */
+#define PARTICLE_CAPACITY 64 // Pool size; a clear beyond this bursts thinner
+#define PARTICLE_LIFE 16     // Frames a particle stays on screen
+#define PARTICLE_PX UI_PX(2) // Side of the square particle
+#define PARTICLE_SPEED 96    // Outward speed per cell from the gravity center (8.8 pixels/frame)
+#define PARTICLE_JITTER (128 * UI_SCALE) // Random speed added per axis (8.8 pixels/frame)
+
+/* Frame budget for deferrable drawing, see draw_deferred() */
+#ifndef FRAME_BUDGET_CYCLES
+#define FRAME_BUDGET_CYCLES 120000 // 4 ms of the 30 MHz core, counted from the frame start
+#endif
+
+/* Why a game ended, counted in gameEnds[] */
+#define END_TOPOUT 0     // Spawn (or hold swap) blocked by locked cells
+#define END_GARBAGE 1    // Received garbage pushed cells off the board
+#define END_NO_PIECES 2  // Puzzle sequence used up
+#define END_WON 3        // Puzzle solved or versus peer topped out
+#define END_CAUSES 4
+
+/* Game-over heatmap layout, in the space above the GAME OVER text */
+#define HEAT_Y UI_PX(8)
+#define HEAT_HEIGHT (GAME_OVER_Y - UI_PX(8) - HEAT_Y)
+#define HEAT_CELL_MAX UI_PX(4)
 
 /* Tetromino definitions */
 const uint16_t TETROMINOS[7][4] = {
@@ -102,13 +261,70 @@ const uint16_t TETROMINOS[7][4] = {
     {0xC600, 0x2640, 0xC600, 0x2640}  // Z
 };
 
+/* Wall kick classes and offsets */
+#define KICK_CLASS_JLSTZ 0
+#define KICK_CLASS_I 1
+#define KICK_CLASS_O 2
+#define KICK_TESTS 5
+
+const int PIECE_KICK_CLASS[7] = {
+    KICK_CLASS_I, KICK_CLASS_JLSTZ, KICK_CLASS_JLSTZ, KICK_CLASS_O,
+    KICK_CLASS_JLSTZ, KICK_CLASS_JLSTZ, KICK_CLASS_JLSTZ};
+
+const int KICK_TEST_COUNT[3] = {KICK_TESTS, KICK_TESTS, 1};
+
+// Clockwise kick offsets {dx, dy} per transition 0->1, 1->2, 2->3, 3->0,
+// in screen coordinates (y grows downward) for a piece moving DIR_DOWN.
+// The other directions use the same table rotated (see init_kick_tables).
+const int8_t BASE_KICKS[3][4][KICK_TESTS][2] = {
+    {// J, L, S, T, Z
+     {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}},
+     {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}},
+     {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}},
+     {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+    {// I
+     {{0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2}},
+     {{0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1}},
+     {{0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2}},
+     {{0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1}}},
+    {// O never needs to move
+     {{0, 0}},
+     {{0, 0}},
+     {{0, 0}},
+     {{0, 0}}}};
+
+// MODE_QUAD spawn offsets from SPAWN_X/Y, pushing each piece toward its direction
+const int QUAD_SPAWN_DX[4] = {0, 0, -2, 2};
+const int QUAD_SPAWN_DY[4] = {2, -2, 0, 0};
+
 #define DIGIT_WIDTH 5
 #define DIGIT_HEIGHT 7
-#define SCORE_Y 2
+#define DIGIT_ADVANCE ((DIGIT_WIDTH + 1) * GLYPH_SCALE) // Glyph plus 1-pixel spacing
+#define SCORE_Y UI_PX(2)
 #define SCORE_X 5
 
-// 5x7 digit patterns (0-9 and ':')
-const unsigned long DIGIT_PATTERNS[11] = {
+/* Next-piece preview queue, drawn in the right-hand margin */
+#define NEXT_QUEUE_SIZE 5
+#define PREVIEW_CELL UI_PX(4)                                 // Pixels per mini block
+#define PREVIEW_BOX (4 * PREVIEW_CELL)                        // 4x4 mini grid
+#define PREVIEW_SLOT_HEIGHT (PREVIEW_BOX + UI_PX(6))
+#define ARROW_SIZE 5
+#define ARROW_PX (ARROW_SIZE * GLYPH_SCALE)
+#define MARKER_PX UI_PX(3)                                    // "Next" marker bar and arrow gap
+#define PREVIEW_WIDTH (PREVIEW_BOX + MARKER_PX + ARROW_PX)    // Tile, gap and arrow
+#define QUEUE_X (BOARD_START_X + (BOARD_WIDTH + 1) * BLOCK_SIZE + UI_PX(8)) // Right of the border
+#define QUEUE_Y BOARD_START_Y
+#define HOLD_X (BOARD_START_X - BLOCK_SIZE - UI_PX(8) - PREVIEW_WIDTH) // Left of the border
+#define HOLD_Y BOARD_START_Y
+
+// HUD elements are only drawn when the board leaves room for them
+#define HAS_SIDE_PANELS (HOLD_X >= 0 && \
+                         QUEUE_X + UI_PX(5) + PREVIEW_WIDTH <= SCREEN_WIDTH && \
+                         QUEUE_Y + NEXT_QUEUE_SIZE * PREVIEW_SLOT_HEIGHT <= SCREEN_HEIGHT)
+#define HAS_SCORE_BAR (BOARD_START_Y - BLOCK_SIZE >= SCORE_Y + (DIGIT_HEIGHT + 2) * GLYPH_SCALE)
+
+// 5x7 digit patterns (0-9 and ':'), 35 bits each so they need 64-bit storage on rv32
+const uint64_t DIGIT_PATTERNS[11] = {
     0b01110100011000110001100011000101110, // 0
     0b00100011000010000100001000010001110, // 1
     0b01110100010000100110010001000111111, // 2
@@ -123,7 +339,7 @@ const unsigned long DIGIT_PATTERNS[11] = {
 };
 
 // Letter patterns for "SCORE" - fixed 5x7 pixel patterns
-const uint32_t LETTER_PATTERNS[5] = {
+const uint64_t LETTER_PATTERNS[5] = {
     0b01110100011000001110000011000101110, // S
     0b01110100001000010000100001000101110, // C
     0b01110100011000110001100011000101110, // O
@@ -131,6 +347,14 @@ const uint32_t LETTER_PATTERNS[5] = {
     0b11111100001111010000100001000011111  // E
 };
 
+// 5x5 direction arrows, indexed by DIR_DOWN/UP/LEFT/RIGHT
+const uint32_t ARROW_PATTERNS[4] = {
+    0b0010000100101010111000100, // Down
+    0b0010001110101010010000100, // Up
+    0b0010001000111110100000100, // Left
+    0b0010000010111110001000100  // Right
+};
+
 /* Game structures */
 typedef struct
 {
@@ -140,22 +364,203 @@ typedef struct
     int direction;
 } Piece;
 
+// One bit per board column; wide boards need a 64-bit row
+#if BOARD_WIDTH <= 32
+typedef uint32_t BoardRow;
+#else
+typedef uint64_t BoardRow;
+#endif
+
+#define BOARD_FULL_ROW ((BoardRow)~(BoardRow)0 >> (sizeof(BoardRow) * 8 - BOARD_WIDTH))
+#define BOARD_ROW_WORDS ((BOARD_WIDTH + 7) / 8) // Eight 4-bit colors per word
+#define BOARD_ROW_BYTES (BOARD_ROW_WORDS * 4)
+
+/* Locked cells, only accessed through cell_get()/cell_set() and
+   the row masks. The occupancy rows are what collision, line
+   and gravity tests read; colors are only needed to draw. Each
+   color row is whole words, so gravity can move nibbles in the
+   same word-wide steps as the occupancy bits. */
 typedef struct
 {
-    char cells[BOARD_HEIGHT][BOARD_WIDTH];
+    BoardRow occupied[BOARD_HEIGHT];                // Bit x set when cell (x, y) is not BLACK
+    uint32_t colors[BOARD_HEIGHT][BOARD_ROW_WORDS]; // Cell x in bits 4*(x%8) of word x/8; nibbles past
+                                                    // BOARD_WIDTH are unused
 } Board;
 
-/* Global variables */
-Board board;
-Piece currentPiece;
-int gameOver = 0;
-int timeoutcount = 0;
-int lastButtonState = 0;
-int lastSwitchState = 0;
-int score = 0;
-static unsigned int randState = 1;
+typedef struct
+{
+    int type;
+    int direction;
+} QueueEntry;
+
+typedef struct Particle
+{
+    struct Particle *next; // Live list
+    int32_t x, y;          // Top-left corner in 8.8 fixed-point screen pixels
+    int16_t vx, vy;        // 8.8 fixed-point pixels per frame
+    uint8_t life;          // Frames left
+    char vgaColor;
+} Particle;
+
+/* Global variables. SESSION_LOCAL ones make up the state of one
+   game; the session server (host/session-server.c) gives every
+   worker thread its own copy. */
+SESSION_LOCAL Board board;
+SESSION_LOCAL int gameMode = MODE_CLASSIC;
+SESSION_LOCAL Piece activePieces[MAX_ACTIVE_PIECES]; // MODE_QUAD: slot index == direction
+SESSION_LOCAL int activeSlots = 0;                   // One bit per slot with a piece in flight
+SESSION_LOCAL int pendingSpawns = 0;                 // Slots holding a piece that could not enter yet
+SESSION_LOCAL int focusedPiece = 0;                  // Slot steered by the button (and hold)
+SESSION_LOCAL BoardRow inflightMask[BOARD_HEIGHT];   // Union of all in-flight piece cells
+SESSION_LOCAL int gameOver = 0;
+SESSION_LOCAL int timeoutcount = 0;
+SESSION_LOCAL int lastButtonState = 0;
+SESSION_LOCAL int lastSwitchState = 0;
+SESSION_LOCAL int score = 0;
+static SESSION_LOCAL unsigned int randState = 1;
 int startSpeed = 899999;
-int speed = 0;
+SESSION_LOCAL int speed = 0;
+
+/* Versus mode state */
+SESSION_LOCAL int pendingGarbage = 0;                 // Received lines, inserted at the next lock
+SESSION_LOCAL int roundWon = 0;                       // Versus peer topped out, or puzzle solved
+
+/* Puzzle mode state */
+SESSION_LOCAL const Puzzle *puzzle = 0;
+SESSION_LOCAL int puzzleNext = 0;                     // Next index into puzzle->pieces
+SESSION_LOCAL int puzzleLinesLeft = 0;
+
+/* Quick-save slots, kept across restarts */
+SESSION_LOCAL uint8_t saveSlots[SNAPSHOT_SLOTS][SNAPSHOT_MAX_BYTES];
+SESSION_LOCAL int saveSlotLength[SNAPSHOT_SLOTS];
+SESSION_LOCAL int saveSlotNext = 0;
+SESSION_LOCAL int saveSlotLatest = -1;                // -1 until the first save
+
+/* Line-clear particles, allocated from a static pool */
+SESSION_LOCAL POOL_STORAGE(particleStorage, Particle, PARTICLE_CAPACITY);
+SESSION_LOCAL Pool particlePool;
+SESSION_LOCAL Particle *liveParticles = 0;
+static SESSION_LOCAL unsigned int particleRand = 1;   // Cosmetic only, keeps my_rand() sequences intact
+
+/* Lock and clear telemetry, cumulative across restarts; saturating counters */
+SESSION_LOCAL uint16_t lockHeat[BOARD_HEIGHT][BOARD_WIDTH]; // Blocks locked into each cell
+SESSION_LOCAL uint16_t directionLocks[4];             // Pieces locked per movement direction
+SESSION_LOCAL uint16_t rowClears[BOARD_HEIGHT];
+SESSION_LOCAL uint16_t colClears[BOARD_WIDTH];
+SESSION_LOCAL uint16_t topouts[4];                    // END_TOPOUT games per direction of the blocked piece
+SESSION_LOCAL uint16_t gameEnds[END_CAUSES];
+
+/* 7-bag randomizer and preview queue state */
+SESSION_LOCAL int bag[7];
+SESSION_LOCAL int bagCount = 0;                       // Pieces left in the current bag
+SESSION_LOCAL QueueEntry nextQueue[NEXT_QUEUE_SIZE];  // Ring buffer, nextQueue[queueHead] spawns next
+SESSION_LOCAL int queueHead = 0;
+SESSION_LOCAL int queueDirty = 0;                     // One bit per preview slot awaiting repaint
+SESSION_LOCAL int queueMarkerSlot = -1;               // Slot currently carrying the "next" marker
+
+/* Hold slot state */
+SESSION_LOCAL int heldType = -1;                      // -1 while the hold slot is empty
+SESSION_LOCAL int heldDirection = DIR_DOWN;
+SESSION_LOCAL int holdUsed = 0;                       // Set once the hold has been used for this spawn
+SESSION_LOCAL int holdDirty = 0;                      // Hold preview awaits repaint
+
+/* Deferred drawing, flushed by draw_deferred() within the frame budget */
+SESSION_LOCAL BoardRow boardDirty[BOARD_HEIGHT];      // Cells changed since they were last drawn
+SESSION_LOCAL int scoreDirty = 0;                     // Score bar awaits repaint
+SESSION_LOCAL uint32_t tileDirty[TILES_Y][TILE_ROW_WORDS]; // Tiles awaiting composition
+SESSION_LOCAL uint32_t pieceTiles[TILES_Y][TILE_ROW_WORDS]; // Tiles under the pieces, composed first
+
+/* Render target of the drawing primitives: the framebuffer, or
+   the tile buffer while compose_tile() runs. Drawing is clipped
+   to the clip rectangle (right and bottom exclusive). */
+SESSION_LOCAL volatile char *targetPixels = VGA_PIXELS;
+SESSION_LOCAL int targetX = 0;                        // Screen position of targetPixels[0]
+SESSION_LOCAL int targetY = 0;
+SESSION_LOCAL int targetStride = SCREEN_STRIDE;
+SESSION_LOCAL int clipLeft = 0;
+SESSION_LOCAL int clipTop = 0;
+SESSION_LOCAL int clipRight = SCREEN_WIDTH;
+SESSION_LOCAL int clipBottom = SCREEN_HEIGHT;
+SESSION_LOCAL uint32_t tileBuffer[TILE_PX * TILE_PX / 4]; // Word aligned for copy_span()
+SESSION_LOCAL int heatmapRow = -1;                    // Next game-over heatmap row, -1 when idle
+SESSION_LOCAL uint32_t frameStart = 0;                // read_cycles() at the top of the frame
+
+// Pre-rendered mini piece tiles (VGA colors), one per tetromino type
+char previewTiles[7][PREVIEW_BOX * PREVIEW_BOX];
+
+// Kick offsets rotated into each movement direction: [direction][class][from][test]
+int8_t kickTable[4][3][4][KICK_TESTS][2];
+
+// Occupied extent of every shape mask inside its 4x4 grid
+typedef struct
+{
+    int8_t minX, maxX, minY, maxY;
+} ShapeBounds;
+
+ShapeBounds shapeBounds[7][4];
+
+// Shape rows as board-order bit masks (bit 0 = leftmost occupied column)
+uint8_t shapeRowBits[7][4][4];
+
+/**
+* @brief Color of a locked cell
+*
+* @param x Board grid X-coordinate
+* @param y Board grid Y-coordinate
+* @return Game color index, BLACK when empty
+*/
+static inline char cell_get(int x, int y)
+{
+    return (board.colors[y][x >> 3] >> ((x & 7) * 4)) & 0xF;
+}
+
+/**
+* @brief Whether a cell holds a locked block (one bit test)
+*/
+static inline int cell_occupied(int x, int y)
+{
+    return (board.occupied[y] >> x) & 1;
+}
+
+/**
+* @brief Stores a cell color and keeps its occupancy bit in step
+*
+* @param x Board grid X-coordinate
+* @param y Board grid Y-coordinate
+* @param color Game color index (0-15), BLACK to empty the cell
+*
+* Also flags the cell in boardDirty, so draw_deferred() repaints
+* it; callers never redraw the board themselves.
+*/
+static inline void cell_set(int x, int y, char color)
+{
+    int shift = (x & 7) * 4;
+    uint32_t *word = &board.colors[y][x >> 3];
+
+    *word = (*word & ~(0xFu << shift)) | (uint32_t)(color & 0xF) << shift;
+    boardDirty[y] |= (BoardRow)1 << x;
+    if (color != BLACK)
+    {
+        board.occupied[y] |= (BoardRow)1 << x;
+    }
+    else
+    {
+        board.occupied[y] &= ~((BoardRow)1 << x);
+    }
+}
+
+/**
+* @brief Empties a whole board row
+*/
+static inline void clear_row(int y)
+{
+    for (int i = 0; i < BOARD_ROW_WORDS; i++)
+    {
+        board.colors[y][i] = 0;
+    }
+    board.occupied[y] = 0;
+    boardDirty[y] = BOARD_FULL_ROW;
+}
 
 /**
 * @brief Generates a pseudo-random number using linear congruential generator
@@ -235,6 +640,8 @@ char get_vga_color(char piece_color)
         return 0x43; // Purple
     case RED:
         return 0xE0; // Red
+    case GARBAGE:
+        return 0x49; // Dark gray
     case WHITE:
         return 0xFF; // White
     default:
@@ -242,6 +649,118 @@ char get_vga_color(char piece_color)
     }
 }
 
+/**
+* @brief Fills a run of framebuffer pixels with one color
+* 
+* @param dst First pixel of the run
+* @param len Number of pixels
+* @param vgaColor 8-bit VGA color code (already converted)
+* 
+* Span blitter that writes single bytes up to the next word
+* boundary, then four pixels per 32-bit store, then the tail.
+* All bulk drawing goes through this so that the 640x480 mode
+* issues a quarter of the bus writes of a per-pixel loop.
+*/
+void fill_span(volatile char *dst, int len, char vgaColor)
+{
+    while (len > 0 && ((uintptr_t)dst & 3))
+    {
+        *dst++ = vgaColor;
+        len--;
+    }
+
+    uint32_t word = (uint8_t)vgaColor * 0x01010101u;
+    volatile uint32_t *wordDst = (volatile uint32_t *)dst;
+    for (; len >= 4; len -= 4)
+    {
+        *wordDst++ = word;
+    }
+
+    dst = (volatile char *)wordDst;
+    while (len-- > 0)
+    {
+        *dst++ = vgaColor;
+    }
+}
+
+/**
+* @brief Copies a run of pixels from RAM to the framebuffer
+* 
+* @param dst First framebuffer pixel
+* @param src Source pixels (VGA colors)
+* @param len Number of pixels
+* 
+* Tile blitter counterpart of fill_span(): uses word copies
+* when source and destination share the same alignment.
+*/
+void copy_span(volatile char *dst, const char *src, int len)
+{
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 3) == 0)
+    {
+        while (len > 0 && ((uintptr_t)dst & 3))
+        {
+            *dst++ = *src++;
+            len--;
+        }
+        volatile uint32_t *wordDst = (volatile uint32_t *)dst;
+        const uint32_t *wordSrc = (const uint32_t *)src;
+        for (; len >= 4; len -= 4)
+        {
+            *wordDst++ = *wordSrc++;
+        }
+        dst = (volatile char *)wordDst;
+        src = (const char *)wordSrc;
+    }
+    while (len-- > 0)
+    {
+        *dst++ = *src++;
+    }
+}
+
+/**
+* @brief Fills a screen-space rectangle with a raw VGA color
+* 
+* @param x Left pixel column
+* @param y Top pixel row
+* @param w Width in pixels
+* @param h Height in pixels
+* @param vgaColor 8-bit VGA color code (already converted)
+* 
+* Clips against the clip rectangle of the render target (the
+* whole screen outside the compositor), so callers in the side
+* margins do not have to repeat the bounds checks.
+*/
+void fill_rect(int x, int y, int w, int h, char vgaColor)
+{
+    if (x < clipLeft)
+    {
+        w -= clipLeft - x;
+        x = clipLeft;
+    }
+    if (y < clipTop)
+    {
+        h -= clipTop - y;
+        y = clipTop;
+    }
+    if (x + w > clipRight)
+    {
+        w = clipRight - x;
+    }
+    if (y + h > clipBottom)
+    {
+        h = clipBottom - y;
+    }
+    if (w <= 0)
+    {
+        return;
+    }
+
+    for (int py = y; py < y + h; py++)
+    {
+        fill_span(TARGET_PIXEL(x, py), w, vgaColor);
+    }
+}
+
 /**
 * @brief Renders a single game block with 3D lighting effects
 * 
@@ -266,15 +785,18 @@ char get_vga_color(char piece_color)
 * 
 * 3. 3D effect rendering:
 *    - Main block body in primary color
-*    - Top/left edges in lighter shade (2 pixels)
-*    - Bottom/right edges in darker shade (2 pixels)
+*    - Top/left edges in lighter shade (BEVEL pixels)
+*    - Bottom/right edges in darker shade (BEVEL pixels)
 *    - Creates raised appearance for pieces
 *    - Creates recessed appearance for background
 * 
-* 4. Safety features:
-*    - Screen boundary checking
-*    - Prevents buffer overflow
-*    - Handles off-screen blocks
+* 4. Rectangle rendering:
+*    - Five fill_rect() calls (light top and left, body,
+*      dark right and bottom) instead of per-pixel tests
+*    - Clipped to the render target like every primitive,
+*      so a compositor tile can take just its part of a block
+*    - Blocks entirely outside the clip rectangle cost one
+*      test
 * 
 * Used for:
 * - Drawing tetris pieces
@@ -289,6 +811,12 @@ void draw_block(int x, int y, char color)
     int screenX = BOARD_START_X + x * BLOCK_SIZE;
     int screenY = BOARD_START_Y + y * BLOCK_SIZE;
 
+    if (screenX >= clipRight || screenX + BLOCK_SIZE <= clipLeft ||
+        screenY >= clipBottom || screenY + BLOCK_SIZE <= clipTop)
+    {
+        return;
+    }
+
     // Get VGA-compatible color
     char vgaColor = get_vga_color(color);
 
@@ -296,34 +824,60 @@ void draw_block(int x, int y, char color)
     char lightEdge = (color == BLACK) ? 0xB6 : get_vga_color(WHITE); // Lighter gray for background
     char darkEdge = (color == BLACK) ? 0x6D : 0x00;                  // Darker gray for background
 
-    // Draw block pixel by pixel
-    for (int dy = 0; dy < BLOCK_SIZE; dy++)
+    // Top and left edges light, right and bottom edges dark (the dark
+    // edges win the corners they share with the light ones)
+    fill_rect(screenX, screenY, BLOCK_SIZE - BEVEL, BEVEL, lightEdge);
+    fill_rect(screenX, screenY + BEVEL, BEVEL, BLOCK_SIZE - 2 * BEVEL, lightEdge);
+    fill_rect(screenX + BEVEL, screenY + BEVEL, BLOCK_SIZE - 2 * BEVEL, BLOCK_SIZE - 2 * BEVEL, vgaColor);
+    fill_rect(screenX + BLOCK_SIZE - BEVEL, screenY, BEVEL, BLOCK_SIZE - BEVEL, darkEdge);
+    fill_rect(screenX, screenY + BLOCK_SIZE - BEVEL, BLOCK_SIZE, BEVEL, darkEdge);
+}
+
+/**
+* @brief Clears the whole visible frame to BLACK
+*/
+void clear_screen(void)
+{
+    fill_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, BLACK);
+}
+
+/**
+* @brief Draws a packed 1-bit glyph scaled by GLYPH_SCALE
+* 
+* @param x Left pixel column
+* @param y Top pixel row
+* @param pattern Row-major bitmap, first pixel in the highest used bit
+* @param width Glyph width in bitmap pixels
+* @param height Glyph height in bitmap pixels
+* @param vgaColor 8-bit VGA color code for set pixels
+* 
+* Shared by the 5x7 digits and letters and the 5x5 arrows.
+* Each row is split into runs of set bits and every run is
+* drawn as one GLYPH_SCALE tall fill_rect(), so scaled glyphs
+* cost a few spans per row rather than scale^2 pixel writes.
+*/
+void draw_glyph(int x, int y, uint64_t pattern, int width, int height, char vgaColor)
+{
+    int bit = width * height - 1;
+    for (int row = 0; row < height; row++)
     {
-        for (int dx = 0; dx < BLOCK_SIZE; dx++)
+        int col = 0;
+        while (col < width)
         {
-            if ((screenX + dx) >= 0 && (screenX + dx) < SCREEN_WIDTH &&
-                (screenY + dy) >= 0 && (screenY + dy) < SCREEN_HEIGHT)
+            if (!((pattern >> (bit - col)) & 1))
             {
-
-                // Default to main color
-                char pixelColor = vgaColor;
-
-                // Top and left edges (lighter)
-                if (dx <= 1 || dy <= 1)
-                {
-                    pixelColor = lightEdge;
-                }
-
-                // Bottom and right edges (darker)
-                if (dx >= BLOCK_SIZE - 2 || dy >= BLOCK_SIZE - 2)
-                {
-                    pixelColor = darkEdge;
-                }
-
-                // Write pixel to VGA buffer
-                VGA_PIXELS[(screenY + dy) * SCREEN_WIDTH + (screenX + dx)] = pixelColor;
+                col++;
+                continue;
+            }
+            int runStart = col;
+            while (col < width && ((pattern >> (bit - col)) & 1))
+            {
+                col++;
             }
+            fill_rect(x + runStart * GLYPH_SCALE, y + row * GLYPH_SCALE,
+                      (col - runStart) * GLYPH_SCALE, GLYPH_SCALE, vgaColor);
         }
+        bit -= width;
     }
 }
 
@@ -336,11 +890,11 @@ void draw_block(int x, int y, char color)
 *    - Positions score at BOARD_START_X horizontally
 *    - Uses SCORE_Y constant for vertical position
 *    - Clears entire score area before drawing
-*    - Area height = DIGIT_HEIGHT + 2 pixels padding
+*    - Area height = DIGIT_HEIGHT + 2 glyph pixels padding
 * 
 * 2. "SCORE" label rendering:
 *    - Uses 5x7 LETTER_PATTERNS for "SCORE" text
-*    - Draws each letter using bit patterns
+*    - Draws each letter with draw_glyph() (scaled spans)
 *    - White color for high contrast
 *    - 1-pixel spacing between letters
 * 
@@ -357,11 +911,8 @@ void draw_block(int x, int y, char color)
 *    - Uses 5x7 DIGIT_PATTERNS for numbers
 *    - Consistent 1-pixel digit spacing
 * 
-* 5. Hardware updates:
-*    - Updates VGA control registers
-*    - Triggers display refresh
-* 
-* Called after:
+* Painted by the HUD layer for the tiles under the score bar,
+* and drawn directly in MODE_HYPER after:
 * - Line clears
 * - Score changes
 * - Game initialization
@@ -372,46 +923,26 @@ void draw_score(void)
 {
     int xPosition = BOARD_START_X;
 
-    // First, clear the entire score area
-    for (int y = SCORE_Y; y < SCORE_Y + DIGIT_HEIGHT + 2; y++)
+    // Boards that reach the top of the frame leave no room for the bar
+    if (!HAS_SCORE_BAR)
     {
-        for (int x = 0; x < SCREEN_WIDTH; x++)
-        {
-            VGA_PIXELS[y * SCREEN_WIDTH + x] = BLACK;
-        }
+        return;
     }
 
+    // First, clear the entire score area
+    fill_rect(0, SCORE_Y, SCREEN_WIDTH, (DIGIT_HEIGHT + 2) * GLYPH_SCALE, BLACK);
+
     // Draw "SCORE"
     for (int i = 0; i < 5; i++)
     {
-        unsigned long pattern = LETTER_PATTERNS[i];
-        for (int y = 0; y < DIGIT_HEIGHT; y++)
-        {
-            for (int x = 0; x < DIGIT_WIDTH; x++)
-            {
-                if (pattern & (1UL << (34 - (y * DIGIT_WIDTH + x))))
-                {
-                    VGA_PIXELS[(SCORE_Y + y) * SCREEN_WIDTH + xPosition + x] = WHITE;
-                }
-            }
-        }
-        xPosition += DIGIT_WIDTH + 1;
+        draw_glyph(xPosition, SCORE_Y, LETTER_PATTERNS[i], DIGIT_WIDTH, DIGIT_HEIGHT, WHITE);
+        xPosition += DIGIT_ADVANCE;
     }
 
     // Draw colon
-    xPosition += 1;
-    unsigned long colon = DIGIT_PATTERNS[10];
-    for (int y = 0; y < DIGIT_HEIGHT; y++)
-    {
-        for (int x = 0; x < DIGIT_WIDTH; x++)
-        {
-            if (colon & (1UL << (34 - (y * DIGIT_WIDTH + x))))
-            {
-                VGA_PIXELS[(SCORE_Y + y) * SCREEN_WIDTH + xPosition + x] = WHITE;
-            }
-        }
-    }
-    xPosition += DIGIT_WIDTH + 1;
+    xPosition += GLYPH_SCALE;
+    draw_glyph(xPosition, SCORE_Y, DIGIT_PATTERNS[10], DIGIT_WIDTH, DIGIT_HEIGHT, WHITE);
+    xPosition += DIGIT_ADVANCE;
 
     // Convert score to digits
     char digits[6]; // Max 5 digits + null terminator
@@ -434,108 +965,119 @@ void draw_score(void)
     // Draw score digits from left to right
     for (int i = digitCount - 1; i >= 0; i--)
     {
-        int digit = digits[i] - '0';
-        unsigned long pattern = DIGIT_PATTERNS[digit];
-
-        for (int y = 0; y < DIGIT_HEIGHT; y++)
-        {
-            for (int x = 0; x < DIGIT_WIDTH; x++)
-            {
-                if (pattern & (1UL << (34 - (y * DIGIT_WIDTH + x))))
-                {
-                    VGA_PIXELS[(SCORE_Y + y) * SCREEN_WIDTH + xPosition + x] = WHITE;
-                }
-            }
-        }
-        xPosition += DIGIT_WIDTH + 1;
+        draw_glyph(xPosition, SCORE_Y, DIGIT_PATTERNS[digits[i] - '0'],
+                   DIGIT_WIDTH, DIGIT_HEIGHT, WHITE);
+        xPosition += DIGIT_ADVANCE;
     }
-
-    // Update the display
-    *(VGA_CTRL + 1) = (uint32_t)(uintptr_t)VGA_PIXELS;
-    *(VGA_CTRL + 0) = 0;
 }
 
 /**
-* @brief Renders the complete game board including border and all pieces
-* 
-* 
-* Comprehensive board rendering function that:
-* 1. Background preparation:
-*    - Clears entire board area including border space
-*    - Uses BLACK color for empty cells
-*    - Includes one cell padding on all sides
-*    - Range: (-1,-1) to (BOARD_WIDTH, BOARD_HEIGHT)
-* 
-* 2. Border rendering:
-*    - Draws WHITE border blocks around play area
-*    - Top border: spans full width plus corners
-*    - Bottom border: spans full width plus corners 
-*    - Left border: spans full height plus corners
-*    - Right border: spans full height plus corners
-*    - Creates clear game area boundary
+* @brief Finds the board cells under the clip rectangle
 * 
-* 3. Piece rendering:
-*    - Iterates through entire board.cells array
-*    - Draws only non-BLACK cells
-*    - Uses piece-specific colors from cell values
-*    - Maintains consistent block appearance
+* @param x0,y0,x1,y1 Receive the inclusive cell range, border
+*                    cells (-1 and BOARD_WIDTH/HEIGHT) included
+* @return 0 if the clip rectangle misses the board and border
 * 
-* Called during:
-* - Initial board setup
-* - After piece locking
-* - After line clears
-* - After gravity effects
-* 
-* Core display function for game state visualization
-* Uses draw_block() for consistent block appearance
+* Lets the layer painters visit only the one to four cells a
+* compositor tile overlaps instead of the whole board.
 */
-void draw_board(void)
+static int clip_cells(int *x0, int *y0, int *x1, int *y1)
 {
-    // Fill the entire board area with black first
-    for (int y = -1; y <= BOARD_HEIGHT; y++)
+    int left = clipLeft - (BOARD_START_X - BLOCK_SIZE);
+    int top = clipTop - (BOARD_START_Y - BLOCK_SIZE);
+    int right = clipRight - 1 - (BOARD_START_X - BLOCK_SIZE);
+    int bottom = clipBottom - 1 - (BOARD_START_Y - BLOCK_SIZE);
+
+    if (right < 0 || bottom < 0)
     {
-        for (int x = -1; x <= BOARD_WIDTH; x++)
-        {
-            draw_block(x, y, BLACK);
-        }
+        return 0;
     }
-
-    // Draw the border blocks
-    for (int i = -1; i <= BOARD_WIDTH; i++)
+    *x0 = (left < 0 ? 0 : left) / BLOCK_SIZE - 1;
+    *y0 = (top < 0 ? 0 : top) / BLOCK_SIZE - 1;
+    *x1 = right / BLOCK_SIZE - 1;
+    *y1 = bottom / BLOCK_SIZE - 1;
+    if (*x1 > BOARD_WIDTH)
+    {
+        *x1 = BOARD_WIDTH;
+    }
+    if (*y1 > BOARD_HEIGHT)
     {
-        draw_block(i, -1, WHITE);           // Top border
-        draw_block(i, BOARD_HEIGHT, WHITE); // Bottom border
+        *y1 = BOARD_HEIGHT;
     }
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+/**
+* @brief Background layer: BLACK everywhere
+*/
+void paint_background(void)
+{
+    fill_rect(clipLeft, clipTop, clipRight - clipLeft, clipBottom - clipTop, BLACK);
+}
 
-    for (int i = -1; i <= BOARD_HEIGHT; i++)
+/**
+* @brief Border layer: the ring of WHITE blocks around the board
+*/
+void paint_border(void)
+{
+    int x0, y0, x1, y1;
+    if (!clip_cells(&x0, &y0, &x1, &y1))
     {
-        draw_block(-1, i, WHITE);          // Left border
-        draw_block(BOARD_WIDTH, i, WHITE); // Right border
+        return;
     }
 
-    // Draw the game pieces
-    for (int y = 0; y < BOARD_HEIGHT; y++)
+    for (int y = y0; y <= y1; y++)
     {
-        for (int x = 0; x < BOARD_WIDTH; x++)
+        for (int x = x0; x <= x1; x++)
         {
-            if (board.cells[y][x] != BLACK)
+            if (x < 0 || x == BOARD_WIDTH || y < 0 || y == BOARD_HEIGHT)
             {
-                draw_block(x, y, board.cells[y][x]);
+                draw_block(x, y, WHITE);
             }
         }
     }
 }
 
 /**
-* @brief Renders the currently active tetromino 
+* @brief Board layer: every cell, locked blocks and empty background
+* 
+* Empty cells are drawn as recessed BLACK blocks, so the layer
+* is opaque over the whole board area.
+*/
+void paint_board(void)
+{
+    int x0, y0, x1, y1;
+    if (!clip_cells(&x0, &y0, &x1, &y1))
+    {
+        return;
+    }
+
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 >= BOARD_WIDTH ? BOARD_WIDTH - 1 : x1;
+    y1 = y1 >= BOARD_HEIGHT ? BOARD_HEIGHT - 1 : y1;
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            draw_block(x, y, cell_get(x, y));
+        }
+    }
+}
+
+/**
+* @brief Renders an in-flight tetromino
+* 
+* @param p Piece to draw
+* @param color Game color index, BLACK erases the piece
 * 
 * 
 * Active piece rendering function that:
 * 1. Shape retrieval and color mapping:
 *    - Gets 16-bit shape pattern from TETROMINOS array using:
-*      * currentPiece.type (0-6 for piece type)
-*      * currentPiece.rotation (0-3 for rotation state)
-*    - Maps piece type to color (type + 1):
+*      * p->type (0-6 for piece type)
+*      * p->rotation (0-3 for rotation state)
+*    - Callers pass the piece color (type + 1):
 *      * 1: CYAN (I piece)
 *      * 2: BLUE (J piece)
 *      * 3: ORANGE (L piece)
@@ -548,20 +1090,17 @@ void draw_board(void)
 *    - Processes 4x4 shape grid
 *    - Right shifts 16-bit pattern to check each bit
 *    - Only draws blocks where bits are set (1)
-*    - Offsets blocks by currentPiece position
+*    - Offsets blocks by the piece position
 * 
-* Called during:
-* - Every game tick
-* - After piece movement
-* - After piece rotation
+* Called by the pieces layer for every composed tile; blocks
+* outside the tile are rejected by draw_block()
 * 
 * Critical for real-time piece visualization
 * Uses draw_block() for consistent appearance
 */
-void draw_current_piece(void)
+void draw_piece(Piece *p, char color)
 {
-    uint16_t shape = TETROMINOS[currentPiece.type][currentPiece.rotation];
-    char pieceColor = currentPiece.type + 1; // Maps to CYAN through RED based on piece type
+    uint16_t shape = TETROMINOS[p->type][p->rotation];
 
     for (int y = 0; y < 4; y++)
     {
@@ -569,616 +1108,2842 @@ void draw_current_piece(void)
         {
             if ((shape >> (15 - (y * 4 + x))) & 1)
             {
-                draw_block(currentPiece.x + x, currentPiece.y + y, pieceColor);
+                draw_block(p->x + x, p->y + y, color);
             }
         }
     }
 }
 
 /**
-* @brief Checks if a piece collides with board boundaries or other pieces
-* 
-* @param p Pointer to Piece structure to check for collisions
-* @return 1 if collision detected, 0 if no collision
+* @brief Pieces layer: every in-flight piece in its own color
+*/
+void paint_pieces(void)
+{
+    for (int slot = 0; slot < MAX_ACTIVE_PIECES; slot++)
+    {
+        if (activeSlots & (1 << slot))
+        {
+            Piece *p = &activePieces[slot];
+            draw_piece(p, p->type + 1);
+        }
+    }
+}
+
+/**
+* @brief Pre-renders the mini preview tile of every tetromino
 * 
-* Collision detection function that:
-* 1. Shape processing:
-*    - Gets 16-bit shape pattern from TETROMINOS array
-*    - Uses piece type and current rotation state
-*    - Processes each bit in 4x4 shape grid
+* Tile cache builder that:
+* 1. Clears each PREVIEW_BOX x PREVIEW_BOX tile to BLACK
+* 2. Paints the spawn rotation (0) as PREVIEW_CELL sized
+*    blocks with a UI_SCALE pixel gap, in the piece color
 * 
-* 2. Collision checks for each filled block:
-*    - Board boundaries:
-*      * Left wall (boardX < 0)
-*      * Right wall (boardX >= BOARD_WIDTH)
-*      * Top edge (boardY < 0)
-*      * Bottom edge (boardY >= BOARD_HEIGHT)
-*    - Other pieces:
-*      * Checks if board cell is non-BLACK
-* 
-* 3. Coordinate translation:
-*    - Converts piece-relative coordinates to board coordinates
-*    - Accounts for piece position (p->x, p->y)
-* 
-* Called during:
-* - Piece movement
-* - Piece rotation
-* - New piece spawn
-* 
-* Critical for:
-* - Movement validation
-* - Game over detection
-* - Wall kick handling
+* Called once at startup. The queue and hold previews then
+* copy these tiles instead of decoding shapes per repaint.
 */
-int check_collision(Piece *p)
+void init_preview_tiles(void)
 {
-    uint16_t shape = TETROMINOS[p->type][p->rotation];
-    for (int y = 0; y < 4; y++)
+    for (int type = 0; type < 7; type++)
     {
-        for (int x = 0; x < 4; x++)
+        uint16_t shape = TETROMINOS[type][0];
+        char vgaColor = get_vga_color(type + 1);
+        char *tile = previewTiles[type];
+
+        for (int py = 0; py < PREVIEW_BOX; py++)
         {
-            if ((shape >> (15 - (y * 4 + x))) & 1)
+            for (int px = 0; px < PREVIEW_BOX; px++)
             {
-                //Convert piece coordinates to board coordinates
-                int boardX = p->x + x;
-                int boardY = p->y + y;
+                int cell = (py / PREVIEW_CELL) * 4 + (px / PREVIEW_CELL);
+                int inGap = (px % PREVIEW_CELL) >= PREVIEW_CELL - UI_SCALE ||
+                            (py % PREVIEW_CELL) >= PREVIEW_CELL - UI_SCALE;
 
-                if (boardX < 0 || boardX >= BOARD_WIDTH ||
-                    boardY < 0 || boardY >= BOARD_HEIGHT ||
-                    board.cells[boardY][boardX] != BLACK)
-                {
-                    return 1;
-                }
+                tile[py * PREVIEW_BOX + px] =
+                    (!inGap && ((shape >> (15 - cell)) & 1)) ? vgaColor : BLACK;
             }
         }
     }
-    return 0;
 }
 
 /**
-* @brief Initializes the game board and screen display
+* @brief Copies a cached preview tile to the render target
 * 
+* @param x Left pixel column
+* @param y Top pixel row
+* @param type Tetromino type (0-6)
 * 
-* Comprehensive initialization function that:
-* 1. Board state initialization:
-*    - Clears game board array (board.cells)
-*    - Sets all cells to BLACK
-*    - Covers full BOARD_WIDTH x BOARD_HEIGHT area
+* Only the part inside the clip rectangle is copied.
+*/
+void blit_preview_tile(int x, int y, int type)
+{
+    const char *tile = previewTiles[type];
+    int left = x < clipLeft ? clipLeft : x;
+    int right = x + PREVIEW_BOX > clipRight ? clipRight : x + PREVIEW_BOX;
+
+    if (left >= right)
+    {
+        return;
+    }
+    for (int py = 0; py < PREVIEW_BOX; py++)
+    {
+        if (y + py >= clipTop && y + py < clipBottom)
+        {
+            copy_span(TARGET_PIXEL(left, y + py), tile + py * PREVIEW_BOX + (left - x), right - left);
+        }
+    }
+}
+
+/**
+* @brief Draws a 5x5 direction arrow, scaled by GLYPH_SCALE
 * 
-* 2. Screen clearing:
-*    - Cleans entire VGA display buffer
-*    - Sets all pixels to BLACK
-*    - Covers full SCREEN_WIDTH x SCREEN_HEIGHT
-*    - Includes border areas
+* @param x Left pixel column
+* @param y Top pixel row
+* @param direction DIR_DOWN, DIR_UP, DIR_LEFT or DIR_RIGHT
+*/
+void draw_arrow(int x, int y, int direction)
+{
+    draw_glyph(x, y, ARROW_PATTERNS[direction], ARROW_SIZE, ARROW_SIZE, WHITE);
+}
+
+/**
+* @brief Repaints one slot of the next-piece preview queue
 * 
-* 3. Border rendering:
-*    - Draws solid WHITE borders
-*    - Consistent BLOCK_SIZE thickness
-*    - Horizontal borders:
-*      * Top: (BOARD_START_Y - BLOCK_SIZE)
-*      * Bottom: (BOARD_START_Y + BOARD_HEIGHT * BLOCK_SIZE)
-*      * Spans: -1 to BOARD_WIDTH inclusive
-*    - Vertical borders:
-*      * Left: (BOARD_START_X - BLOCK_SIZE)
-*      * Right: (BOARD_START_X + BOARD_WIDTH * BLOCK_SIZE)
-*      * Spans: -1 to BOARD_HEIGHT inclusive
+* @param slot Ring buffer index (0 to NEXT_QUEUE_SIZE - 1)
 * 
-* Called during:
-* - Game start
-* - Game restart
+* Slot rendering function that:
+* 1. Copies the cached tile of the queued tetromino
+* 2. Clears the arrow area and draws the spawn direction
+*    to the right of the tile
 * 
-* Sets up clean initial state for gameplay
-* Direct pixel manipulation for efficiency
+* Slots are fixed to ring buffer positions, so advancing the
+* queue only refills one slot; the "next" marker is painted
+* beside it by paint_hud().
 */
-void init_board(void)
+void draw_queue_slot(int slot)
 {
-    // First clear the entire board
-    for (int y = 0; y < BOARD_HEIGHT; y++)
+    int slotX = QUEUE_X + UI_PX(5);
+    int slotY = QUEUE_Y + slot * PREVIEW_SLOT_HEIGHT;
+    QueueEntry *entry = &nextQueue[slot];
+
+    if (entry->type < 0)
     {
-        for (int x = 0; x < BOARD_WIDTH; x++)
-        {
-            board.cells[y][x] = BLACK;
-        }
+        fill_rect(slotX, slotY, PREVIEW_WIDTH, PREVIEW_BOX, BLACK);
+        return;
     }
 
-    // Initial screen clear including border area
-    for (int y = 0; y < SCREEN_HEIGHT; y++)
+    blit_preview_tile(slotX, slotY, entry->type);
+    fill_rect(slotX + PREVIEW_BOX, slotY, MARKER_PX + ARROW_PX, PREVIEW_BOX, BLACK);
+    draw_arrow(slotX + PREVIEW_BOX + MARKER_PX, slotY + (PREVIEW_BOX - ARROW_PX) / 2,
+               entry->direction);
+}
+
+/**
+* @brief Draws the hold preview
+* 
+* Draws the held piece from the tile cache plus its direction
+* arrow in the left margin, or clears the slot when nothing is
+* held.
+*/
+void draw_hold(void)
+{
+    if (heldType < 0)
     {
-        for (int x = 0; x < SCREEN_WIDTH; x++)
-        {
-            VGA_PIXELS[y * SCREEN_WIDTH + x] = BLACK;
-        }
+        fill_rect(HOLD_X, HOLD_Y, PREVIEW_WIDTH, PREVIEW_BOX, BLACK);
+    }
+    else
+    {
+        blit_preview_tile(HOLD_X, HOLD_Y, heldType);
+        fill_rect(HOLD_X + PREVIEW_BOX, HOLD_Y, MARKER_PX + ARROW_PX, PREVIEW_BOX, BLACK);
+        draw_arrow(HOLD_X + PREVIEW_BOX + MARKER_PX, HOLD_Y + (PREVIEW_BOX - ARROW_PX) / 2,
+                   heldDirection);
     }
+}
+
+/* Whether the clip rectangle overlaps the given screen rectangle */
+static int clip_overlaps(int x, int y, int w, int h)
+{
+    return x < clipRight && x + w > clipLeft && y < clipBottom && y + h > clipTop;
+}
 
-    // Horizontal borders
-    for (int i = -1; i <= BOARD_WIDTH; i++)
+/**
+* @brief HUD layer: score bar, preview queue with its marker and hold
+* 
+* Each part is skipped when the clip rectangle misses it, so a
+* tile inside the board pays a few compares here. The "next"
+* marker is a WHITE bar beside nextQueue[queueHead].
+*/
+void paint_hud(void)
+{
+    if (HAS_SCORE_BAR && clip_overlaps(0, SCORE_Y, SCREEN_WIDTH, (DIGIT_HEIGHT + 2) * GLYPH_SCALE))
     {
-        for (int thickness = 0; thickness < BLOCK_SIZE; thickness++)
-        {
-            // Top border
-            VGA_PIXELS[((BOARD_START_Y - BLOCK_SIZE) + thickness) * SCREEN_WIDTH +
-                       (BOARD_START_X + i * BLOCK_SIZE)] = WHITE;
-            // Bottom border
-            VGA_PIXELS[(BOARD_START_Y + BOARD_HEIGHT * BLOCK_SIZE + thickness) * SCREEN_WIDTH +
-                       (BOARD_START_X + i * BLOCK_SIZE)] = WHITE;
-        }
+        draw_score();
     }
 
-    //Vertical borders
-    for (int i = -1; i <= BOARD_HEIGHT; i++)
+    if (!HAS_SIDE_PANELS)
     {
-        for (int thickness = 0; thickness < BLOCK_SIZE; thickness++)
+        return;
+    }
+    for (int slot = 0; slot < NEXT_QUEUE_SIZE; slot++)
+    {
+        int slotY = QUEUE_Y + slot * PREVIEW_SLOT_HEIGHT;
+        if (clip_overlaps(QUEUE_X, slotY, UI_PX(5) + PREVIEW_WIDTH, PREVIEW_BOX))
         {
-            // Left border
-            VGA_PIXELS[(BOARD_START_Y + i * BLOCK_SIZE) * SCREEN_WIDTH +
-                       (BOARD_START_X - BLOCK_SIZE + thickness)] = WHITE;
-            // Right border
-            VGA_PIXELS[(BOARD_START_Y + i * BLOCK_SIZE) * SCREEN_WIDTH +
-                       (BOARD_START_X + BOARD_WIDTH * BLOCK_SIZE + thickness)] = WHITE;
+            draw_queue_slot(slot);
+            if (slot == queueHead)
+            {
+                fill_rect(QUEUE_X, slotY, MARKER_PX, PREVIEW_BOX, WHITE);
+            }
         }
     }
+    if (clip_overlaps(HOLD_X, HOLD_Y, PREVIEW_WIDTH, PREVIEW_BOX))
+    {
+        draw_hold();
+    }
 }
 
 /**
-* @brief Creates and positions a new tetromino piece
-* 
-* 
-* Piece generation function that:
-* 1. Piece initialization:
-*    - Randomly selects piece type (0-6)
-*    - Sets initial rotation to 0
-*    - Generates random movement direction (0-3)
-* 
-* 2. Position setup:
-*    - Places piece at board center
-*    - X offset: (BOARD_WIDTH / 2) - 2
-*    - Y offset: (BOARD_HEIGHT / 2) - 2
-*    - Accounts for 4x4 piece grid
-* 
-* 3. Direction assignment:
-*    - Random direction from:
-*      * DIR_DOWN (0)
-*      * DIR_UP (1)
-*      * DIR_LEFT (2)
-*      * DIR_RIGHT (3)
-* 
-* 4. Game over detection:
-*    - Checks for collision at spawn position
-*    - Sets gameOver flag if collision occurs
-* 
-* Called:
-* - At game start
-* - After piece lock
-* - After line clear
-* 
-* Critical for game progression and difficulty
+* @brief Effects layer: every live line-clear particle
 */
-void spawn_piece(void)
+void paint_effects(void)
 {
-    currentPiece.type = my_rand() % 7;
-    currentPiece.rotation = 0;
+    for (Particle *p = liveParticles; p; p = p->next)
+    {
+        fill_rect(p->x >> 8, p->y >> 8, PARTICLE_PX, PARTICLE_PX, p->vgaColor);
+    }
+}
 
-    // Spawn in center of square board
-    currentPiece.x = (BOARD_WIDTH / 2) - 2;
-    currentPiece.y = (BOARD_HEIGHT / 2) - 2;
+// Layer painters, indexed by LAYER_*
+static void (*const LAYER_PAINTERS[LAYERS])(void) = {
+    paint_background, paint_border, paint_board, paint_pieces, paint_hud, paint_effects};
+
+/* Sets the flags of the tiles under a screen rectangle in one tile grid */
+static void mark_tiles(uint32_t tiles[TILES_Y][TILE_ROW_WORDS], int x, int y, int w, int h)
+{
+    if (w <= 0 || h <= 0 || x + w <= 0 || y + h <= 0)
+    {
+        return;
+    }
 
-    // Random direction
-    currentPiece.direction = my_rand() % 4;
+    int tx0 = (x < 0 ? 0 : x) / TILE_PX;
+    int ty0 = (y < 0 ? 0 : y) / TILE_PX;
+    int tx1 = (x + w - 1) / TILE_PX;
+    int ty1 = (y + h - 1) / TILE_PX;
+    tx1 = tx1 >= TILES_X ? TILES_X - 1 : tx1;
+    ty1 = ty1 >= TILES_Y ? TILES_Y - 1 : ty1;
 
-    if (check_collision(&currentPiece))
+    for (int ty = ty0; ty <= ty1; ty++)
     {
-        gameOver = 1;
+        for (int tx = tx0; tx <= tx1; tx++)
+        {
+            tiles[ty][tx >> 5] |= 1u << (tx & 31);
+        }
     }
 }
 
 /**
-* @brief Fixes the current tetromino piece to the game board
+* @brief Flags the tiles under a screen rectangle for composition
 * 
+* @param x Left pixel column
+* @param y Top pixel row
+* @param w Width in pixels
+* @param h Height in pixels
 * 
-* Piece locking function that:
-* 1. Shape processing:
-*    - Gets 16-bit shape pattern from TETROMINOS array
-*    - Uses currentPiece type and rotation
-*    - Processes each bit in 4x4 shape grid
+* Parts outside the screen are ignored.
+*/
+void mark_dirty(int x, int y, int w, int h)
+{
+    mark_tiles(tileDirty, x, y, w, h);
+}
+
+/* Flags the tiles under one board cell */
+static void mark_cell(int x, int y)
+{
+    mark_dirty(BOARD_START_X + x * BLOCK_SIZE, BOARD_START_Y + y * BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE);
+}
+
+/**
+* @brief Flags the tiles under every in-flight piece
 * 
-* 2. Board integration:
-*    - Converts active piece to static board cells
-*    - Maps piece type to color value (type + 1):
-*      * I piece → CYAN (1)
-*      * J piece → BLUE (2)
-*      * L piece → ORANGE (3)
-*      * O piece → YELLOW (4)
-*      * S piece → GREEN (5)
-*      * T piece → PURPLE (6)
-*      * Z piece → RED (7)
+* Uses the shape extent from shapeBounds, so each piece marks
+* one rectangle rather than four blocks. The tiles go into
+* pieceTiles, which compose_dirty() draws before the budget
+* applies.
+*/
+void mark_pieces(void)
+{
+    for (int slot = 0; slot < MAX_ACTIVE_PIECES; slot++)
+    {
+        if (activeSlots & (1 << slot))
+        {
+            Piece *p = &activePieces[slot];
+            ShapeBounds *b = &shapeBounds[p->type][p->rotation];
+            mark_tiles(pieceTiles,
+                       BOARD_START_X + (p->x + b->minX) * BLOCK_SIZE,
+                       BOARD_START_Y + (p->y + b->minY) * BLOCK_SIZE,
+                       (b->maxX - b->minX + 1) * BLOCK_SIZE,
+                       (b->maxY - b->minY + 1) * BLOCK_SIZE);
+        }
+    }
+}
+
+/**
+* @brief Shows the in-flight pieces at their current positions
 * 
-* 3. Position translation:
-*    - Converts piece-relative coordinates to board coordinates
-*    - Uses currentPiece.x and currentPiece.y as offsets
+* @param erase Non-zero for the positions at the start of the frame
 * 
-* Called when:
-* - Piece hits bottom/other pieces
-* - Collision detected in current direction
+* Outside MODE_HYPER the pieces are a compositor layer, so the
+* call before and the call after the rules both just flag the
+* tiles under the pieces; draw_deferred() composes them from
+* the layers. MODE_HYPER draws its projection directly.
+*/
+void refresh_active_pieces(int erase)
+{
+    if (gameMode == MODE_HYPER)
+    {
+        hyper_draw_piece(erase);
+        return;
+    }
+    mark_pieces();
+}
+
+/**
+* @brief Turns the per-element dirty flags into tile flags
 * 
-* Triggers:
-* - Line clear checks
-* - New piece spawn
+* Flag converter that:
+* 1. Marks the tiles under every cell flagged in boardDirty
+* 2. Marks the score bar, the flagged queue slots, both ends
+*    of a marker move and the hold preview
+* 3. Clears those flags, so only tileDirty says what is left
+*    to draw
 */
-void lock_piece(void)
+static void collect_dirty(void)
 {
-    uint16_t shape = TETROMINOS[currentPiece.type][currentPiece.rotation];
-    for (int y = 0; y < 4; y++)
+    for (int y = 0; y < BOARD_HEIGHT; y++)
     {
-        for (int x = 0; x < 4; x++)
+        BoardRow row = boardDirty[y];
+        for (int x = 0; row; x++, row >>= 1)
         {
-            if ((shape >> (15 - (y * 4 + x))) & 1)
+            if (row & 1)
+            {
+                mark_cell(x, y);
+            }
+        }
+        boardDirty[y] = 0;
+    }
+
+    if (scoreDirty && HAS_SCORE_BAR)
+    {
+        mark_dirty(0, SCORE_Y, SCREEN_WIDTH, (DIGIT_HEIGHT + 2) * GLYPH_SCALE);
+    }
+    scoreDirty = 0;
+
+    if (HAS_SIDE_PANELS)
+    {
+        for (int slot = 0; slot < NEXT_QUEUE_SIZE; slot++)
+        {
+            if ((queueDirty & (1 << slot)) || slot == queueMarkerSlot ||
+                (slot == queueHead && queueMarkerSlot != queueHead))
             {
-                board.cells[currentPiece.y + y][currentPiece.x + x] = currentPiece.type + 1;
+                mark_dirty(QUEUE_X, QUEUE_Y + slot * PREVIEW_SLOT_HEIGHT,
+                           UI_PX(5) + PREVIEW_WIDTH, PREVIEW_BOX);
             }
         }
+        if (holdDirty)
+        {
+            mark_dirty(HOLD_X, HOLD_Y, PREVIEW_WIDTH, PREVIEW_BOX);
+        }
     }
+    queueDirty = 0;
+    queueMarkerSlot = queueHead;
+    holdDirty = 0;
 }
 
 /**
-* @brief Attempts to rotate the current piece 90 degrees clockwise
-* 
-* 
-* Piece rotation function that:
-* 1. Rotation state management:
-*    - Stores current rotation state
-*    - Advances rotation by 1 position
-*    - Uses modulo 4 to cycle through states (0->1->2->3->0)
+* @brief Composes one 8x8 screen tile and copies it to the framebuffer
 * 
-* 2. Collision validation:
-*    - Checks if rotated position is valid
-*    - Uses check_collision() for validation
+* @param tx Tile column
+* @param ty Tile row
 * 
-* 3. Rotation recovery:
-*    - Restores previous rotation if collision detected
-*    - Implements simple wall kick system
-* 
-* Called when:
-* - Button press detected
-* - User requests rotation
-* 
-* Core gameplay mechanic for piece manipulation
-* Simple but effective rotation system
+* Tile compositor that:
+* 1. Picks the lowest layer that matters: the board covers
+*    every tile inside it, board plus border every tile inside
+*    the frame, so the layers below are skipped there
+* 2. Points the drawing primitives at tileBuffer, clipped to
+*    the tile, and runs that layer's painter and every one
+*    above it in order
+* 3. Copies the finished tile to the framebuffer in TILE_PX
+*    word-aligned spans, so every screen pixel is written once
+*    however many layers overlap it
 */
-void rotate_piece(void)
+static void compose_tile(int tx, int ty)
 {
-    int oldRotation = currentPiece.rotation;
-    currentPiece.rotation = (currentPiece.rotation + 1) % 4;
-    if (check_collision(&currentPiece))
+    int x = tx * TILE_PX;
+    int y = ty * TILE_PX;
+    int layer = LAYER_BACKGROUND;
+
+    if (x >= BOARD_START_X && y >= BOARD_START_Y &&
+        x + TILE_PX <= BOARD_START_X + BOARD_WIDTH * BLOCK_SIZE &&
+        y + TILE_PX <= BOARD_START_Y + BOARD_HEIGHT * BLOCK_SIZE)
     {
-        currentPiece.rotation = oldRotation;
+        layer = LAYER_BOARD;
     }
+    else if (x >= BOARD_START_X - BLOCK_SIZE && y >= BOARD_START_Y - BLOCK_SIZE &&
+             x + TILE_PX <= BOARD_START_X + (BOARD_WIDTH + 1) * BLOCK_SIZE &&
+             y + TILE_PX <= BOARD_START_Y + (BOARD_HEIGHT + 1) * BLOCK_SIZE)
+    {
+        layer = LAYER_BORDER;
+    }
+
+    targetPixels = (volatile char *)tileBuffer;
+    targetX = clipLeft = x;
+    targetY = clipTop = y;
+    targetStride = TILE_PX;
+    clipRight = x + TILE_PX;
+    clipBottom = y + TILE_PX;
+
+    for (; layer < LAYERS; layer++)
+    {
+        LAYER_PAINTERS[layer]();
+    }
+
+    targetPixels = VGA_PIXELS;
+    targetX = clipLeft = 0;
+    targetY = clipTop = 0;
+    targetStride = SCREEN_STRIDE;
+    clipRight = SCREEN_WIDTH;
+    clipBottom = SCREEN_HEIGHT;
+
+    for (int row = 0; row < TILE_PX; row++)
+    {
+        copy_span(VGA_ROW(y + row) + x, (const char *)tileBuffer + row * TILE_PX, TILE_PX);
+    }
+}
+
+/* Whether the current frame still has drawing budget left */
+static int frame_budget_left(void)
+{
+    return read_cycles() - frameStart < FRAME_BUDGET_CYCLES;
 }
 
 /**
-* @brief Applies quad-directional gravity effects after line clears
-* 
-* @param clearedRow Index of cleared horizontal line (-1 if none)
-* @param clearedCol Index of cleared vertical line (-1 if none)
-* 
-* Complex gravity simulation function that:
-* 1. Coordinate system:
-*    - Uses board center as gravity pivot point
-*    - centerX = BOARD_WIDTH / 2
-*    - centerY = BOARD_HEIGHT / 2
-*    - Divides board into four quadrants
-* 
-* 2. Horizontal line clear handling:
-*    - Above center:
-*      * Blocks fall upward
-*      * Scans from y=1 to centerY
-*      * Moves blocks into empty spaces above
-*    - Below center:
-*      * Blocks fall downward
-*      * Scans from bottom up to centerY
-*      * Moves blocks into empty spaces below
-* 
-* 3. Vertical line clear handling:
-*    - Top-right quadrant:
-*      * Blocks fall rightward
-*      * Scans from right edge to centerX
-*      * Y range: 0 to centerY
-*    - Top-left quadrant:
-*      * Blocks fall leftward
-*      * Scans from left edge to centerX
-*      * Y range: 0 to centerY
-*    - Bottom-right quadrant:
-*      * Blocks fall rightward
-*      * Scans from right edge to centerX
-*      * Y range: centerY to BOARD_HEIGHT
-*    - Bottom-left quadrant:
-*      * Blocks fall leftward
-*      * Scans from left edge to centerX
-*      * Y range: centerY to BOARD_HEIGHT
-* 
-* 4. Animation handling:
-*    - Tracks number of block movements
-*    - Redraws board after each iteration
-*    - 50ms delay between frames
-*    - Continues until no more movements possible
+* @brief Composes the flagged tiles, one tile row per step
 * 
-* Called after:
-* - Line clear detection
-* - Before spawning new piece
+* @param budgeted Non-zero to stop when the frame budget runs out
 * 
-* Creates unique gameplay mechanic with
-* quad-directional gravity based on board position
+* The tiles under the pieces' old and new positions come first
+* and are never deferred, so piece motion shows every frame
+* however much of the board is still waiting.
 */
-void apply_gravity(int clearedRow, int clearedCol)
+static void compose_dirty(int budgeted)
 {
-    int changes;
-    int centerX = BOARD_WIDTH / 2;
-    int centerY = BOARD_HEIGHT / 2;
+    int steps = 0;
 
-    do
+    for (int ty = 0; ty < TILES_Y; ty++)
     {
-        changes = 0;
-
-        // If a row was cleared (horizontal line clear)
-        if (clearedRow != -1)
+        for (int w = 0; w < TILE_ROW_WORDS; w++)
         {
-            // For blocks above center, fall upward
-            if (clearedRow < centerY)
+            uint32_t bits = pieceTiles[ty][w];
+            for (int tx = w * 32; bits; tx++, bits >>= 1)
             {
-                for (int y = 1; y < centerY; y++)
+                if (bits & 1)
                 {
-                    for (int x = 0; x < BOARD_WIDTH; x++)
-                    {
-                        if (board.cells[y][x] != BLACK && board.cells[y - 1][x] == BLACK)
-                        {
-                            board.cells[y - 1][x] = board.cells[y][x];
-                            board.cells[y][x] = BLACK;
-                            changes++;
-                        }
-                    }
+                    compose_tile(tx, ty);
                 }
             }
-            // For blocks below center, fall downward
-            else
+            tileDirty[ty][w] &= ~pieceTiles[ty][w];
+            pieceTiles[ty][w] = 0;
+        }
+    }
+
+    for (int ty = 0; ty < TILES_Y; ty++)
+    {
+        int rowDirty = 0;
+        for (int w = 0; w < TILE_ROW_WORDS; w++)
+        {
+            rowDirty |= tileDirty[ty][w] != 0;
+        }
+        if (!rowDirty)
+        {
+            continue;
+        }
+        if (budgeted && steps++ > 0 && !frame_budget_left())
+        {
+            return;
+        }
+        for (int w = 0; w < TILE_ROW_WORDS; w++)
+        {
+            uint32_t bits = tileDirty[ty][w];
+            for (int tx = w * 32; bits; tx++, bits >>= 1)
             {
-                for (int y = BOARD_HEIGHT - 2; y >= centerY; y--)
+                if (bits & 1)
                 {
-                    for (int x = 0; x < BOARD_WIDTH; x++)
-                    {
-                        if (board.cells[y][x] != BLACK && board.cells[y + 1][x] == BLACK)
-                        {
-                            board.cells[y + 1][x] = board.cells[y][x];
-                            board.cells[y][x] = BLACK;
-                            changes++;
-                        }
-                    }
+                    compose_tile(tx, ty);
                 }
             }
+            tileDirty[ty][w] = 0;
         }
+    }
+}
+
+/**
+* @brief Repaints everything that changed, within the frame budget
+* 
+* 
+* Deferred rendering function that:
+* 1. Turns the board, score, queue and hold flags into tile
+*    flags (collect_dirty)
+* 2. Composes the tiles under the pieces, then the other
+*    flagged tiles from the layers, one tile row per step
+* 3. Checks FRAME_BUDGET_CYCLES (measured from frameStart)
+*    before every step but the first and leaves the rest
+*    flagged for the next frame, so a big clear is spread
+*    over several frames while input and piece motion keep
+*    their pace; the first step always runs, so a backlog
+*    drains even when a frame starts late
+* 
+* MODE_HYPER bypasses the compositor and only redraws the
+* score bar here. Called once per frame after the rules, the
+* particles and the second refresh_active_pieces().
+*/
+void draw_deferred(void)
+{
+    if (gameMode == MODE_HYPER)
+    {
+        if (scoreDirty)
+        {
+            draw_score();
+            scoreDirty = 0;
+        }
+        return;
+    }
+
+    collect_dirty();
+    compose_dirty(1);
+}
+
+/**
+* @brief Composes the whole screen at once, ignoring the budget
+* 
+* Used when the game starts or a snapshot is restored, where
+* every layer changes together. A restore can happen mid-frame,
+* before the rules move the pieces again, so the tiles under
+* the pieces are flagged once more for draw_deferred().
+*/
+void redraw_screen(void)
+{
+#ifdef RENDER_THREAD
+    if (render_owns_screen())
+    {
+        return; // Repainted from the next snapshot on the render thread
+    }
+#endif
+    trace_begin("redraw_screen");
+    collect_dirty();
+    mark_dirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    compose_dirty(0);
+    mark_pieces();
+    trace_end("redraw_screen");
+}
+
+/**
+* @brief Checks if a piece collides with board boundaries or other pieces
+* 
+* @param p Pointer to Piece structure to check for collisions
+* @return COLLIDE_NONE, COLLIDE_BOARD (walls or locked cells, takes
+*         precedence) or COLLIDE_PIECE (another in-flight piece)
+* 
+* Collision detection function that:
+* 1. Shape processing:
+*    - Uses the shapeRowBits masks of the piece type and
+*      current rotation state, shifted to the piece column
+* 
+* 2. Board boundaries, tested once on the shape extent
+*    from shapeBounds (see init_shape_tables):
+*      * Left wall (boardX < 0)
+*      * Right wall (boardX >= BOARD_WIDTH)
+*      * Top edge (boardY < 0)
+*      * Bottom edge (boardY >= BOARD_HEIGHT)
+* 
+* 3. Locked cells:
+*    - One AND per shape row against board.occupied
+* 
+* 4. In-flight pieces:
+*    - One AND per shape row against inflightMask
+*    - The piece being tested must be lifted out of the
+*      mask first (occupancy_toggle), so it does not hit
+*      its own cells
+* 
+* 5. Coordinate translation:
+*    - Converts piece-relative coordinates to board coordinates
+*    - Accounts for piece position (p->x, p->y)
+* 
+* Called during:
+* - Piece movement
+* - Piece rotation
+* - New piece spawn
+* 
+* Critical for:
+* - Movement validation
+* - Game over detection
+* - Wall kick handling
+*/
+int check_collision(Piece *p)
+{
+    ShapeBounds *b = &shapeBounds[p->type][p->rotation];
+
+    // Wall tests on the precomputed extent, no per-cell bounds checks
+    if (p->x + b->minX < 0 || p->x + b->maxX >= BOARD_WIDTH ||
+        p->y + b->minY < 0 || p->y + b->maxY >= BOARD_HEIGHT)
+    {
+        return COLLIDE_BOARD;
+    }
+
+    // Piece rows as board masks, tested against locked cells first
+    BoardRow bits[4];
+    for (int y = b->minY; y <= b->maxY; y++)
+    {
+        bits[y] = (BoardRow)shapeRowBits[p->type][p->rotation][y] << (p->x + b->minX);
+        if (board.occupied[p->y + y] & bits[y])
+        {
+            return COLLIDE_BOARD;
+        }
+    }
+
+    for (int y = b->minY; y <= b->maxY; y++)
+    {
+        if (inflightMask[p->y + y] & bits[y])
+        {
+            return COLLIDE_PIECE;
+        }
+    }
+    return COLLIDE_NONE;
+}
+
+/**
+* @brief Adds or removes a piece's cells in the shared in-flight mask
+* 
+* @param p Piece whose cells are flipped in inflightMask
+* 
+* In-flight pieces never overlap, so XOR both inserts a piece
+* (when absent) and lifts it out again (when present). Costs one
+* XOR per occupied shape row.
+*/
+void occupancy_toggle(Piece *p)
+{
+    ShapeBounds *b = &shapeBounds[p->type][p->rotation];
+    for (int y = b->minY; y <= b->maxY; y++)
+    {
+        inflightMask[p->y + y] ^= (BoardRow)shapeRowBits[p->type][p->rotation][y] << (p->x + b->minX);
+    }
+}
+
+/**
+* @brief Initializes the game board
+* 
+* 
+* Board initialization function that:
+* 1. Clears the color nibbles and occupancy rows
+* 2. Sets all cells to BLACK
+* 3. Covers full BOARD_WIDTH x BOARD_HEIGHT area
+* 4. Empties the in-flight piece mask
+* 
+* Called during:
+* - Game start
+* - Game restart
+* 
+* Draws nothing; the caller composes the screen afterwards
+* with redraw_screen()
+*/
+void init_board(void)
+{
+    // First clear the entire board
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        clear_row(y);
+        inflightMask[y] = 0;
+    }
+}
+
+
+/**
+* @brief Draws the next piece type from a shuffled 7-bag
+* 
+* @return Piece type (0-6)
+* 
+* 7-bag randomizer that:
+* 1. Refills the bag with one of each tetromino when empty
+* 2. Shuffles it with Fisher-Yates using my_rand()
+* 3. Hands pieces out from the end of the bag
+* 
+* Guarantees every type appears once per 7 spawns, so the
+* longest possible drought of a type is 12 pieces.
+*/
+int bag_next(void)
+{
+    if (bagCount == 0)
+    {
+        for (int i = 0; i < 7; i++)
+        {
+            bag[i] = i;
+        }
+        for (int i = 6; i > 0; i--)
+        {
+            int j = my_rand() % (i + 1);
+            int tmp = bag[i];
+            bag[i] = bag[j];
+            bag[j] = tmp;
+        }
+        bagCount = 7;
+    }
+    return bag[--bagCount];
+}
+
+/**
+* @brief Produces the piece that enters the back of the queue
+* 
+* Draws the type from the 7-bag and a random direction, or in
+* MODE_PUZZLE takes the next entry of the puzzle's fixed
+* sequence. Once that sequence is used up the entry has type
+* -1, which spawn_piece() treats as the puzzle being lost.
+*/
+QueueEntry queue_entry(void)
+{
+    QueueEntry entry;
+
+    if (gameMode == MODE_PUZZLE)
+    {
+        if (puzzleNext < puzzle->pieceCount)
+        {
+            uint8_t packed = puzzle->pieces[puzzleNext++];
+            entry.type = PUZZLE_PIECE_TYPE(packed);
+            entry.direction = PUZZLE_PIECE_DIRECTION(packed);
+        }
+        else
+        {
+            entry.type = -1;
+            entry.direction = DIR_DOWN;
+        }
+        return entry;
+    }
+
+    entry.type = bag_next();
+    entry.direction = my_rand() % 4;
+    return entry;
+}
+
+/**
+* @brief Resets the bag and fills the preview queue
+* 
+* Called at game start, before the first spawn_piece(). Marks
+* every preview slot dirty so the whole queue is painted once.
+*/
+void init_queue(void)
+{
+    bagCount = 0;
+    for (int i = 0; i < NEXT_QUEUE_SIZE; i++)
+    {
+        nextQueue[i] = queue_entry();
+    }
+    queueHead = 0;
+    queueMarkerSlot = -1;
+    queueDirty = (1 << NEXT_QUEUE_SIZE) - 1;
+}
+
+/**
+* @brief Takes the next piece off the queue and refills its slot
+* 
+* @return Type and spawn direction of the piece to spawn
+* 
+* The consumed slot is refilled in place from the bag and is
+* the only slot flagged for repaint; the head then advances to
+* the following slot.
+*/
+QueueEntry queue_pop(void)
+{
+    QueueEntry entry = nextQueue[queueHead];
+
+    nextQueue[queueHead] = queue_entry();
+    queueDirty |= 1 << queueHead;
+
+    queueHead = (queueHead + 1) % NEXT_QUEUE_SIZE;
+    return entry;
+}
+
+/* Increments a telemetry counter, sticking at its maximum */
+static void count_event(uint16_t *counter)
+{
+    if (*counter != 0xFFFF)
+    {
+        (*counter)++;
+    }
+}
+
+/**
+* @brief Ends the game and records why
+*
+* @param cause END_* reason
+* @param direction Direction of the blocked piece for END_TOPOUT
+*/
+void end_game(int cause, int direction)
+{
+    gameOver = 1;
+    count_event(&gameEnds[cause]);
+    if (cause == END_TOPOUT)
+    {
+        count_event(&topouts[direction]);
+    }
+}
+
+/**
+* @brief Creates and positions a new tetromino piece
+* 
+* @param slot activePieces index to fill
+* 
+* Piece generation function that:
+* 1. Piece initialization:
+*    - Takes piece type (0-6) and direction from the
+*      preview queue (7-bag randomizer, see queue_pop)
+*    - Sets initial rotation to 0
+* 
+* 2. Position setup:
+*    - Places piece at board center
+*    - X offset: SPAWN_X (GRAVITY_CENTER_X - 2)
+*    - Y offset: SPAWN_Y (GRAVITY_CENTER_Y - 2)
+*    - Accounts for 4x4 piece grid
+*    - MODE_QUAD shifts it two cells toward its direction
+*      (QUAD_SPAWN_DX/DY) so the four slots can coexist
+* 
+* 3. Direction assignment:
+*    - MODE_CLASSIC: queued random direction from:
+*      * DIR_DOWN (0)
+*      * DIR_UP (1)
+*      * DIR_LEFT (2)
+*      * DIR_RIGHT (3)
+*    - MODE_QUAD: the slot index is the direction
+* 
+* 4. Game over detection:
+*    - Sets gameOver flag if walls or locked cells block
+*      the spawn position
+*    - If only another in-flight piece is in the way, the
+*      piece waits in pendingSpawns and is retried on the
+*      next tick
+* 
+* Called:
+* - At game start
+* - After piece lock
+* - After line clear
+* 
+* Critical for game progression and difficulty
+*/
+void spawn_piece(int slot)
+{
+    Piece *p = &activePieces[slot];
+
+    // A piece that was blocked by another in-flight piece keeps its type
+    if (!(pendingSpawns & (1 << slot)))
+    {
+        QueueEntry next = queue_pop();
+        if (next.type < 0)
+        {
+            // Puzzle sequence used up without reaching the goal
+            end_game(END_NO_PIECES, 0);
+            return;
+        }
+        p->type = next.type;
+
+        // Direction was rolled when the piece entered the queue
+        p->direction = (gameMode == MODE_QUAD) ? slot : next.direction;
+    }
+    p->rotation = 0;
+
+    // Spawn in center of square board
+    p->x = SPAWN_X;
+    p->y = SPAWN_Y;
+    if (gameMode == MODE_QUAD)
+    {
+        p->x += QUAD_SPAWN_DX[slot];
+        p->y += QUAD_SPAWN_DY[slot];
+    }
+
+    if (slot == focusedPiece)
+    {
+        holdUsed = 0;
+    }
+
+    int hit = check_collision(p);
+    if (hit == COLLIDE_PIECE)
+    {
+        pendingSpawns |= 1 << slot;
+        return;
+    }
+    pendingSpawns &= ~(1 << slot);
+
+    if (hit == COLLIDE_BOARD)
+    {
+        end_game(END_TOPOUT, p->direction);
+        return;
+    }
+
+    occupancy_toggle(p);
+    activeSlots |= 1 << slot;
+}
+
+/**
+* @brief Swaps the current piece with the hold slot
+* 
+* 
+* Hold function that:
+* 1. Allows one hold per spawn (holdUsed, reset by spawn_piece),
+*    not in MODE_QUAD
+
+* 2. With an empty slot:
+*    - Does nothing when the queue has no next piece (end of
+*      a puzzle sequence), so the last piece stays in play
+*    - Stores the current piece type and direction
+*    - Spawns the next piece from the queue
+* 3. With an occupied slot:
+*    - Exchanges current and held type/direction
+*    - Restarts the swapped-in piece at the board center
+*      in rotation 0
+*    - Ends the game if the center is blocked, as spawn does
+* 4. Flags the hold preview for repaint
+* 
+* Called when the hold switch changes state
+*/
+void hold_piece(void)
+{
+    Piece *p = &activePieces[focusedPiece];
+
+    if (holdUsed || gameMode == MODE_QUAD || !(activeSlots & (1 << focusedPiece)))
+    {
+        return;
+    }
+
+    int swapType = heldType;
+    int swapDirection = heldDirection;
+
+    // Nothing to swap in: holding would end the puzzle with a piece in hand
+    if (swapType < 0 && nextQueue[queueHead].type < 0)
+    {
+        return;
+    }
+
+    heldType = p->type;
+    heldDirection = p->direction;
+
+    // Lift the piece out of play before replacing it
+    occupancy_toggle(p);
+    activeSlots &= ~(1 << focusedPiece);
+
+    if (swapType < 0)
+    {
+        spawn_piece(focusedPiece);
+    }
+    else
+    {
+        p->type = swapType;
+        p->direction = swapDirection;
+        p->rotation = 0;
+        p->x = SPAWN_X;
+        p->y = SPAWN_Y;
+
+        if (check_collision(p))
+        {
+            end_game(END_TOPOUT, p->direction);
+        }
+        else
+        {
+            occupancy_toggle(p);
+            activeSlots |= 1 << focusedPiece;
+        }
+    }
+
+    holdUsed = 1;
+    holdDirty = 1;
+}
+
+/**
+* @brief Fixes an in-flight tetromino to the game board
+* 
+* @param p Piece to lock, already lifted out of inflightMask
+* 
+* Piece locking function that:
+* 1. Shape processing:
+*    - Gets 16-bit shape pattern from TETROMINOS array
+*    - Uses the piece type and rotation
+*    - Processes each bit in 4x4 shape grid
+* 
+* 2. Board integration:
+*    - Converts active piece to static board cells
+*    - Maps piece type to color value (type + 1):
+*      * I piece → CYAN (1)
+*      * J piece → BLUE (2)
+*      * L piece → ORANGE (3)
+*      * O piece → YELLOW (4)
+*      * S piece → GREEN (5)
+*      * T piece → PURPLE (6)
+*      * Z piece → RED (7)
+* 
+* 3. Position translation:
+*    - Converts piece-relative coordinates to board coordinates
+*    - Uses p->x and p->y as offsets
+*    - Only fills empty cells: in MODE_QUAD another piece's
+*      line clear may have moved locked cells under this one
+* 
+* 4. Telemetry:
+*    - Counts every filled cell in lockHeat and the piece in
+*      directionLocks
+* 
+* Called when:
+* - Piece hits bottom/other pieces
+* - Collision detected in current direction
+* 
+* Triggers:
+* - Line clear checks
+* - New piece spawn
+*/
+void lock_piece(Piece *p)
+{
+    uint16_t shape = TETROMINOS[p->type][p->rotation];
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            if ((shape >> (15 - (y * 4 + x))) & 1 &&
+                !cell_occupied(p->x + x, p->y + y))
+            {
+                cell_set(p->x + x, p->y + y, p->type + 1);
+                count_event(&lockHeat[p->y + y][p->x + x]);
+            }
+        }
+    }
+    count_event(&directionLocks[p->direction]);
+}
+
+/**
+* @brief Builds the shape extent and direction-adapted kick tables
+* 
+* 
+* Startup table builder that:
+* 1. Shape extents:
+*    - Scans every TETROMINOS mask once
+*    - Stores min/max occupied column and row in shapeBounds
+*    - Stores each row as a board-order bit mask relative to
+*      minX in shapeRowBits, for inflightMask tests
+* 
+* 2. Kick tables:
+*    - BASE_KICKS is written for a piece moving DIR_DOWN
+*    - For each movement direction the offsets are rotated so
+*      "down" points along that direction:
+*      * DIR_DOWN:  ( dx,  dy)
+*      * DIR_UP:    (-dx, -dy)
+*      * DIR_LEFT:  (-dy,  dx)
+*      * DIR_RIGHT: ( dy, -dx)
+*    - Kicks therefore always prefer moving against the
+*      piece's own travel direction, like floor kicks do
+* 
+* Called once at startup, before the first rotation
+*/
+void init_shape_tables(void)
+{
+    for (int type = 0; type < 7; type++)
+    {
+        for (int rot = 0; rot < 4; rot++)
+        {
+            uint16_t shape = TETROMINOS[type][rot];
+            ShapeBounds b = {3, 0, 3, 0};
+            for (int y = 0; y < 4; y++)
+            {
+                for (int x = 0; x < 4; x++)
+                {
+                    if ((shape >> (15 - (y * 4 + x))) & 1)
+                    {
+                        if (x < b.minX) b.minX = x;
+                        if (x > b.maxX) b.maxX = x;
+                        if (y < b.minY) b.minY = y;
+                        if (y > b.maxY) b.maxY = y;
+                    }
+                }
+            }
+            shapeBounds[type][rot] = b;
+
+            for (int y = 0; y < 4; y++)
+            {
+                uint8_t bits = 0;
+                for (int x = b.minX; x <= b.maxX; x++)
+                {
+                    if ((shape >> (15 - (y * 4 + x))) & 1)
+                    {
+                        bits |= 1 << (x - b.minX);
+                    }
+                }
+                shapeRowBits[type][rot][y] = bits;
+            }
+        }
+    }
+
+    for (int cls = 0; cls < 3; cls++)
+    {
+        for (int from = 0; from < 4; from++)
+        {
+            for (int i = 0; i < KICK_TEST_COUNT[cls]; i++)
+            {
+                int dx = BASE_KICKS[cls][from][i][0];
+                int dy = BASE_KICKS[cls][from][i][1];
+
+                kickTable[DIR_DOWN][cls][from][i][0] = dx;
+                kickTable[DIR_DOWN][cls][from][i][1] = dy;
+                kickTable[DIR_UP][cls][from][i][0] = -dx;
+                kickTable[DIR_UP][cls][from][i][1] = -dy;
+                kickTable[DIR_LEFT][cls][from][i][0] = -dy;
+                kickTable[DIR_LEFT][cls][from][i][1] = dx;
+                kickTable[DIR_RIGHT][cls][from][i][0] = dy;
+                kickTable[DIR_RIGHT][cls][from][i][1] = -dx;
+            }
+        }
+    }
+}
+
+/**
+* @brief Attempts to rotate a piece 90 degrees clockwise
+* 
+* @param p In-flight piece to rotate
+* 
+* Piece rotation function that:
+* 1. Rotation state management:
+*    - Advances rotation by 1 position
+*    - Uses modulo 4 to cycle through states (0->1->2->3->0)
+* 
+* 2. Wall kicks:
+*    - Looks up the kick list for the piece class (I, O or
+*      J/L/S/T/Z), the rotation transition and the piece's
+*      movement direction in kickTable
+*    - Tries each offset in order with check_collision(),
+*      which only touches the shape mask and its extent
+*    - Keeps the first position that fits
+*    - The piece is lifted out of inflightMask while the
+*      kicks are tested and put back afterwards
+* 
+* 3. Rotation recovery:
+*    - Leaves the piece untouched if every kick collides
+* 
+* Called when:
+* - Button press detected
+* - User requests rotation
+* 
+* Core gameplay mechanic for piece manipulation
+*/
+void rotate_piece(Piece *p)
+{
+    int from = p->rotation;
+    int cls = PIECE_KICK_CLASS[p->type];
+    int8_t (*kicks)[2] = kickTable[p->direction][cls][from];
+    Piece test = *p;
+
+    occupancy_toggle(p);
+    test.rotation = (from + 1) % 4;
+    for (int i = 0; i < KICK_TEST_COUNT[cls]; i++)
+    {
+        test.x = p->x + kicks[i][0];
+        test.y = p->y + kicks[i][1];
+        if (!check_collision(&test))
+        {
+            *p = test;
+            break;
+        }
+    }
+    occupancy_toggle(p);
+}
+
+/* Columns on each side of the gravity center, as row masks */
+#define LEFT_HALF (((BoardRow)1 << GRAVITY_CENTER_X) - 1)
+#define RIGHT_HALF (BOARD_FULL_ROW & ~LEFT_HALF)
+
+/**
+* @brief Widens eight occupancy bits to a mask of their color nibbles
+* 
+* @param bits Cells 0-7 of a color word, bit 0 first
+* @return 0xF in every nibble whose bit is set
+* 
+* Three shift-and-mask steps spread the bits four apart and a
+* multiply fills each nibble, so no table and no loop.
+*/
+static inline uint32_t nibble_mask(uint32_t bits)
+{
+    bits &= 0xFF;
+    bits = (bits | bits << 12) & 0x000F000F;
+    bits = (bits | bits << 6) & 0x03030303;
+    bits = (bits | bits << 3) & 0x11111111;
+    return bits * 0xF;
+}
+
+/**
+* @brief Moves the blocks of one row into the empty cells of a neighbour row
+* 
+* @param from Row the blocks leave
+* @param to Row above or below it
+* @return 1 if any block moved
+* 
+* One step of vertical gravity for every half-column at once:
+* a block moves where the cell in front of it is empty, which
+* is a single AND NOT of the two occupancy rows. Its color
+* nibbles follow word by word under the widened mask.
+*/
+static int fall_row(int from, int to)
+{
+    BoardRow moving = board.occupied[from] & ~board.occupied[to];
+    if (!moving)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < BOARD_ROW_WORDS; i++)
+    {
+        uint32_t nibbles = nibble_mask((uint32_t)(moving >> (i * 8)));
+        board.colors[to][i] |= board.colors[from][i] & nibbles;
+        board.colors[from][i] &= ~nibbles;
+    }
+    board.occupied[to] |= moving;
+    board.occupied[from] &= ~moving;
+    boardDirty[to] |= moving;
+    boardDirty[from] |= moving;
+    return 1;
+}
+
+/**
+* @brief Moves every loose block of one half-row a cell toward its edge
+* 
+* @param y Board row
+* @param right Non-zero for the right half falling right,
+*              zero for the left half falling left
+* @return 1 if any block moved
+* 
+* One step of horizontal gravity for a whole half-row:
+* 1. The blocks already resting against the edge are the run
+*    of ones at that end of the half: m & ~(m + 1) for the
+*    left half, or the blocks above the highest hole (holes
+*    smeared downward) for the right half
+* 2. Every other block moves one cell, a single shift of the
+*    occupancy bits; a block stacked on a moving one moves
+*    with it, as it would in a cell-by-cell sweep toward the
+*    edge
+* 3. The color nibbles under the moving blocks are lifted out
+*    of the row and put back one nibble over, carrying
+*    between words
+*/
+static int slide_row(int y, int right)
+{
+    BoardRow occupied = board.occupied[y];
+    BoardRow moving;
+    BoardRow moved;
+
+    if (right)
+    {
+        BoardRow holes = ~occupied & RIGHT_HALF;
+        for (int shift = 1; shift < BOARD_WIDTH; shift <<= 1)
+        {
+            holes |= holes >> shift;
+        }
+        moving = occupied & RIGHT_HALF & holes;
+        moved = moving << 1;
+    }
+    else
+    {
+        BoardRow half = occupied & LEFT_HALF;
+        moving = half & (half + 1);
+        moved = moving >> 1;
+    }
+    if (!moving)
+    {
+        return 0;
+    }
+
+    uint32_t *row = board.colors[y];
+    uint32_t lifted[BOARD_ROW_WORDS];
+    for (int i = 0; i < BOARD_ROW_WORDS; i++)
+    {
+        uint32_t nibbles = nibble_mask((uint32_t)(moving >> (i * 8)));
+        lifted[i] = row[i] & nibbles;
+        row[i] &= ~nibbles;
+    }
+    for (int i = 0; i < BOARD_ROW_WORDS; i++)
+    {
+        if (right)
+        {
+            row[i] |= lifted[i] << 4 | (i > 0 ? lifted[i - 1] >> 28 : 0);
+        }
+        else
+        {
+            row[i] |= lifted[i] >> 4 | (i + 1 < BOARD_ROW_WORDS ? lifted[i + 1] << 28 : 0);
+        }
+    }
+    board.occupied[y] = (occupied & ~moving) | moved;
+    boardDirty[y] |= moving | moved;
+    return 1;
+}
+
+/**
+* @brief Applies quad-directional gravity effects after line clears
+* 
+* @param clearedRow Index of cleared horizontal line (-1 if none)
+* @param clearedCol Index of cleared vertical line (-1 if none)
+* 
+* Complex gravity simulation function that:
+* 1. Coordinate system:
+*    - Uses board center as gravity pivot point
+*    - GRAVITY_CENTER_X/Y split the board into halves
+* 
+* 2. Horizontal line clear handling:
+*    - Above center: blocks fall upward, rows swept from
+*      y=1 to the center with fall_row()
+*    - Below center: blocks fall downward, rows swept from
+*      the bottom up to the center
+*    - Each row step moves the blocks of every column at once
+* 
+* 3. Vertical line clear handling:
+*    - Right of center: every half-row falls rightward
+*    - Left of center: every half-row falls leftward
+*    - One slide_row() per half-row instead of a sweep over
+*      its cells
+* 
+* 4. Settling:
+*    - Each pass moves every loose block one cell, exactly
+*      like the cell-by-cell sweeps of gravity_reference()
+*    - Repeats until no more movements possible, all
+*      within the current frame
+*    - Moved cells are only flagged in boardDirty; the
+*      repaint is left to draw_deferred() so a big settle
+*      cannot stall the frame loop
+* 
+* Called after:
+* - Line clear detection
+* - Before spawning new piece
+* 
+* Creates unique gameplay mechanic with
+* quad-directional gravity based on board position
+*/
+void apply_gravity(int clearedRow, int clearedCol)
+{
+    int changes;
+
+    trace_begin("apply_gravity");
+    do
+    {
+        changes = 0;
+
+        // If a row was cleared (horizontal line clear)
+        if (clearedRow != -1)
+        {
+            if (clearedRow < GRAVITY_CENTER_Y)
+            {
+                for (int y = 1; y < GRAVITY_CENTER_Y; y++)
+                {
+                    changes |= fall_row(y, y - 1);
+                }
+            }
+            else
+            {
+                for (int y = BOARD_HEIGHT - 2; y >= GRAVITY_CENTER_Y; y--)
+                {
+                    changes |= fall_row(y, y + 1);
+                }
+            }
+        }
+
+        // If a column was cleared (vertical line clear)
+        if (clearedCol != -1)
+        {
+            for (int y = 0; y < BOARD_HEIGHT; y++)
+            {
+                changes |= slide_row(y, clearedCol >= GRAVITY_CENTER_X);
+            }
+        }
+    } while (changes); // Keep applying gravity until no more changes occur
+    trace_end("apply_gravity");
+}
+
+#ifdef GRAVITY_CHECK
+#ifdef HOST_BUILD
+#include <stdlib.h> // exit()
+#else
+extern void handle_exception(unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+#endif
+
+/* Moves a locked block one step into an empty neighbour */
+static int fall_cell(int x, int y, int toX, int toY)
+{
+    if (!cell_occupied(x, y) || cell_occupied(toX, toY))
+    {
+        return 0;
+    }
+    cell_set(toX, toY, cell_get(x, y));
+    cell_set(x, y, BLACK);
+    return 1;
+}
+
+/**
+* @brief Cell-by-cell gravity, the reference apply_gravity() must match
+* 
+* Sweeps every half-column and half-row toward its edge one
+* cell at a time and repeats until nothing moves.
+*/
+static void gravity_reference(int clearedRow, int clearedCol)
+{
+    int changes;
+
+    do
+    {
+        changes = 0;
+        if (clearedRow != -1)
+        {
+            if (clearedRow < GRAVITY_CENTER_Y)
+            {
+                for (int y = 1; y < GRAVITY_CENTER_Y; y++)
+                {
+                    for (int x = 0; x < BOARD_WIDTH; x++)
+                    {
+                        changes += fall_cell(x, y, x, y - 1);
+                    }
+                }
+            }
+            else
+            {
+                for (int y = BOARD_HEIGHT - 2; y >= GRAVITY_CENTER_Y; y--)
+                {
+                    for (int x = 0; x < BOARD_WIDTH; x++)
+                    {
+                        changes += fall_cell(x, y, x, y + 1);
+                    }
+                }
+            }
+        }
+        if (clearedCol != -1)
+        {
+            for (int y = 0; y < BOARD_HEIGHT; y++)
+            {
+                if (clearedCol >= GRAVITY_CENTER_X)
+                {
+                    for (int x = BOARD_WIDTH - 2; x >= GRAVITY_CENTER_X; x--)
+                    {
+                        changes += fall_cell(x, y, x + 1, y);
+                    }
+                }
+                else
+                {
+                    for (int x = 1; x < GRAVITY_CENTER_X; x++)
+                    {
+                        changes += fall_cell(x, y, x - 1, y);
+                    }
+                }
+            }
+        }
+    } while (changes > 0);
+}
+
+/**
+* @brief Checks apply_gravity() against gravity_reference()
+* 
+* Settles random boards of every density with both versions,
+* for each combination of cleared row and column side, and
+* compares colors and occupancy cell by cell. Prints the
+* number of boards that differ over the UART. Any mismatch
+* stops the program: the host build exits with status 1, the
+* board parks in handle_exception(). On a pass the board is
+* left empty and the game starts as usual.
+* 
+* Run as a gate on the host (from the repository root), once
+* per BOARD_CONFIG:
+*   cc -O2 -DHOST_BUILD -DGRAVITY_CHECK -o tetris-gravity-check tetris.c link.c hypergrid.c puzzles.c pool.c profile.c host/dtekv-host.c host/link-pipe.c
+*   echo q | TETRIS_FAST=1 ./tetris-gravity-check
+*/
+void gravity_self_check(void)
+{
+    static const int clears[8][2] = {
+        {0, -1}, {BOARD_HEIGHT - 1, -1}, {-1, 0}, {-1, BOARD_WIDTH - 1},
+        {0, 0}, {0, BOARD_WIDTH - 1}, {BOARD_HEIGHT - 1, 0}, {BOARD_HEIGHT - 1, BOARD_WIDTH - 1}};
+    unsigned int seed = 1;
+    int mismatches = 0;
+    int boards = 0;
+
+    for (int round = 0; round < 64; round++)
+    {
+        for (int c = 0; c < 8; c++)
+        {
+            for (int y = 0; y < BOARD_HEIGHT; y++)
+            {
+                for (int x = 0; x < BOARD_WIDTH; x++)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    int filled = ((seed >> 16) & 7) < (round & 7);
+                    cell_set(x, y, filled ? 1 + (seed >> 20) % GARBAGE : BLACK);
+                }
+            }
+
+            Board start = board;
+            gravity_reference(clears[c][0], clears[c][1]);
+            Board expected = board;
+            board = start;
+            apply_gravity(clears[c][0], clears[c][1]);
+
+            int same = 1;
+            for (int y = 0; y < BOARD_HEIGHT; y++)
+            {
+                same &= board.occupied[y] == expected.occupied[y];
+                for (int x = 0; x < BOARD_WIDTH; x++)
+                {
+                    same &= (uint32_t)cell_get(x, y) == ((expected.colors[y][x >> 3] >> ((x & 7) * 4)) & 0xF);
+                }
+            }
+            mismatches += !same;
+            boards++;
+        }
+    }
+
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        clear_row(y);
+    }
+    print("gravity check: ");
+    print_dec(boards);
+    print(" boards, ");
+    print_dec(mismatches);
+    print(" mismatches\n");
+    if (mismatches)
+    {
+#ifdef HOST_BUILD
+        exit(1);
+#else
+        handle_exception((unsigned)(uintptr_t)apply_gravity, 0, 0, 0, 0, 0, 24, 0); // Unknown error, parks
+#endif
+    }
+}
+#endif
+
+/**
+* @brief Turns a multi-line clear into garbage for the peer
+* 
+* @param linesCleared Rows plus columns cleared by one lock
+* 
+* A double sends 1 line, a triple 2, and four or more lines
+* send one each. Lines still waiting in pendingGarbage are
+* cancelled first; only the rest is queued on the link, which
+* batches everything into the frame's single packet.
+*/
+void send_garbage(int linesCleared)
+{
+    int lines = (linesCleared >= 4) ? linesCleared : linesCleared - 1;
+    int cancelled = (lines < pendingGarbage) ? lines : pendingGarbage;
+
+    pendingGarbage -= cancelled;
+    lines -= cancelled;
+    if (lines > 0)
+    {
+        link_queue_event(LINK_EV_GARBAGE, lines);
+    }
+}
+
+/**
+* @brief Moves a run of packed board color bytes, overlapping runs allowed
+* 
+* @param dst First destination byte in board.colors
+* @param src First source byte
+* @param len Number of bytes (two cells each)
+* 
+* Board counterpart of copy_span(): copies in the safe
+* direction for overlapping runs and uses word copies when
+* source and destination share the same alignment.
+*/
+void move_cells(uint8_t *dst, const uint8_t *src, int len)
+{
+    int aligned = (((uintptr_t)dst ^ (uintptr_t)src) & 3) == 0;
+
+    if (dst < src)
+    {
+        if (aligned)
+        {
+            while (len > 0 && ((uintptr_t)dst & 3))
+            {
+                *dst++ = *src++;
+                len--;
+            }
+            uint32_t *wordDst = (uint32_t *)dst;
+            const uint32_t *wordSrc = (const uint32_t *)src;
+            for (; len >= 4; len -= 4)
+            {
+                *wordDst++ = *wordSrc++;
+            }
+            dst = (uint8_t *)wordDst;
+            src = (const uint8_t *)wordSrc;
+        }
+        while (len-- > 0)
+        {
+            *dst++ = *src++;
+        }
+    }
+    else if (dst > src)
+    {
+        dst += len;
+        src += len;
+        if (aligned)
+        {
+            while (len > 0 && ((uintptr_t)dst & 3))
+            {
+                *--dst = *--src;
+                len--;
+            }
+            uint32_t *wordDst = (uint32_t *)dst;
+            const uint32_t *wordSrc = (const uint32_t *)src;
+            for (; len >= 4; len -= 4)
+            {
+                *--wordDst = *--wordSrc;
+            }
+            dst = (uint8_t *)wordDst;
+            src = (const uint8_t *)wordSrc;
+        }
+        while (len-- > 0)
+        {
+            *--dst = *--src;
+        }
+    }
+}
+
+/**
+* @brief Sets a run of packed board color bytes to one color
+* 
+* @param dst First byte in board.colors
+* @param len Number of bytes (two cells each)
+* @param color Game color index
+* 
+* Board counterpart of fill_span(), with word stores for the
+* aligned middle of the run. Occupancy rows and boardDirty are
+* the caller's.
+*/
+void fill_cells(uint8_t *dst, int len, char color)
+{
+    uint8_t pair = (color & 0xF) * 0x11;
+
+    while (len > 0 && ((uintptr_t)dst & 3))
+    {
+        *dst++ = pair;
+        len--;
+    }
+
+    uint32_t word = pair * 0x01010101u;
+    uint32_t *wordDst = (uint32_t *)dst;
+    for (; len >= 4; len -= 4)
+    {
+        *wordDst++ = word;
+    }
+
+    dst = (uint8_t *)wordDst;
+    while (len-- > 0)
+    {
+        *dst++ = pair;
+    }
+}
+
+/**
+* @brief Sets a run of cells within one board row to one color
+* 
+* @param y Board row
+* @param x First cell of the run
+* @param len Number of cells, ending at or before BOARD_WIDTH
+* @param color Game color index, BLACK to empty the cells
+* 
+* A run starting or ending halfway through a byte gets its odd
+* nibble patched; the whole bytes between go to fill_cells().
+* Occupancy and boardDirty take the run as one bit range.
+*/
+static void fill_row_cells(int y, int x, int len, char color)
+{
+    BoardRow run = (BOARD_FULL_ROW >> (BOARD_WIDTH - len)) << x;
+    uint8_t *bytes = (uint8_t *)board.colors[y];
+    uint8_t nibble = color & 0xF;
+    int end = x + len;
+
+    if (x & 1)
+    {
+        bytes[x >> 1] = (bytes[x >> 1] & 0x0F) | nibble << 4;
+        x++;
+    }
+    if ((end & 1) && x < end)
+    {
+        bytes[end >> 1] = (bytes[end >> 1] & 0xF0) | nibble;
+        end--;
+    }
+    fill_cells(bytes + (x >> 1), (end - x) >> 1, color);
+
+    if (color != BLACK)
+    {
+        board.occupied[y] |= run;
+    }
+    else
+    {
+        board.occupied[y] &= ~run;
+    }
+    boardDirty[y] |= run;
+}
+
+/**
+* @brief Shifts a row of packed colors by whole cells
+* 
+* @param dst BOARD_ROW_WORDS words receiving the shifted row
+* @param src Color row of board.colors
+* @param cells Cells to move toward higher x, negative for lower x
+* 
+* Each word takes its part from two source words, the same
+* cross-word carry slide_row() uses for a one-cell step.
+* Cells shifted in from outside the row are BLACK.
+*/
+static void shift_row_colors(uint32_t *dst, const uint32_t *src, int cells)
+{
+    int right = cells > 0;
+    int n = right ? cells : -cells;
+    int words = n >> 3;
+    int bits = (n & 7) * 4;
+
+    for (int i = 0; i < BOARD_ROW_WORDS; i++)
+    {
+        int from = right ? i - words : i + words;
+        int carry = right ? from - 1 : from + 1;
+        uint32_t word = 0;
+        if (from >= 0 && from < BOARD_ROW_WORDS)
+        {
+            word = right ? src[from] << bits : src[from] >> bits;
+        }
+        if (bits && carry >= 0 && carry < BOARD_ROW_WORDS)
+        {
+            word |= right ? src[carry] >> (32 - bits) : src[carry] << (32 - bits);
+        }
+        dst[i] = word;
+    }
+}
+
+/**
+* @brief Pushes garbage lines into the board from one edge
+* 
+* @param edge Edge the lines enter from: DIR_DOWN (bottom),
+*             DIR_UP (top), DIR_LEFT or DIR_RIGHT
+* @param lines Number of garbage lines
+* @return 1 if locked blocks were pushed past the center
+* 
+* 
+* Garbage engine that:
+* 1. Overflow check:
+*    - The half of the board on the given side of
+*      GRAVITY_CENTER_X/Y (the same halves apply_gravity()
+*      uses) moves lines cells toward the center
+*    - The lines nearest the center are pushed out; any
+*      occupancy bit in them means the stack overflowed
+* 
+* 2. Shift, done once for the whole batch:
+*    - Rows are contiguous, so a top or bottom edge moves the
+*      packed colors of the entire half with one move_cells()
+*      call and the occupancy rows with one word per row
+*    - A left or right edge shifts each row's occupancy mask
+*      once and its color words with shift_row_colors(),
+*      then masks the half back in along with the new lines
+*    - Work is independent of the line count apart from
+*      punching the holes
+* 
+* 3. New lines:
+*    - Filled with GARBAGE blocks
+*    - Each line gets its own random hole
+* 
+* No piece may be in flight in the affected half. Changed
+* rows are flagged in boardDirty for draw_deferred()
+*/
+int inject_garbage(int edge, int lines)
+{
+    int vertical = (edge == DIR_DOWN || edge == DIR_UP);
+    int half;
+    int overflow = 0;
+
+    switch (edge)
+    {
+    case DIR_DOWN:
+        half = BOARD_HEIGHT - GRAVITY_CENTER_Y;
+        break;
+    case DIR_UP:
+        half = GRAVITY_CENTER_Y;
+        break;
+    case DIR_LEFT:
+        half = GRAVITY_CENTER_X;
+        break;
+    default:
+        half = BOARD_WIDTH - GRAVITY_CENTER_X;
+        break;
+    }
+    if (lines <= 0)
+    {
+        return 0;
+    }
+    if (lines > half)
+    {
+        lines = half;
+        overflow = 1;
+    }
+
+    // First row/column of the half nearest the center, and the
+    // first of the lines pushed out there
+    int inner = (edge == DIR_DOWN) ? GRAVITY_CENTER_Y : (edge == DIR_RIGHT) ? GRAVITY_CENTER_X : 0;
+    int lost = (edge == DIR_UP) ? GRAVITY_CENTER_Y - lines : (edge == DIR_LEFT) ? GRAVITY_CENTER_X - lines : inner;
+
+    if (vertical)
+    {
+        for (int y = lost; y < lost + lines; y++)
+        {
+            overflow |= board.occupied[y] != 0;
+        }
+
+        int keep = half - lines;
+        if (edge == DIR_DOWN)
+        {
+            move_cells((uint8_t *)board.colors[inner], (uint8_t *)board.colors[inner + lines], keep * BOARD_ROW_BYTES);
+            for (int y = inner; y < inner + keep; y++)
+            {
+                board.occupied[y] = board.occupied[y + lines];
+            }
+        }
+        else
+        {
+            move_cells((uint8_t *)board.colors[lines], (uint8_t *)board.colors[0], keep * BOARD_ROW_BYTES);
+            for (int y = lines + keep - 1; y >= lines; y--)
+            {
+                board.occupied[y] = board.occupied[y - lines];
+            }
+        }
+
+        int first = (edge == DIR_DOWN) ? BOARD_HEIGHT - lines : 0;
+        fill_cells((uint8_t *)board.colors[first], lines * BOARD_ROW_BYTES, GARBAGE);
+        for (int y = first; y < first + lines; y++)
+        {
+            board.occupied[y] = BOARD_FULL_ROW;
+            cell_set(my_rand() % BOARD_WIDTH, y, BLACK);
+        }
+
+        // Every row of the half moved as a whole
+        int top = (edge == DIR_DOWN) ? inner : 0;
+        for (int y = top; y < top + half; y++)
+        {
+            boardDirty[y] = BOARD_FULL_ROW;
+        }
+    }
+    else
+    {
+        int first = (edge == DIR_RIGHT) ? BOARD_WIDTH - lines : 0;
+        int step = (edge == DIR_RIGHT) ? -lines : lines;
+        BoardRow halfMask = (edge == DIR_RIGHT) ? RIGHT_HALF : LEFT_HALF;
+        BoardRow lostMask = (BOARD_FULL_ROW >> (BOARD_WIDTH - lines)) << lost;
+        BoardRow garbageMask = (BOARD_FULL_ROW >> (BOARD_WIDTH - lines)) << first;
+        BoardRow keepMask = halfMask & ~garbageMask;
+        uint32_t garbageWord = (uint32_t)GARBAGE * 0x11111111u;
+
+        for (int y = 0; y < BOARD_HEIGHT; y++)
+        {
+            BoardRow occupied = board.occupied[y];
+            BoardRow shifted = (edge == DIR_RIGHT) ? occupied >> lines : occupied << lines;
+            overflow |= (occupied & lostMask) != 0;
+            board.occupied[y] = (occupied & ~halfMask) | (shifted & keepMask) | garbageMask;
+
+            uint32_t *row = board.colors[y];
+            uint32_t moved[BOARD_ROW_WORDS];
+            shift_row_colors(moved, row, step);
+            for (int i = 0; i < BOARD_ROW_WORDS; i++)
+            {
+                uint32_t half = nibble_mask((uint32_t)(halfMask >> (i * 8)));
+                uint32_t keep = nibble_mask((uint32_t)(keepMask >> (i * 8)));
+                uint32_t garbage = nibble_mask((uint32_t)(garbageMask >> (i * 8)));
+                row[i] = (row[i] & ~half) | (moved[i] & keep) | (garbageWord & garbage);
+            }
+            boardDirty[y] |= halfMask;
+        }
+        for (int x = first; x < first + lines; x++)
+        {
+            cell_set(x, my_rand() % BOARD_HEIGHT, BLACK);
+        }
+    }
+
+    return overflow;
+}
+
+/**
+* @brief Pushes pending versus garbage into the board
+* 
+* The whole batch enters from one randomly chosen edge through
+* inject_garbage(); the game ends if the stack is pushed past
+* the center. Called after a lock, before the next spawn, so
+* no piece is in flight while lines move.
+*/
+void insert_garbage(void)
+{
+    if (pendingGarbage == 0)
+    {
+        return;
+    }
+
+    if (inject_garbage(my_rand() % 4, pendingGarbage))
+    {
+        end_game(END_GARBAGE, 0);
+    }
+    pendingGarbage = 0;
+}
+
+/**
+* @brief Adds the score for one lock and speeds the game up
+* 
+* @param linesCleared Lines (rows, columns or hyperplanes)
+*                     cleared by the lock
+* 
+* Shared by check_lines() and the 4D mode; see check_lines()
+* for the score table and speed formula.
+*/
+void score_lines(int linesCleared)
+{
+    // Update score
+    switch (linesCleared)
+    {
+    case 1:
+        score += SCORE_SINGLE;
+        if (speed > 1000)
+        {
+            speed -= score * 400;
+        }
+
+        break;
+    case 2:
+        score += SCORE_DOUBLE;
+        if (speed > 1000)
+        {
+            speed -= score * 400 * 2;
+        }
+        break;
+    case 3:
+        score += SCORE_TRIPLE;
+        if (speed > 1000)
+        {
+            speed -= score * 400 * 3;
+        }
+        break;
+    case 4:
+        score += SCORE_TETRIS;
+        if (speed > 1000)
+        {
+            speed -= score * 400 * 4;
+        }
+        break;
+    }
+
+    int periodLow = (speed) & 0xFFFF;
+    int periodHigh = (speed >> 16) & 0xFFFF;
+    *TIMER_PERIODL = periodLow;
+    *TIMER_PERIODH = periodHigh;
+}
+
+/**
+* @brief Starts a puzzle from puzzles.c
+* 
+* @param index Puzzle number, wrapped to the puzzles available
+* @return 0 if no puzzle fits this board size
+* 
+* 
+* Loader function that:
+* 1. Picks the index-th puzzle laid out for BOARD_WIDTH x
+*    BOARD_HEIGHT, counting modulo the number of such puzzles
+* 2. Decodes its board runs directly into the board: runs
+*    are in row-major cell order like the board itself, so
+*    each run is one fill_row_cells() call per row it covers
+* 3. Resets the piece sequence and the line goal
+* 
+* Called after init_board() and before init_queue(), which
+* reads the puzzle's piece sequence
+*/
+int start_puzzle(int index)
+{
+    int matching = 0;
+    for (int i = 0; i < PUZZLE_COUNT; i++)
+    {
+        matching += (PUZZLES[i].width == BOARD_WIDTH && PUZZLES[i].height == BOARD_HEIGHT);
+    }
+    if (matching == 0)
+    {
+        return 0;
+    }
+
+    index %= matching;
+    for (puzzle = PUZZLES; ; puzzle++)
+    {
+        if (puzzle->width == BOARD_WIDTH && puzzle->height == BOARD_HEIGHT && index-- == 0)
+        {
+            break;
+        }
+    }
+
+    int x = 0;
+    int y = 0;
+    const uint8_t *run = puzzle->cells;
+    while (y < BOARD_HEIGHT)
+    {
+        int color = *run >> 4;
+        int length = (*run & 0xF) + 1;
+        if (length == 16)
+        {
+            length += *++run;
+        }
+        run++;
+
+        // Runs continue across row ends
+        while (length > 0 && y < BOARD_HEIGHT)
+        {
+            int span = (BOARD_WIDTH - x < length) ? BOARD_WIDTH - x : length;
+            fill_row_cells(y, x, span, color);
+            length -= span;
+            x += span;
+            if (x == BOARD_WIDTH)
+            {
+                x = 0;
+                y++;
+            }
+        }
+    }
+
+    puzzleNext = 0;
+    puzzleLinesLeft = puzzle->goalLines;
+    return 1;
+}
+
+/**
+* @brief Drops every particle without repainting, for a fresh screen
+*
+* Called whenever the whole screen is redrawn (game start,
+* snapshot restore), since the cells under the particles are
+* repainted anyway.
+*/
+void init_particles(void)
+{
+    pool_init(&particlePool, particleStorage, sizeof(Particle), PARTICLE_CAPACITY);
+    liveParticles = 0;
+}
+
+/* Small xorshift for particle jitter, separate from my_rand() */
+static int particle_rand(void)
+{
+    particleRand ^= particleRand << 13;
+    particleRand ^= particleRand >> 17;
+    particleRand ^= particleRand << 5;
+    return particleRand & 0x7fff;
+}
+
+/**
+* @brief Bursts a clearing cell into a particle
+*
+* @param x Board grid X-coordinate of the cell
+* @param y Board grid Y-coordinate of the cell
+* @param color Game color of the cell before it is cleared
+*
+* The particle starts at the cell center and flies away from
+* the gravity center, faster the farther out the cell is, with
+* some random jitter. When the pool is exhausted the cell
+* simply gets no particle.
+*/
+void spawn_particle(int x, int y, char color)
+{
+    Particle *p = pool_alloc(&particlePool);
+    if (!p)
+    {
+        return;
+    }
+
+    p->x = (BOARD_START_X + x * BLOCK_SIZE + (BLOCK_SIZE - PARTICLE_PX) / 2) << 8;
+    p->y = (BOARD_START_Y + y * BLOCK_SIZE + (BLOCK_SIZE - PARTICLE_PX) / 2) << 8;
+    p->vx = (x - GRAVITY_CENTER_X) * PARTICLE_SPEED * UI_SCALE +
+            particle_rand() % (2 * PARTICLE_JITTER + 1) - PARTICLE_JITTER;
+    p->vy = (y - GRAVITY_CENTER_Y) * PARTICLE_SPEED * UI_SCALE +
+            particle_rand() % (2 * PARTICLE_JITTER + 1) - PARTICLE_JITTER;
+    p->life = PARTICLE_LIFE;
+    p->vgaColor = get_vga_color(color);
+    p->next = liveParticles;
+    liveParticles = p;
+}
+
+/**
+* @brief Advances every live particle
+*
+* Particle update function that:
+* 1. Flags the tiles under the particle's old square
+* 2. Counts down each particle's life and moves it by its
+*    velocity, which decays by 1/8 per frame
+* 3. Returns expired particles and those leaving the board
+*    area to the pool (O(1) each)
+* 4. Flags the tiles under the survivors' new squares
+*
+* Draws nothing itself: the particles are the top compositor
+* layer, so draw_deferred() paints them over the board and
+* restores what they leave. Called once per frame after the
+* rules, before draw_deferred().
+*/
+void update_particles(void)
+{
+    Particle **link = &liveParticles;
+
+    while (*link)
+    {
+        Particle *p = *link;
+        mark_dirty(p->x >> 8, p->y >> 8, PARTICLE_PX, PARTICLE_PX);
+        p->x += p->vx;
+        p->y += p->vy;
+        p->vx -= p->vx / 8;
+        p->vy -= p->vy / 8;
+
+        int px = p->x >> 8;
+        int py = p->y >> 8;
+        if (--p->life == 0 ||
+            px < BOARD_START_X || px + PARTICLE_PX > BOARD_START_X + BOARD_WIDTH * BLOCK_SIZE ||
+            py < BOARD_START_Y || py + PARTICLE_PX > BOARD_START_Y + BOARD_HEIGHT * BLOCK_SIZE)
+        {
+            *link = p->next;
+            pool_free(&particlePool, p);
+            continue;
+        }
+
+        mark_dirty(px, py, PARTICLE_PX, PARTICLE_PX);
+        link = &p->next;
+    }
+}
+
+/**
+* @brief Checks for and processes completed lines, updates score and speed
+* 
+* 
+* Comprehensive line clearing function that:
+* 1. Line detection:
+*    - Checks horizontal rows and vertical columns
+*    - Tracks number of lines cleared simultaneously
+*    - Records positions of last cleared row/column
+*    - Marks complete lines by setting cells to BLACK
+* 
+* 2. Scoring system:
+*    - SCORE_SINGLE (100): 1 line
+*    - SCORE_DOUBLE (300): 2 lines
+*    - SCORE_TRIPLE (500): 3 lines
+*    - SCORE_TETRIS (800): 4 lines
+* 
+* 3. Speed adjustment:
+*    - Decreases timer period based on:
+*      * Current score
+*      * Number of lines cleared
+*      * Base multiplier of 400
+*    - Has minimum speed threshold of 1000
+*    - Updates timer hardware registers:
+*      * TIMER_PERIODL: Lower 16 bits
+*      * TIMER_PERIODH: Upper 16 bits
+* 
+* 4. Follow-up actions:
+*    - Triggers gravity effects if lines cleared
+*    - Flags the score bar for repaint (scoreDirty)
+*    - Changed cells are already flagged in boardDirty
+* 
+* Called after:
+* - Piece locking
+* - Before spawning new piece
+* 
+* Core scoring and difficulty progression mechanic
+* Unique vertical line clear feature
+*/
+void check_lines(void)
+{
+    int linesCleared = 0;
+    int lastClearedRow = -1;
+    int lastClearedCol = -1;
+
+    trace_begin("check_lines");
+
+    // Check horizontal lines, one compare per row
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        if (board.occupied[y] == BOARD_FULL_ROW)
+        {
+            linesCleared++;
+            lastClearedRow = y;
+            count_event(&rowClears[y]);
+            // Clear the completed row
+            for (int x = 0; x < BOARD_WIDTH; x++)
+            {
+                spawn_particle(x, y, cell_get(x, y));
+            }
+            clear_row(y);
+        }
+    }
+
+    // Check vertical lines: a column is complete where every row has its bit
+    BoardRow fullColumns = BOARD_FULL_ROW;
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        fullColumns &= board.occupied[y];
+    }
+    for (int x = 0; x < BOARD_WIDTH; x++)
+    {
+        if ((fullColumns >> x) & 1)
+        {
+            linesCleared++;
+            lastClearedCol = x;
+            count_event(&colClears[x]);
+            // Clear the completed column
+            for (int y = 0; y < BOARD_HEIGHT; y++)
+            {
+                spawn_particle(x, y, cell_get(x, y));
+                cell_set(x, y, BLACK);
+            }
+        }
+    }
+
+    // Apply gravity effects if any lines were cleared
+    if (lastClearedRow != -1 || lastClearedCol != -1)
+    {
+        apply_gravity(lastClearedRow, lastClearedCol);
+    }
+
+    score_lines(linesCleared);
+
+    if (gameMode == MODE_PUZZLE && linesCleared > 0)
+    {
+        puzzleLinesLeft -= linesCleared;
+        if (puzzleLinesLeft <= 0)
+        {
+            roundWon = 1;
+            end_game(END_WON, 0);
+        }
+    }
+
+    if (gameMode == MODE_VERSUS && linesCleared >= 2)
+    {
+        send_garbage(linesCleared);
+    }
+
+    if (linesCleared > 0)
+    {
+        scoreDirty = 1;
+        trace_counter("lines cleared", linesCleared);
+    }
+    trace_end("check_lines");
+}
+
+/**
+* @brief Appends a little-endian value of count bytes
+*/
+uint8_t *put_bytes(uint8_t *out, uint32_t value, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        *out++ = value >> (8 * i);
+    }
+    return out;
+}
+
+/**
+* @brief Reads a little-endian value of count bytes
+*/
+uint32_t get_bytes(const uint8_t **in, int count)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        value |= (uint32_t)*(*in)++ << (8 * i);
+    }
+    return value;
+}
+
+/* Appends the low width bits (at most 32) of bits to a little-endian bit stream */
+static uint8_t *put_bits(uint8_t *out, uint64_t *pending, int *count, uint32_t bits, int width)
+{
+    *pending |= (uint64_t)(bits & (uint32_t)((1ull << width) - 1)) << *count;
+    *count += width;
+    while (*count >= 8)
+    {
+        *out++ = (uint8_t)*pending;
+        *pending >>= 8;
+        *count -= 8;
+    }
+    return out;
+}
+
+/* Reads the next width bits (at most 32) of a little-endian bit stream */
+static uint32_t take_bits(const uint8_t **in, uint64_t *pending, int *count, int width)
+{
+    while (*count < width)
+    {
+        *pending |= (uint64_t)*(*in)++ << *count;
+        *count += 8;
+    }
+    uint32_t bits = (uint32_t)(*pending & ((1ull << width) - 1));
+    *pending >>= width;
+    *count -= width;
+    return bits;
+}
+
+/* Number of set bits in the low 8 bits */
+static inline int bit_count8(uint32_t bits)
+{
+    bits &= 0xFF;
+    bits -= (bits >> 1) & 0x55;
+    bits = (bits & 0x33) + ((bits >> 2) & 0x33);
+    return (bits + (bits >> 4)) & 0xF;
+}
+
+/**
+* @brief Narrows a color word to one bit per non-BLACK nibble
+* 
+* Inverse of nibble_mask(): three shift-and-mask steps gather
+* bit 4k into bit k.
+*/
+static inline uint32_t nibble_bits(uint32_t word)
+{
+    word |= word >> 2;
+    word |= word >> 1;
+    word &= 0x11111111;
+    word = (word | word >> 3) & 0x03030303;
+    word = (word | word >> 6) & 0x000F000F;
+    return (word | word >> 12) & 0xFF;
+}
+
+/**
+* @brief Nibble moves that pack the cells of an occupancy byte together
+* 
+* @param bits Occupancy of the eight cells of a color word
+* @param moves Receives, for each of three steps, the cells
+*              that move down by 1, 2 and 4 nibbles
+* 
+* The compress network of Hacker's Delight 7-4 on eight
+* elements: a prefix XOR finds, for every cell, how many empty
+* cells lie below it, and each step moves the cells whose
+* count has that bit set.
+*/
+static void nibble_moves(uint32_t bits, uint32_t moves[3])
+{
+    uint32_t below = (~bits << 1) & 0xFF;
+
+    for (int i = 0; i < 3; i++)
+    {
+        uint32_t odd = below ^ below << 1;
+        odd ^= odd << 2;
+        odd = (odd ^ odd << 4) & 0xFF;
+        moves[i] = odd & bits;
+        bits = (bits ^ moves[i]) | moves[i] >> (1 << i);
+        below &= ~odd;
+    }
+}
+
+/* Packs the occupied cells of a color word into its low nibbles */
+static uint32_t pack_nibbles(uint32_t word, uint32_t bits)
+{
+    uint32_t moves[3];
+
+    nibble_moves(bits, moves);
+    word &= nibble_mask(bits);
+    for (int i = 0; i < 3; i++)
+    {
+        uint32_t moving = word & nibble_mask(moves[i]);
+        word = (word ^ moving) | moving >> (4 << i);
+    }
+    return word;
+}
+
+/* Spreads packed low nibbles back out to the occupied cells, undoing pack_nibbles() */
+static uint32_t unpack_nibbles(uint32_t packed, uint32_t bits)
+{
+    uint32_t moves[3];
+
+    nibble_moves(bits, moves);
+    for (int i = 2; i >= 0; i--)
+    {
+        uint32_t mask = nibble_mask(moves[i]);
+        packed = (packed & ~mask) | (packed << (4 << i) & mask);
+    }
+    return packed & nibble_mask(bits);
+}
+
+/**
+* @brief Serializes the complete 2D game state into a packed blob
+* 
+* @param out Buffer of at least SNAPSHOT_MAX_BYTES
+* @return Blob length in bytes, 0 if the mode cannot be saved
+* 
+* 
+* Snapshot function that writes, in order:
+* 1. Header: magic, version, mode and board size (4 bytes)
+* 2. Score, speed (timer period) and RNG state (12 bytes)
+* 3. Tick phase, slot masks, focus and hold (4 bytes)
+* 4. Every active or pending piece: x, y and one byte of
+*    type, rotation and direction (3 bytes each)
+* 5. Queue ring (head plus 1 byte per entry) and the rest of
+*    the current bag (count plus two pieces per byte)
+* 6. Puzzle number and progress in MODE_PUZZLE (3 bytes)
+* 7. Board: one occupancy bit per cell, then a color nibble
+*    for each occupied cell only
+* 
+* A typical 20x20 game state packs into about 100 bytes
+* instead of the 400+ of the raw structures. Both directions
+* work a word at a time: occupancy rows go through the bit
+* stream whole, and each color word is packed to its occupied
+* nibbles with pack_nibbles() (unpack_nibbles() on load).
+* 
+* MODE_VERSUS (peer state lives on the link) and MODE_HYPER
+* (separate grid) are not saved.
+*/
+int snapshot_save(uint8_t *out)
+{
+    uint8_t *start = out;
+
+    if (gameMode == MODE_VERSUS || gameMode == MODE_HYPER)
+    {
+        return 0;
+    }
+
+    *out++ = SNAPSHOT_MAGIC;
+    *out++ = SNAPSHOT_VERSION << 4 | gameMode;
+    *out++ = BOARD_WIDTH;
+    *out++ = BOARD_HEIGHT;
+
+    out = put_bytes(out, score, 4);
+    out = put_bytes(out, speed, 4);
+    out = put_bytes(out, randState, 4);
+
+    *out++ = timeoutcount;
+    *out++ = activeSlots | pendingSpawns << 4;
+    *out++ = focusedPiece | holdUsed << 2;
+    *out++ = (heldType + 1) | heldDirection << 3;
+
+    for (int slot = 0; slot < MAX_ACTIVE_PIECES; slot++)
+    {
+        if ((activeSlots | pendingSpawns) & (1 << slot))
+        {
+            Piece *p = &activePieces[slot];
+            *out++ = (uint8_t)p->x;
+            *out++ = (uint8_t)p->y;
+            *out++ = p->type | p->rotation << 3 | p->direction << 5;
+        }
+    }
+
+    *out++ = queueHead;
+    for (int i = 0; i < NEXT_QUEUE_SIZE; i++)
+    {
+        *out++ = (nextQueue[i].type & 0x7) | nextQueue[i].direction << 3;
+    }
+    *out++ = bagCount;
+    for (int i = 0; i < bagCount; i += 2)
+    {
+        *out++ = bag[i] | ((i + 1 < bagCount) ? bag[i + 1] : 0) << 4;
+    }
+
+    if (gameMode == MODE_PUZZLE)
+    {
+        *out++ = puzzle - PUZZLES;
+        *out++ = puzzleNext;
+        *out++ = puzzleLinesLeft;
+    }
+
+    // Occupancy rows, then the packed colors of every color word
+    uint64_t pending = 0;
+    int count = 0;
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        out = put_bits(out, &pending, &count, (uint32_t)board.occupied[y], BOARD_WIDTH < 32 ? BOARD_WIDTH : 32);
+#if BOARD_WIDTH > 32
+        out = put_bits(out, &pending, &count, (uint32_t)(board.occupied[y] >> 32), BOARD_WIDTH - 32);
+#endif
+    }
+    if (count > 0)
+    {
+        *out++ = (uint8_t)pending;
+        pending = 0;
+        count = 0;
+    }
+
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        for (int i = 0; i < BOARD_ROW_WORDS; i++)
+        {
+            uint32_t bits = (uint32_t)(board.occupied[y] >> (i * 8)) & 0xFF;
+            if (bits)
+            {
+                out = put_bits(out, &pending, &count, pack_nibbles(board.colors[y][i], bits), 4 * bit_count8(bits));
+            }
+        }
+    }
+    if (count > 0)
+    {
+        *out++ = (uint8_t)pending;
+    }
+
+    return out - start;
+}
+
+/**
+* @brief Checks that a blob is complete before it is unpacked
+* 
+* @return 1 if the header matches this build, the length
+*         equals what the header, slot masks, bag count and
+*         occupancy bits imply, and every field that indexes
+*         an array is in range: pieces inside the board and
+*         clear of locked cells and each other, queue head, bag
+*         entries, directions and the puzzle number
+* 
+* Blobs also come from files on the host (TETRIS_INJECT,
+* tetris-archive seek), so nothing is trusted.
+*/
+int snapshot_valid(const uint8_t *in, int length)
+{
+    if (length < SNAPSHOT_HEADER_BYTES || in[0] != SNAPSHOT_MAGIC ||
+        (in[1] >> 4) != SNAPSHOT_VERSION || in[2] != BOARD_WIDTH || in[3] != BOARD_HEIGHT)
+    {
+        return 0;
+    }
+
+    int mode = in[1] & 0xF;
+    if (mode != MODE_CLASSIC && mode != MODE_QUAD && mode != MODE_PUZZLE)
+    {
+        return 0;
+    }
+    if ((in[SNAPSHOT_HEADER_BYTES - 1] >> 3) > 3) // Held piece direction
+    {
+        return 0;
+    }
 
-        // If a column was cleared (vertical line clear)
-        if (clearedCol != -1)
+    int slots = in[SNAPSHOT_HEADER_BYTES - 3];
+    int offset = SNAPSHOT_HEADER_BYTES;
+    int active[MAX_ACTIVE_PIECES]; // Blob offsets of the pieces in inflightMask
+    int activeCount = 0;
+    for (int slot = 0; slot < MAX_ACTIVE_PIECES; slot++)
+    {
+        if ((slots | slots >> 4) & (1 << slot))
         {
-            // Top-right quadrant: fall right
-            if (clearedCol >= centerX)
+            if (offset + 3 > length)
             {
-                for (int x = BOARD_WIDTH - 2; x >= centerX; x--)
-                {
-                    for (int y = 0; y < centerY; y++)
-                    {
-                        if (board.cells[y][x] != BLACK && board.cells[y][x + 1] == BLACK)
-                        {
-                            board.cells[y][x + 1] = board.cells[y][x];
-                            board.cells[y][x] = BLACK;
-                            changes++;
-                        }
-                    }
-                }
+                return 0;
             }
-            // Top-left quadrant: fall left
-            else
+            if (slots & (1 << slot))
             {
-                for (int x = 1; x < centerX; x++)
-                {
-                    for (int y = 0; y < centerY; y++)
-                    {
-                        if (board.cells[y][x] != BLACK && board.cells[y][x - 1] == BLACK)
-                        {
-                            board.cells[y][x - 1] = board.cells[y][x];
-                            board.cells[y][x] = BLACK;
-                            changes++;
-                        }
-                    }
-                }
+                active[activeCount++] = offset;
             }
 
-            // Bottom-right quadrant: fall right
-            if (clearedCol >= centerX)
+            int x = (int8_t)in[offset];
+            int y = (int8_t)in[offset + 1];
+            int type = in[offset + 2] & 0x7;
+            if (type == 7 || (in[offset + 2] >> 5) > 3)
             {
-                for (int x = BOARD_WIDTH - 2; x >= centerX; x--)
-                {
-                    for (int y = centerY; y < BOARD_HEIGHT; y++)
-                    {
-                        if (board.cells[y][x] != BLACK && board.cells[y][x + 1] == BLACK)
-                        {
-                            board.cells[y][x + 1] = board.cells[y][x];
-                            board.cells[y][x] = BLACK;
-                            changes++;
-                        }
-                    }
-                }
+                return 0;
             }
-            // Bottom-left quadrant: fall left
-            else
+            ShapeBounds *b = &shapeBounds[type][(in[offset + 2] >> 3) & 0x3];
+            if (x + b->minX < 0 || x + b->maxX >= BOARD_WIDTH || y + b->minY < 0 || y + b->maxY >= BOARD_HEIGHT)
             {
-                for (int x = 1; x < centerX; x++)
-                {
-                    for (int y = centerY; y < BOARD_HEIGHT; y++)
-                    {
-                        if (board.cells[y][x] != BLACK && board.cells[y][x - 1] == BLACK)
-                        {
-                            board.cells[y][x - 1] = board.cells[y][x];
-                            board.cells[y][x] = BLACK;
-                            changes++;
-                        }
-                    }
-                }
+                return 0;
             }
+            offset += 3;
+        }
+    }
+
+    if (offset + 1 + NEXT_QUEUE_SIZE > length || in[offset] >= NEXT_QUEUE_SIZE)
+    {
+        return 0;
+    }
+    for (int i = 1; i <= NEXT_QUEUE_SIZE; i++)
+    {
+        if ((in[offset + i] >> 3) > 3)
+        {
+            return 0;
+        }
+    }
+    offset += 1 + NEXT_QUEUE_SIZE;
+
+    int count = (offset < length) ? in[offset] : 8;
+    if (count > 7 || offset + 1 + (count + 1) / 2 > length)
+    {
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (((in[offset + 1 + i / 2] >> ((i & 1) * 4)) & 0xF) >= 7)
+        {
+            return 0;
+        }
+    }
+    offset += 1 + (count + 1) / 2;
+
+    if (mode == MODE_PUZZLE)
+    {
+        if (offset >= length || in[offset] >= PUZZLE_COUNT ||
+            PUZZLES[in[offset]].width != BOARD_WIDTH || PUZZLES[in[offset]].height != BOARD_HEIGHT)
+        {
+            return 0;
         }
+        offset += 3;
+    }
+    if (offset + SNAPSHOT_CELL_BYTES > length)
+    {
+        return 0;
+    }
 
-        // Redraw after each iteration to show the falling animation
-        if (changes > 0)
+    int occupied = 0;
+    for (int i = 0; i < SNAPSHOT_CELL_BYTES; i++)
+    {
+        for (uint8_t bits = in[offset + i]; bits; bits &= bits - 1)
         {
-            draw_board();
-            delay(50); // Add a small delay to make the falling animation visible
+            occupied++;
         }
+    }
+    if (offset + SNAPSHOT_CELL_BYTES + (occupied + 1) / 2 != length)
+    {
+        return 0;
+    }
 
-    } while (changes > 0); // Keep applying gravity until no more changes occur
+    /* Active pieces may not overlap locked cells or each other,
+       or occupancy_toggle() would cancel the shared cells.
+       Pending pieces stay out of inflightMask and go through
+       check_collision() when they spawn. */
+    const uint8_t *bits = in + offset;
+    uint64_t pending = 0;
+    int bitCount = 0;
+    BoardRow rows[BOARD_HEIGHT];
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        rows[y] = take_bits(&bits, &pending, &bitCount, BOARD_WIDTH < 32 ? BOARD_WIDTH : 32);
+#if BOARD_WIDTH > 32
+        rows[y] |= (BoardRow)take_bits(&bits, &pending, &bitCount, BOARD_WIDTH - 32) << 32;
+#endif
+    }
+    for (int i = 0; i < activeCount; i++)
+    {
+        const uint8_t *piece = in + active[i];
+        int type = piece[2] & 0x7;
+        int rotation = (piece[2] >> 3) & 0x3;
+        ShapeBounds *b = &shapeBounds[type][rotation];
+        for (int y = b->minY; y <= b->maxY; y++)
+        {
+            BoardRow cells = (BoardRow)shapeRowBits[type][rotation][y] << ((int8_t)piece[0] + b->minX);
+            BoardRow *row = &rows[(int8_t)piece[1] + y];
+            if (*row & cells)
+            {
+                return 0;
+            }
+            *row |= cells;
+        }
+    }
+    return 1;
 }
 
 /**
-* @brief Checks for and processes completed lines, updates score and speed
-* 
-* 
-* Comprehensive line clearing function that:
-* 1. Line detection:
-*    - Checks horizontal rows and vertical columns
-*    - Tracks number of lines cleared simultaneously
-*    - Records positions of last cleared row/column
-*    - Marks complete lines by setting cells to BLACK
-* 
-* 2. Scoring system:
-*    - SCORE_SINGLE (100): 1 line
-*    - SCORE_DOUBLE (300): 2 lines
-*    - SCORE_TRIPLE (500): 3 lines
-*    - SCORE_TETRIS (800): 4 lines
+* @brief Loads a snapshot_save() blob into the game state, without drawing
 * 
-* 3. Speed adjustment:
-*    - Decreases timer period based on:
-*      * Current score
-*      * Number of lines cleared
-*      * Base multiplier of 400
-*    - Has minimum speed threshold of 1000
-*    - Updates timer hardware registers:
-*      * TIMER_PERIODL: Lower 16 bits
-*      * TIMER_PERIODH: Upper 16 bits
+* @param in Blob
+* @param length Blob length in bytes
+* @return 1 on success, 0 if the blob is invalid (the game is
+*         left untouched)
 * 
-* 4. Follow-up actions:
-*    - Triggers gravity effects if lines cleared
-*    - Updates score display
-*    - Redraws game board
 * 
-* Called after:
-* - Piece locking
-* - Before spawning new piece
+* Load function that:
+* 1. Validates the blob with snapshot_valid() before changing
+*    anything
+* 2. Unpacks the fields in snapshot_save() order, rebuilding
+*    inflightMask from the active pieces
+* 3. Reprograms the timer period for the saved speed
 * 
-* Core scoring and difficulty progression mechanic
-* Unique vertical line clear feature
+* The session server swaps games in and out with this every
+* tick; snapshot_restore() adds the redraw.
 */
-void check_lines(void)
+int snapshot_load(const uint8_t *in, int length)
 {
-    int linesCleared = 0;
-    int lastClearedRow = -1;
-    int lastClearedCol = -1;
+    if (!snapshot_valid(in, length))
+    {
+        return 0;
+    }
+
+    gameMode = in[1] & 0xF;
+    in += 4;
+    score = get_bytes(&in, 4);
+    speed = get_bytes(&in, 4);
+    randState = get_bytes(&in, 4);
+
+    timeoutcount = *in++;
+    activeSlots = *in & 0xF;
+    pendingSpawns = *in++ >> 4;
+    focusedPiece = *in & 0x3;
+    holdUsed = (*in++ >> 2) & 1;
+    heldType = (*in & 0x7) - 1;
+    heldDirection = *in++ >> 3;
 
-    // Check horizontal lines
     for (int y = 0; y < BOARD_HEIGHT; y++)
     {
-        int complete = 1;
-        for (int x = 0; x < BOARD_WIDTH; x++)
+        inflightMask[y] = 0;
+    }
+    for (int slot = 0; slot < MAX_ACTIVE_PIECES; slot++)
+    {
+        if ((activeSlots | pendingSpawns) & (1 << slot))
         {
-            if (board.cells[y][x] == BLACK)
+            Piece *p = &activePieces[slot];
+            p->x = (int8_t)*in++;
+            p->y = (int8_t)*in++;
+            p->type = *in & 0x7;
+            p->rotation = (*in >> 3) & 0x3;
+            p->direction = *in++ >> 5;
+            if (activeSlots & (1 << slot))
             {
-                complete = 0;
-                break;
+                occupancy_toggle(p);
             }
         }
+    }
 
-        if (complete)
+    queueHead = *in++;
+    for (int i = 0; i < NEXT_QUEUE_SIZE; i++)
+    {
+        int type = *in & 0x7;
+        nextQueue[i].type = (type == 7) ? -1 : type;
+        nextQueue[i].direction = *in++ >> 3;
+    }
+    bagCount = *in++;
+    for (int i = 0; i < bagCount; i += 2)
+    {
+        bag[i] = *in & 0xF;
+        if (i + 1 < bagCount)
         {
-            linesCleared++;
-            lastClearedRow = y;
-            // Clear the completed row
-            for (int x = 0; x < BOARD_WIDTH; x++)
-            {
-                board.cells[y][x] = BLACK;
-            }
+            bag[i + 1] = *in >> 4;
         }
+        in++;
     }
 
-    // Check vertical lines
-    for (int x = 0; x < BOARD_WIDTH; x++)
+    if (gameMode == MODE_PUZZLE)
     {
-        int complete = 1;
-        for (int y = 0; y < BOARD_HEIGHT; y++)
-        {
-            if (board.cells[y][x] == BLACK)
-            {
-                complete = 0;
-                break;
-            }
-        }
+        puzzle = &PUZZLES[*in++];
+        puzzleNext = *in++;
+        puzzleLinesLeft = *in++;
+    }
 
-        if (complete)
+    /* Word at a time: each color word takes its packed nibbles
+       and its occupancy comes from the nibbles that are not BLACK */
+    const uint8_t *colors = in + SNAPSHOT_CELL_BYTES;
+    uint64_t pending = 0;
+    uint64_t colorPending = 0;
+    int count = 0;
+    int colorCount = 0;
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        BoardRow row = take_bits(&in, &pending, &count, BOARD_WIDTH < 32 ? BOARD_WIDTH : 32);
+#if BOARD_WIDTH > 32
+        row |= (BoardRow)take_bits(&in, &pending, &count, BOARD_WIDTH - 32) << 32;
+#endif
+
+        board.occupied[y] = 0;
+        for (int i = 0; i < BOARD_ROW_WORDS; i++)
         {
-            linesCleared++;
-            lastClearedCol = x;
-            // Clear the completed column
-            for (int y = 0; y < BOARD_HEIGHT; y++)
+            uint32_t bits = (uint32_t)(row >> (i * 8)) & 0xFF;
+            uint32_t word = 0;
+            if (bits)
             {
-                board.cells[y][x] = BLACK;
+                word = unpack_nibbles(take_bits(&colors, &colorPending, &colorCount, 4 * bit_count8(bits)), bits);
             }
+            board.colors[y][i] = word;
+            board.occupied[y] |= (BoardRow)nibble_bits(word) << (i * 8);
         }
+        boardDirty[y] = BOARD_FULL_ROW;
     }
 
-    // Apply gravity effects if any lines were cleared
-    if (lastClearedRow != -1 || lastClearedCol != -1)
+    gameOver = 0;
+    roundWon = 0;
+    queueMarkerSlot = -1;
+    queueDirty = (1 << NEXT_QUEUE_SIZE) - 1;
+    holdDirty = 1;
+
+    *TIMER_PERIODL = speed & 0xFFFF;
+    *TIMER_PERIODH = (speed >> 16) & 0xFFFF;
+    return 1;
+}
+
+/**
+* @brief Replaces the running game with a snapshot_save() blob
+* 
+* @param in Blob
+* @param length Blob length in bytes
+* @return 1 on success, 0 if the blob is invalid (the game is
+*         left untouched)
+* 
+* Loads the blob with snapshot_load(), drops the particles and
+* redraws the board, score, queue and hold.
+*/
+int snapshot_restore(const uint8_t *in, int length)
+{
+    if (!snapshot_load(in, length))
     {
-        apply_gravity(lastClearedRow, lastClearedCol);
+        return 0;
     }
 
-    // Update score
-    switch (linesCleared)
+    init_particles();
+    redraw_screen();
+    return 1;
+}
+
+/**
+* @brief Saves the game into the next quick-save slot
+* 
+* Slots are used round-robin, so the previous save survives
+* one more save and quick_resume() can step back to it.
+*/
+void quick_save(void)
+{
+    int length = snapshot_save(saveSlots[saveSlotNext]);
+    if (length == 0)
     {
-    case 1:
-        score += SCORE_SINGLE;
-        if (speed > 1000)
-        {
-            speed -= score * 400;
-        }
+        return;
+    }
 
-        break;
-    case 2:
-        score += SCORE_DOUBLE;
-        if (speed > 1000)
-        {
-            speed -= score * 400 * 2;
-        }
-        break;
-    case 3:
-        score += SCORE_TRIPLE;
-        if (speed > 1000)
-        {
-            speed -= score * 400 * 3;
-        }
-        break;
-    case 4:
-        score += SCORE_TETRIS;
-        if (speed > 1000)
-        {
-            speed -= score * 400 * 4;
-        }
-        break;
+    saveSlotLength[saveSlotNext] = length;
+    saveSlotLatest = saveSlotNext;
+    saveSlotNext = (saveSlotNext + 1) % SNAPSHOT_SLOTS;
+    print("Saved slot ");
+    print_dec(saveSlotLatest);
+    print("\n");
+}
+
+/**
+* @brief Resumes the most recent quick save
+* 
+* Each further resume steps back to the save before it, as
+* far as the slots reach.
+*/
+void quick_resume(void)
+{
+    if (gameMode == MODE_VERSUS || gameMode == MODE_HYPER || saveSlotLatest < 0)
+    {
+        return;
     }
 
-    int periodLow = (speed) & 0xFFFF;
-    int periodHigh = (speed >> 16) & 0xFFFF;
-    *TIMER_PERIODL = periodLow;
-    *TIMER_PERIODH = periodHigh;
+    int slot = saveSlotLatest;
+    if (snapshot_restore(saveSlots[slot], saveSlotLength[slot]))
+    {
+        print("Resumed slot ");
+        print_dec(slot);
+        print("\n");
+    }
 
-    if (linesCleared > 0)
+    int previous = (slot + SNAPSHOT_SLOTS - 1) % SNAPSHOT_SLOTS;
+    saveSlotLatest = saveSlotLength[previous] ? previous : slot;
+}
+
+/**
+* @brief Applies a direction switch to the focused piece
+* 
+* @param direction DIR_DOWN, DIR_UP, DIR_LEFT or DIR_RIGHT
+* 
+* In MODE_CLASSIC the focused piece changes its movement
+* direction. In MODE_QUAD every slot has a fixed direction, so
+* the switch instead moves the focus (button rotation) to the
+* piece travelling that way.
+*/
+void steer(int direction)
+{
+    if (gameMode == MODE_QUAD)
     {
-        draw_score();
-        draw_board();
+        focusedPiece = direction;
+    }
+    else if (activePieces[focusedPiece].direction != direction)
+    {
+        activePieces[focusedPiece].direction = direction;
     }
 }
 
@@ -1190,9 +3955,11 @@ void check_lines(void)
 * 1. Reads current state of all switches from hardware address
 * 2. Uses XOR operation to detect changed switches since last check
 * 3. Handles four directional switches (RIGHT, LEFT, UP, DOWN)
-* 4. Changes piece direction only if different from current direction
+* 4. Steers with steer(): changes the piece direction in
+*    MODE_CLASSIC, picks the piece to control in MODE_QUAD
 * 5. Implements priority order: RIGHT > LEFT > UP > DOWN
-* 6. Updates lastSwitchState for next comparison
+* 6. Swaps with the hold slot when SWITCH_HOLD changed
+* 7. Updates lastSwitchState for next comparison
 * 
 * Hardware specific details:
 * - Uses SWITCH_ADDRESS memory-mapped IO
@@ -1200,10 +3967,11 @@ void check_lines(void)
 * - Uses predefined direction constants (DIR_RIGHT, DIR_LEFT, etc.)
 * 
 * Switch mappings:
-* - SWITCH_RIGHT (0x1): Change direction to right
-* - SWITCH_LEFT (0x2): Change direction to left 
-* - SWITCH_UP (0x8): Change direction to up
-* - SWITCH_DOWN (0x4): Change direction to down
+* - SWITCH_RIGHT (0x1): Change direction to right (focus right piece)
+* - SWITCH_LEFT (0x2): Change direction to left (focus left piece)
+* - SWITCH_UP (0x8): Change direction to up (focus upper piece)
+* - SWITCH_DOWN (0x4): Change direction to down (focus lower piece)
+* - SWITCH_HOLD (0x10): Swap with the hold slot
 * 
 * Called every game tick to check for direction changes
 * Critical for implementing unique quad-directional gameplay mechanic
@@ -1213,39 +3981,52 @@ void handle_switch_changes(void)
     int currentSwitches = *SWITCH_ADDRESS & 0x3FF;
     int switchChanges = currentSwitches ^ lastSwitchState;
 
+    if (gameMode == MODE_HYPER)
+    {
+        hyper_switch_changes(switchChanges);
+        lastSwitchState = currentSwitches;
+        return;
+    }
+
+    // The hold switch works on any state change, like the direction switches
+    if (switchChanges & SWITCH_HOLD)
+    {
+        hold_piece();
+    }
+
+    if (switchChanges & SWITCH_SNAPSHOT)
+    {
+        if (*BUTTON_ADDRESS & 0x1)
+        {
+            quick_resume();
+        }
+        else
+        {
+            quick_save();
+        }
+    }
+
     if (switchChanges)
     {
         // Check if the right switch changed state (either on->off or off->on)
         if (switchChanges & SWITCH_RIGHT)
         {
-            if (currentPiece.direction != DIR_RIGHT)
-            {
-                currentPiece.direction = DIR_RIGHT;
-            }
+            steer(DIR_RIGHT);
         }
         // Check if the left switch changed state (either on->off or off->on)
         else if (switchChanges & SWITCH_LEFT)
         {
-            if (currentPiece.direction != DIR_LEFT)
-            {
-                currentPiece.direction = DIR_LEFT;
-            }
+            steer(DIR_LEFT);
         }
         // Check if the up switch changed state (either on->off or off->on)
         else if (switchChanges & SWITCH_UP)
         {
-            if (currentPiece.direction != DIR_UP)
-            {
-                currentPiece.direction = DIR_UP;
-            }
+            steer(DIR_UP);
         }
         // Check if the down switch changed state (either on->off or off->on)
         else if (switchChanges & SWITCH_DOWN)
         {
-            if (currentPiece.direction != DIR_DOWN)
-            {
-                currentPiece.direction = DIR_DOWN;
-            }
+            steer(DIR_DOWN);
         }
     }
 
@@ -1273,7 +4054,7 @@ void handle_interrupt(unsigned cause)
 * Input handler that:
 * 1. Reads button state from hardware address
 * 2. Detects rising edge (button press) using lastButtonState
-* 3. Triggers piece rotation on button press
+* 3. Triggers rotation of the focused piece on button press
 * 4. Updates lastButtonState for next check
 */
 void handle_input(void)
@@ -1282,13 +4063,22 @@ void handle_input(void)
 
     if (button && !lastButtonState)
     {
-        rotate_piece();
+        if (gameMode == MODE_HYPER)
+        {
+            hyper_rotate();
+        }
+        else if (activeSlots & (1 << focusedPiece))
+        {
+            rotate_piece(&activePieces[focusedPiece]);
+        }
     }
     lastButtonState = button;
 }
 
 /**
-* @brief Handles automatic piece movement based on current direction
+* @brief Moves one in-flight piece a step along its direction
+* 
+* @param slot activePieces index of the piece
 * 
 * 
 * Core movement function that:
@@ -1298,63 +4088,102 @@ void handle_input(void)
 *    - LEFT: Decrements X position
 *    - RIGHT: Increments X position
 * 
-* 2. Collision handling:
-*    - Checks for collisions after movement
-*    - If collision detected:
-*      * Reverts movement in opposite direction
-*      * Locks piece in last valid position
-*      * Checks for completed lines
-*      * Updates board display
-*      * Spawns new piece
+* 2. Collision handling:
+*    - Lifts the piece out of inflightMask and checks the
+*      new position with check_collision()
+*    - Another in-flight piece in the way: the move is
+*      undone and the piece simply waits for the next tick
+*    - Walls or locked cells in the way:
+*      * Reverts movement in opposite direction
+*      * Locks piece in last valid position
+*      * Checks for completed lines
+*      * Inserts pending versus garbage
+*      * Spawns a new piece into the same slot
+* 
+* Ensures consistent game pace
+* Handles end of piece lifecycle
+*/
+void move_piece(int slot)
+{
+    Piece *p = &activePieces[slot];
+    int dx = 0;
+    int dy = 0;
+
+    switch (p->direction)
+    {
+    case DIR_DOWN:
+        dy = 1;
+        break;
+    case DIR_UP:
+        dy = -1;
+        break;
+    case DIR_LEFT:
+        dx = -1;
+        break;
+    case DIR_RIGHT:
+        dx = 1;
+        break;
+    }
+
+    occupancy_toggle(p);
+    p->x += dx;
+    p->y += dy;
+
+    int hit = check_collision(p);
+    if (hit)
+    {
+        // Undo movement
+        p->x -= dx;
+        p->y -= dy;
+    }
+
+    if (hit == COLLIDE_BOARD)
+    {
+        activeSlots &= ~(1 << slot);
+        lock_piece(p);
+        check_lines();
+        insert_garbage();
+        if (!gameOver)
+        {
+            spawn_piece(slot);
+        }
+    }
+    else
+    {
+        occupancy_toggle(p);
+    }
+}
+
+/**
+* @brief Advances every in-flight piece by one step
+* 
+* Steps the pieces in slot order, so in MODE_QUAD a piece
+* freeing a cell lets a later slot move into it on the same
+* tick. Slots whose spawn was blocked by another piece retry
+* their spawn here.
 * 
 * Called:
 * - On timer tick
 * - When timeoutcount reaches threshold (20)
-* 
-* Ensures consistent game pace
-* Handles end of piece lifecycle
-* Core game loop mechanic
 */
 void handle_tick_movement(void)
 {
-    switch (currentPiece.direction)
+    if (gameMode == MODE_HYPER)
     {
-    case DIR_DOWN:
-        currentPiece.y++;
-        break;
-    case DIR_UP:
-        currentPiece.y--;
-        break;
-    case DIR_LEFT:
-        currentPiece.x--;
-        break;
-    case DIR_RIGHT:
-        currentPiece.x++;
-        break;
+        hyper_tick();
+        return;
     }
 
-    if (check_collision(&currentPiece))
+    for (int slot = 0; slot < MAX_ACTIVE_PIECES && !gameOver; slot++)
     {
-        // Undo movement
-        switch (currentPiece.direction)
+        if (activeSlots & (1 << slot))
         {
-        case DIR_DOWN:
-            currentPiece.y--;
-            break;
-        case DIR_UP:
-            currentPiece.y++;
-            break;
-        case DIR_LEFT:
-            currentPiece.x++;
-            break;
-        case DIR_RIGHT:
-            currentPiece.x--;
-            break;
+            move_piece(slot);
+        }
+        else if (pendingSpawns & (1 << slot))
+        {
+            spawn_piece(slot);
         }
-        lock_piece();
-        check_lines();
-        draw_board();
-        spawn_piece();
     }
 }
 
@@ -1396,8 +4225,8 @@ void init_timer(void)
 * 2. Character drawing process:
 *    - Converts game color to VGA-compatible color
 *    - Maps input character to correct pattern index
-*    - Renders pattern bit-by-bit to screen buffer
-*    - Handles screen boundary checking
+*    - Renders each row with draw_glyph() as scaled spans
+*    - Screen boundary clipping happens in fill_rect()
 *
 * 3. Pattern details:
 *    - Each character uses 12x12 pixel grid
@@ -1485,27 +4314,12 @@ void draw_large_char(int x, int y, char c, char color)
         return;
     }
 
-    // Draw the character line by line
+    // Draw the character line by line, each row as a 1-high glyph
     for (int row = 0; row < LARGE_CHAR_HEIGHT; row++)
     {
-        uint16_t pattern = charPatterns[patternIndex][row];
-        for (int col = 0; col < LARGE_CHAR_WIDTH; col++)
-        {
-            //Using the leftmost 12 of 16 bits. 
-            if (pattern & (0x8000 >> col))
-            {
-                //Calulates screen position
-                int pixelX = x + col;
-                int pixelY = y + row;
-
-                //Checks screen boundaries
-                if (pixelX >= 0 && pixelX < SCREEN_WIDTH &&
-                    pixelY >= 0 && pixelY < SCREEN_HEIGHT)
-                {
-                    VGA_PIXELS[pixelY * SCREEN_WIDTH + pixelX] = vgaColor; // Use the converted VGA color
-                }
-            }
-        }
+        //Using the leftmost 12 of 16 bits. 
+        uint16_t pattern = charPatterns[patternIndex][row] >> (16 - LARGE_CHAR_WIDTH);
+        draw_glyph(x, y + row * GLYPH_SCALE, pattern, LARGE_CHAR_WIDTH, 1, vgaColor);
     }
 }
 
@@ -1519,7 +4333,8 @@ void draw_large_char(int x, int y, char c, char color)
 *    - Calculates centered positions for text and score
 * 
 * 2. "GAME OVER" text rendering:
-*    - Uses large 12x12 characters in RED color
+*    - Uses large 12x12 characters in RED color (GREEN after
+*      winning a versus round)
 *    - Centers text horizontally using GAME_OVER_X constant
 *    - Places text vertically using GAME_OVER_Y constant
 *    - Adds 2-pixel spacing between characters
@@ -1546,19 +4361,13 @@ void draw_game_over(void)
     int x = GAME_OVER_X;
 
     // Clear screen first
-    for (int y = 0; y < SCREEN_HEIGHT; y++)
-    {
-        for (int x = 0; x < SCREEN_WIDTH; x++)
-        {
-            VGA_PIXELS[y * SCREEN_WIDTH + x] = BLACK;
-        }
-    }
+    clear_screen();
 
     // Draw each character in "GAME OVER"
     for (int i = 0; text[i] != '\0'; i++)
     {
-        draw_large_char(x, GAME_OVER_Y, text[i], RED);
-        x += LARGE_CHAR_WIDTH + 2; // Move right for next char with 2-pixel spacing
+        draw_large_char(x, GAME_OVER_Y, text[i], roundWon ? GREEN : RED);
+        x += LARGE_CHAR_PX + UI_PX(2); // Move right for next char with 2-pixel spacing
     }
 
     // Convert score to digits
@@ -1580,55 +4389,338 @@ void draw_game_over(void)
     }
 
     // Calculate center position for the score
-    int scoreWidth = digitCount * (DIGIT_WIDTH + 1);
+    int scoreWidth = digitCount * DIGIT_ADVANCE;
     int scoreX = (SCREEN_WIDTH - scoreWidth) / 2;
-    int scoreY = GAME_OVER_Y + LARGE_CHAR_HEIGHT + 20;
+    int scoreY = GAME_OVER_Y + LARGE_CHAR_PX + UI_PX(20);
 
     // Draw score digits using same pattern as draw_score function
     for (int i = digitCount - 1; i >= 0; i--)
     {
-        int digit = digits[i] - '0'; // Convert char to number
-        unsigned long pattern = DIGIT_PATTERNS[digit];
+        draw_glyph(scoreX, scoreY, DIGIT_PATTERNS[digits[i] - '0'],
+                   DIGIT_WIDTH, DIGIT_HEIGHT, WHITE);
+        scoreX += DIGIT_ADVANCE;
+    }
+}
+
+/* Prints one "heat <label> n n ..." line */
+static void print_counters(const char *label, const uint16_t *counters, int count)
+{
+    print("heat ");
+    print(label);
+    for (int i = 0; i < count; i++)
+    {
+        print(" ");
+        print_dec(counters[i]);
+    }
+    print("\n");
+}
+
+/**
+* @brief Dumps the lock and clear telemetry over the UART
+*
+* Line-oriented text, easy to grep out of the terminal log:
+*   heat board <width> <height>
+*   heat directions <down> <up> <left> <right>
+*   heat ends <topout> <garbage> <no pieces> <won>
+*   heat topouts <down> <up> <left> <right>
+*   heat rows <one count per row>
+*   heat cols <one count per column>
+*   heat cells <one count per cell>     (once per board row)
+*
+* Called on every game over. All counts are cumulative since
+* power-up.
+*/
+void export_telemetry(void)
+{
+    print("heat board ");
+    print_dec(BOARD_WIDTH);
+    print(" ");
+    print_dec(BOARD_HEIGHT);
+    print("\n");
+    print_counters("directions", directionLocks, 4);
+    print_counters("ends", gameEnds, END_CAUSES);
+    print_counters("topouts", topouts, 4);
+    print_counters("rows", rowClears, BOARD_HEIGHT);
+    print_counters("cols", colClears, BOARD_WIDTH);
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        print_counters("cells", lockHeat[y], BOARD_WIDTH);
+    }
+}
+
+#ifdef SERVER_BUILD
+/**
+* @brief Takes the piece, line and game-end counts since the last call
+*
+* The session server steps a different game on every call, so
+* its per-game stats come from these deltas rather than from
+* the power-up totals. Clears the counters it reads (lockHeat
+* is left to saturate; the server never shows it).
+*
+* @param pieces Receives the pieces locked
+* @param lines Receives the rows plus columns cleared
+* @return END_* cause of a game that ended, -1 if none did
+*/
+int take_telemetry(int *pieces, int *lines)
+{
+    int cause = -1;
+
+    *pieces = 0;
+    *lines = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        *pieces += directionLocks[i];
+        directionLocks[i] = 0;
+        topouts[i] = 0;
+    }
+    for (int i = 0; i < END_CAUSES; i++)
+    {
+        if (gameEnds[i] != 0)
+        {
+            cause = i;
+        }
+        gameEnds[i] = 0;
+    }
+    for (int y = 0; y < BOARD_HEIGHT; y++)
+    {
+        *lines += rowClears[y];
+        rowClears[y] = 0;
+    }
+    for (int x = 0; x < BOARD_WIDTH; x++)
+    {
+        *lines += colClears[x];
+        colClears[x] = 0;
+    }
+    return cause;
+}
+
+#define OBSERVATION_PLANE_BYTES ((BOARD_WIDTH * BOARD_HEIGHT + 7) / 8)
+
+/**
+* @brief Packs the board into bit planes for the vectorized environment
+*
+* Two planes of BOARD_WIDTH * BOARD_HEIGHT bits, each padded to
+* whole bytes: the locked cells, then the cells of the pieces in
+* flight. Cell (x, y) is bit y * BOARD_WIDTH + x of its plane,
+* least significant bit first.
+*
+* @param out Receives the planes; 0 to only ask for the size
+* @return Bytes written
+*/
+int observe_board(uint8_t *out)
+{
+    for (int plane = 0; out && plane < 2; plane++)
+    {
+        const BoardRow *rows = plane ? inflightMask : board.occupied;
+        uint64_t pending = 0;
+        int count = 0;
+
+        for (int y = 0; y < BOARD_HEIGHT; y++)
+        {
+            out = put_bits(out, &pending, &count, (uint32_t)rows[y], BOARD_WIDTH < 32 ? BOARD_WIDTH : 32);
+#if BOARD_WIDTH > 32
+            out = put_bits(out, &pending, &count, (uint32_t)(rows[y] >> 32), BOARD_WIDTH - 32);
+#endif
+        }
+        if (count > 0)
+        {
+            *out++ = (uint8_t)pending;
+        }
+    }
+    return 2 * OBSERVATION_PLANE_BYTES;
+}
+
+void board_dimensions(int *width, int *height)
+{
+    *width = BOARD_WIDTH;
+    *height = BOARD_HEIGHT;
+}
+#endif
+
+/* Maps count/max onto a black-blue-cyan-green-yellow-red ramp */
+static char heat_color(int count, int max)
+{
+    static const char HEAT_RAMP[8] = {0x00, 0x02, 0x03, 0x1F, 0x1C, 0xFC, 0xF0, 0xE0};
+
+    if (max == 0)
+    {
+        return HEAT_RAMP[0];
+    }
+    return HEAT_RAMP[(count * 7 + max - 1) / max];
+}
+
+/**
+* @brief Renders the telemetry as a heatmap on the game over screen
+*
+*
+* Heatmap function that:
+* 1. Sizes one square per board cell to fit above the
+*    GAME OVER text (at most HEAT_CELL_MAX pixels)
+* 2. Colors each square by its lockHeat count relative to the
+*    busiest cell
+* 3. Adds a strip right of the grid with rowClears and one
+*    below it with colClears, scaled to the busiest line
+* 4. Draws from heatmapRow on, one board row per step, until
+*    the frame budget runs out, and resumes there on the next
+*    call; heatmapRow is -1 once everything is drawn
+*
+* Called every frame of the game over screen; draw_game_over()
+* callers set heatmapRow to 0 to start, except in MODE_HYPER
+* which does not use the 2D board.
+*/
+void draw_heatmap(void)
+{
+    static int maxLocks;
+    static int maxClears;
+
+    int cell = HEAT_HEIGHT / (BOARD_HEIGHT + 2);
+    if (cell > HEAT_CELL_MAX)
+    {
+        cell = HEAT_CELL_MAX;
+    }
+    if (cell < 1 || heatmapRow < 0)
+    {
+        heatmapRow = -1;
+        return;
+    }
 
-        for (int y = 0; y < DIGIT_HEIGHT; y++)
+    if (heatmapRow == 0)
+    {
+        maxLocks = 0;
+        maxClears = 0;
+        for (int y = 0; y < BOARD_HEIGHT; y++)
         {
-            for (int x = 0; x < DIGIT_WIDTH; x++)
+            for (int x = 0; x < BOARD_WIDTH; x++)
             {
-                // Using the same bit pattern calculation as draw_score()
-                if (pattern & (1UL << (34 - (y * 5 + x))))
-                { 
-                    //Absolute screen position coordinates
-                    int pixelX = scoreX + x;
-                    int pixelY = scoreY + y;
-
-                    if (pixelX >= 0 && pixelX < SCREEN_WIDTH &&
-                        pixelY >= 0 && pixelY < SCREEN_HEIGHT)
-                    {
-                        VGA_PIXELS[pixelY * SCREEN_WIDTH + pixelX] = WHITE;
-                    }
+                if (lockHeat[y][x] > maxLocks)
+                {
+                    maxLocks = lockHeat[y][x];
                 }
             }
+            if (rowClears[y] > maxClears)
+            {
+                maxClears = rowClears[y];
+            }
+        }
+        for (int x = 0; x < BOARD_WIDTH; x++)
+        {
+            if (colClears[x] > maxClears)
+            {
+                maxClears = colClears[x];
+            }
+        }
+    }
+
+    int left = (SCREEN_WIDTH - (BOARD_WIDTH + 2) * cell) / 2;
+    int steps = 0;
+    for (; heatmapRow < BOARD_HEIGHT; heatmapRow++)
+    {
+        if (steps++ > 0 && !frame_budget_left())
+        {
+            return;
+        }
+
+        int y = heatmapRow;
+        for (int x = 0; x < BOARD_WIDTH; x++)
+        {
+            fill_rect(left + x * cell, HEAT_Y + y * cell, cell, cell,
+                      heat_color(lockHeat[y][x], maxLocks));
         }
-        scoreX += DIGIT_WIDTH + 1;
+        fill_rect(left + (BOARD_WIDTH + 1) * cell, HEAT_Y + y * cell, cell, cell,
+                  heat_color(rowClears[y], maxClears));
+    }
+
+    if (steps > 0 && !frame_budget_left())
+    {
+        return;
+    }
+    for (int x = 0; x < BOARD_WIDTH; x++)
+    {
+        fill_rect(left + x * cell, HEAT_Y + (BOARD_HEIGHT + 1) * cell, cell, cell,
+                  heat_color(colClears[x], maxClears));
     }
+    heatmapRow = -1;
 }
 
-/* Main game loop */
-int main(void)
+/**
+* @brief Collects what the versus peer sent since the last frame
+* 
+* Drains the link without waiting, adds received garbage to
+* pendingGarbage and ends the round as a win once the peer
+* reports a top-out. Does nothing outside MODE_VERSUS.
+*/
+void poll_link(void)
 {
-game_start: // Label for restarting the game
-    print("Starting Tetris...\n");
+    if (gameMode != MODE_VERSUS)
+    {
+        return;
+    }
 
-    randState = *TIMER_STATUS; // Use whatever value is in the timer as our seed
-    init_timer();
+    link_poll();
+    pendingGarbage += link_take_garbage();
+    if (link_inbox()->peerToppedOut)
+    {
+        roundWon = 1;
+        end_game(END_WON, 0);
+    }
+}
 
+/**
+* @brief Sets up a new game for the switches sampled at start
+* 
+* @param seed Random seed for the bag and garbage holes
+* @param switches Switch bits selecting the mode and puzzle
+* 
+* Game setup function that:
+* 1. Resets score, speed, timer period, pieces, hold and the
+*    versus and puzzle state
+* 2. Picks the mode from the mode switches
+* 3. Builds the board (or hypergrid), the queue and the first
+*    pieces, and draws the whole screen
+* 
+* The link is left to the caller. Used by main() for every
+* (re)start and by the session server for new sessions, which
+* skips the drawing.
+*/
+void start_game(unsigned int seed, int switches)
+{
     // Reset game variables
+    randState = seed;
     speed = startSpeed;
     gameOver = 0;
     score = 0;
     timeoutcount = 0;
     lastButtonState = 0;
-    lastSwitchState = *SWITCH_ADDRESS & 0x3FF;
+    lastSwitchState = switches;
+    if (lastSwitchState & SWITCH_MODE_QUAD)
+    {
+        gameMode = MODE_QUAD;
+    }
+    else if (lastSwitchState & SWITCH_MODE_VERSUS)
+    {
+        gameMode = MODE_VERSUS;
+    }
+    else if (lastSwitchState & SWITCH_MODE_HYPER)
+    {
+        gameMode = MODE_HYPER;
+    }
+    else if (lastSwitchState & SWITCH_MODE_PUZZLE)
+    {
+        gameMode = MODE_PUZZLE;
+    }
+    else
+    {
+        gameMode = MODE_CLASSIC;
+    }
+    activeSlots = 0;
+    pendingSpawns = 0;
+    focusedPiece = 0;
+    heldType = -1;
+    heldDirection = DIR_DOWN;
+    holdUsed = 0;
+    holdDirty = 1;
+    pendingGarbage = 0;
+    roundWon = 0;
 
     // Reset update frequency (game speed)
     int periodLow = (speed) & 0xFFFF;
@@ -1636,81 +4728,261 @@ game_start: // Label for restarting the game
     *TIMER_PERIODL = periodLow;
     *TIMER_PERIODH = periodHigh;
 
-    // Initial screen clear
-    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++)
+    init_particles();
+    if (gameMode == MODE_HYPER)
+    {
+        clear_screen();
+        hyper_init(SCREEN_WIDTH, SCREEN_HEIGHT, UI_SCALE);
+        hyper_draw_grid();
+        draw_score();
+    }
+    else
     {
-        VGA_PIXELS[i] = BLACK;
+        init_board();
+        if (gameMode == MODE_PUZZLE && !start_puzzle(lastSwitchState & SWITCH_PUZZLE_SELECT))
+        {
+            gameMode = MODE_CLASSIC;
+        }
+        init_queue();
+        for (int slot = 0; slot < (gameMode == MODE_QUAD ? MAX_ACTIVE_PIECES : 1); slot++)
+        {
+            spawn_piece(slot);
+        }
+#ifndef SERVER_BUILD
+        redraw_screen();
+#endif
     }
+}
+
+#ifndef SERVER_BUILD
+/**
+* @brief Advances the particles, composes what changed and presents the frame
+*/
+static void draw_frame(void)
+{
+    prof_begin(PROF_PARTICLES);
+    update_particles();
+    prof_end(PROF_PARTICLES);
 
-    init_board();
-    spawn_piece();
-    draw_board();
-    draw_score();
+    prof_begin(PROF_RENDER);
+    refresh_active_pieces(0);
+    trace_begin("draw_deferred");
+    draw_deferred();
+    trace_end("draw_deferred");
+    prof_end(PROF_RENDER);
 
-    while (!gameOver)
+    *(VGA_CTRL + 1) = (uint32_t)(uintptr_t)VGA_PIXELS;
+    *(VGA_CTRL + 0) = 0;
+}
+#endif
+
+/**
+* @brief Runs one frame of the game loop
+* 
+* 
+* Frame function that:
+* 1. Polls the link and flags the tiles under the pieces
+* 2. Reads the button and switches
+* 3. Counts timer periods and moves the pieces on every 20th
+* 4. Advances the particles and composes what changed within
+*    the frame budget, then presents the frame
+* 5. Flushes the link
+* 
+* Called by main() with delay(10) between frames until
+* gameOver is set. The session server calls it once per tick
+* and is built without step 4, as its clients only get the
+* game state. With RENDER_THREAD, step 4 hands a snapshot to
+* the render thread instead, for every game that has one.
+*/
+void run_frame(void)
+{
+    frameStart = read_cycles();
+    prof_begin(PROF_FRAME);
+    poll_link();
+
+    // Tiles under the previous piece positions
+    refresh_active_pieces(1);
+
+    prof_begin(PROF_INPUT);
+    trace_begin("handle_input");
+    handle_input();
+    trace_end("handle_input");
+    trace_begin("handle_switch_changes");
+    handle_switch_changes();
+    trace_end("handle_switch_changes");
+    prof_end(PROF_INPUT);
+
+    prof_begin(PROF_RULES);
+    if (*TIMER_STATUS & 0x1)
+    {
+        timeoutcount++;
+        *TIMER_STATUS &= ~0x1;
+
+        if (timeoutcount >= 20)
+        {
+            timeoutcount = 0;
+            trace_begin("handle_tick_movement");
+            handle_tick_movement();
+            trace_end("handle_tick_movement");
+        }
+    }
+    prof_end(PROF_RULES);
+
+#if defined(RENDER_THREAD)
+    if (!render_publish()) // Versus and hyper games have no snapshot and still draw here
+    {
+        draw_frame();
+    }
+#elif !defined(SERVER_BUILD)
+    draw_frame();
+#endif
+
+    link_flush();
+    prof_end(PROF_FRAME);
+    prof_frame_done();
+}
+
+#ifdef RENDER_THREAD
+/**
+* @brief Shows a snapshot of the simulated game, on the render thread
+* 
+* @param in snapshot_save() blob published by run_frame()
+* @param length Blob length in bytes
+* @param full Non-zero to repaint the whole screen
+* 
+* Render function that:
+* 1. Flags the tiles under the pieces of the frame shown last
+* 2. Loads the blob into this thread's copy of the game
+* 3. Repaints everything on request or when the mode (and with
+*    it the layout) changed; otherwise narrows the board flags,
+*    which snapshot_load() sets for every cell, to the cells
+*    that differ from the frame shown last
+* 4. Composes and presents the frame like run_frame()
+* 
+* Line-clear particles are spawned by the rules on the
+* simulation thread, so they do not show here.
+*/
+void render_frame(const uint8_t *in, int length, int full)
+{
+    Board previous = board;
+    int previousScore = score;
+    int previousMode = gameMode;
+
+    frameStart = read_cycles();
+    refresh_active_pieces(1);
+    if (!snapshot_load(in, length))
+    {
+        return;
+    }
+
+    if (full || gameMode != previousMode)
+    {
+        init_particles();
+        redraw_screen();
+    }
+    else
     {
-        // Only clear the previous piece position
-        uint16_t oldShape = TETROMINOS[currentPiece.type][currentPiece.rotation];
-        for (int y = 0; y < 4; y++)
+        for (int y = 0; y < BOARD_HEIGHT; y++)
         {
-            for (int x = 0; x < 4; x++)
+            BoardRow changed = 0;
+            for (int x = 0; x < BOARD_WIDTH; x++)
             {
-                if ((oldShape >> (15 - (y * 4 + x))) & 1)
+                if (((previous.colors[y][x >> 3] ^ board.colors[y][x >> 3]) >> ((x & 7) * 4)) & 0xF)
                 {
-                    draw_block(currentPiece.x + x, currentPiece.y + y, BLACK);
+                    changed |= (BoardRow)1 << x;
                 }
             }
+            boardDirty[y] = changed;
         }
+        scoreDirty |= score != previousScore;
+    }
+    draw_frame();
+}
+#endif
 
-        handle_input();
-        handle_switch_changes();
+#ifndef SERVER_BUILD
+/* Main game loop */
+int main(void)
+{
+    init_preview_tiles();
+    init_shape_tables();
+    link_init(link_default_transport());
+#ifdef GRAVITY_CHECK
+    gravity_self_check();
+#endif
 
-        if (*TIMER_STATUS & 0x1)
-        {
-            timeoutcount++;
-            *TIMER_STATUS &= ~0x1;
+game_start: // Label for restarting the game
+    print("Starting Tetris...\n");
 
-            if (timeoutcount >= 20)
-            {
-                timeoutcount = 0;
-                handle_tick_movement();
-            }
-        }
+    unsigned int seed = *TIMER_STATUS; // Use whatever value is in the timer as our seed
+    init_timer();
 
-        draw_current_piece();
+    start_game(seed, *SWITCH_ADDRESS & 0x3FF);
+
+    link_reset();
+    if (gameMode == MODE_VERSUS)
+    {
+        link_queue_event(LINK_EV_HELLO, 0);
+    }
 
-        *(VGA_CTRL + 1) = (uint32_t)(uintptr_t)VGA_PIXELS;
-        *(VGA_CTRL + 0) = 0;
+#ifdef HOST_BUILD
+    host_inject_snapshot();
+#endif
+#ifdef RENDER_THREAD
+    render_resume(); // The render thread draws from here until the game ends
+#endif
 
+    while (!gameOver)
+    {
+        run_frame();
         delay(10);
     }
 
     // Stop timer interrupts
     *TIMER_CONTROL = 0;
+#ifdef RENDER_THREAD
+    render_pause(); // The game over screen is drawn here
+#endif
+
+    // Tell the peer it won; flushed by the loops below
+    if (gameMode == MODE_VERSUS && !roundWon)
+    {
+        link_queue_event(LINK_EV_TOPOUT, 0);
+    }
 
     // Clear the screen with a fade effect
-    for (int y = 0; y < SCREEN_HEIGHT; y++)
+    for (int y = 0; y < SCREEN_HEIGHT; y += UI_SCALE)
     {
-        for (int x = 0; x < SCREEN_WIDTH; x++)
-        {
-            VGA_PIXELS[y * SCREEN_WIDTH + x] = BLACK;
-        }
+        fill_rect(0, y, SCREEN_WIDTH, UI_SCALE, BLACK);
+        link_flush();
         delay(10); // Slow fade effect
     }
 
-    // Draw the game over screen
+    // Draw the game over screen; the heatmap follows row by row
+    trace_begin("draw_game_over");
     draw_game_over();
+    trace_end("draw_game_over");
+    heatmapRow = (gameMode != MODE_HYPER) ? 0 : -1;
 
     // Display game over message
     print("Game Over! Final Score: ");
     print_dec(score);
     print("\n");
+    export_telemetry();
     print("Press button to restart\n");
 
     // Wait for button press, with debounce
     int restart_button_state = 0;
     while (1)
     {
+        frameStart = read_cycles();
+        if (heatmapRow >= 0)
+        {
+            trace_begin("draw_heatmap");
+            draw_heatmap();
+            trace_end("draw_heatmap");
+        }
+
         int current_button = *BUTTON_ADDRESS & 0x1;
 
         // Check for button press (transition from 0 to 1)
@@ -1723,8 +4995,10 @@ game_start: // Label for restarting the game
             }
         }
         restart_button_state = current_button;
+        link_flush();
         delay(10);
     }
 
     return 0; // This line will never be reached
-}
\ No newline at end of file
+}
+#endif